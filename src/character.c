@@ -20,21 +20,887 @@
  */
 
 #include "internal.h"
+#include <ctype.h>
 
-SYMBOL_EXPORT void SelectSpritesheet(struct Game* game, struct Character* character, char* name) {
-	struct Spritesheet* tmp = character->spritesheets;
+#define MASK_CACHE_MAGIC "SDMK"
+#define MASK_CACHE_VERSION 1
+
+// how many successors/predecessors of the selected spritesheet are prefetched in lazy mode
+#define SPRITESHEET_PREFETCH_DEPTH 2
+
+static int GetMaskStride(int width) {
+	return (width + 7) / 8;
+}
+
+static void BuildFrameMask(struct SpritesheetFrame* frame) {
+	int width = al_get_bitmap_width(frame->_priv.image), height = al_get_bitmap_height(frame->_priv.image);
+	ALLEGRO_LOCKED_REGION* region = al_lock_bitmap(frame->_priv.image, ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE, ALLEGRO_LOCK_READONLY);
+	if (!region) {
+		return;
+	}
+	int stride = GetMaskStride(width);
+	frame->_priv.mask = calloc(stride * height, sizeof(uint8_t));
+	frame->_priv.mask_width = width;
+	frame->_priv.mask_height = height;
+	for (int y = 0; y < height; y++) {
+		const uint8_t* row = (const uint8_t*)region->data + y * region->pitch;
+		uint8_t* out = frame->_priv.mask + y * stride;
+		for (int x = 0; x < width; x++) {
+			if (row[x * 4 + 3]) {
+				out[x / 8] |= 1 << (x % 8);
+			}
+		}
+	}
+	al_unlock_bitmap(frame->_priv.image);
+}
+
+static void FreeFrameMask(struct SpritesheetFrame* frame) {
+	free(frame->_priv.mask);
+	frame->_priv.mask = NULL;
+}
+
+static bool TestFrameMask(struct SpritesheetFrame* frame, int x, int y) {
+	return frame->_priv.mask[y * GetMaskStride(frame->_priv.mask_width) + x / 8] & (1 << (x % 8));
+}
+
+static int64_t GetFileTimestamp(struct Game* game, const char* filename) {
+	const char* path = FindDataFilePath(game, filename);
+	if (!path) {
+		return 0;
+	}
+	ALLEGRO_FS_ENTRY* entry = al_create_fs_entry(path);
+	int64_t timestamp = al_get_fs_entry_mtime(entry);
+	al_destroy_fs_entry(entry);
+	return timestamp;
+}
+
+static int64_t GetSpritesheetTimestamp(struct Game* game, struct Spritesheet* spritesheet) {
+	int64_t timestamp = spritesheet->filepath ? GetFileTimestamp(game, spritesheet->filepath) : 0;
+	for (int i = 0; i < spritesheet->frame_count; i++) {
+		if (spritesheet->frames[i]._priv.filepath) {
+			timestamp = MAX(timestamp, GetFileTimestamp(game, spritesheet->frames[i]._priv.filepath));
+		}
+	}
+	return timestamp;
+}
+
+// Escapes everything but alphanumerics, so names with path separators stay within a single file name.
+static void AppendMaskCacheName(char* filename, size_t size, const char* name) {
+	size_t len = strlen(filename);
+	for (const char* c = name; *c && len + 4 < size; c++) {
+		if (isalnum((unsigned char)*c)) {
+			filename[len++] = *c;
+		} else {
+			len += snprintf(filename + len, size - len, "%%%02X", (unsigned char)*c);
+		}
+	}
+	filename[len] = '\0';
+}
+
+static ALLEGRO_PATH* GetMaskCachePath(struct Character* character, struct Spritesheet* spritesheet, bool create) {
+	ALLEGRO_PATH* path = al_get_standard_path(ALLEGRO_USER_DATA_PATH);
+	al_append_path_component(path, "masks");
+	if (create) {
+		al_make_directory(al_path_cstr(path, ALLEGRO_NATIVE_PATH_SEP));
+	}
+	char filename[255] = {0};
+	AppendMaskCacheName(filename, sizeof(filename) - 5, character->name);
+	strcat(filename, "-");
+	AppendMaskCacheName(filename, sizeof(filename) - 5, spritesheet->name);
+	strcat(filename, ".mask");
+	al_set_path_filename(path, filename);
+	return path;
+}
+
+static bool LoadMaskCache(struct Game* game, struct Character* character, struct Spritesheet* spritesheet, int64_t timestamp) {
+	const ALLEGRO_FILE_INTERFACE* iface = al_get_new_file_interface();
+	al_set_standard_file_interface();
+	ALLEGRO_PATH* path = GetMaskCachePath(character, spritesheet, false);
+	ALLEGRO_FILE* file = al_fopen(al_path_cstr(path, ALLEGRO_NATIVE_PATH_SEP), "rb");
+	al_destroy_path(path);
+	al_set_new_file_interface(iface);
+	if (!file) {
+		return false;
+	}
+
+	char magic[4];
+	bool valid = al_fread(file, magic, 4) == 4 && memcmp(magic, MASK_CACHE_MAGIC, 4) == 0 && al_fread32le(file) == MASK_CACHE_VERSION;
+	if (valid) {
+		int64_t stamp = (uint32_t)al_fread32le(file);
+		stamp |= (int64_t)al_fread32le(file) << 32;
+		valid = stamp == timestamp && al_fread32le(file) == spritesheet->frame_count;
+	}
+	for (int i = 0; valid && i < spritesheet->frame_count; i++) {
+		struct SpritesheetFrame* frame = &spritesheet->frames[i];
+		int width = al_fread32le(file), height = al_fread32le(file);
+		if (width != al_get_bitmap_width(frame->_priv.image) || height != al_get_bitmap_height(frame->_priv.image)) {
+			valid = false;
+			break;
+		}
+		size_t size = GetMaskStride(width) * height;
+		frame->_priv.mask = malloc(size);
+		frame->_priv.mask_width = width;
+		frame->_priv.mask_height = height;
+		valid = al_fread(file, frame->_priv.mask, size) == size;
+	}
+	al_fclose(file);
+
+	if (!valid) {
+		for (int i = 0; i < spritesheet->frame_count; i++) {
+			FreeFrameMask(&spritesheet->frames[i]);
+		}
+	}
+	return valid;
+}
+
+static void SaveMaskCache(struct Game* game, struct Character* character, struct Spritesheet* spritesheet, int64_t timestamp) {
+	for (int i = 0; i < spritesheet->frame_count; i++) {
+		if (!spritesheet->frames[i]._priv.mask) {
+			return;
+		}
+	}
+
+	const ALLEGRO_FILE_INTERFACE* iface = al_get_new_file_interface();
+	al_set_standard_file_interface();
+	ALLEGRO_PATH* path = GetMaskCachePath(character, spritesheet, true);
+	ALLEGRO_FILE* file = al_fopen(al_path_cstr(path, ALLEGRO_NATIVE_PATH_SEP), "wb");
+	al_destroy_path(path);
+	al_set_new_file_interface(iface);
+	if (!file) {
+		return;
+	}
+
+	al_fwrite(file, MASK_CACHE_MAGIC, 4);
+	al_fwrite32le(file, MASK_CACHE_VERSION);
+	al_fwrite32le(file, (int32_t)(timestamp & 0xFFFFFFFF));
+	al_fwrite32le(file, (int32_t)(timestamp >> 32));
+	al_fwrite32le(file, spritesheet->frame_count);
+	for (int i = 0; i < spritesheet->frame_count; i++) {
+		struct SpritesheetFrame* frame = &spritesheet->frames[i];
+		al_fwrite32le(file, frame->_priv.mask_width);
+		al_fwrite32le(file, frame->_priv.mask_height);
+		al_fwrite(file, frame->_priv.mask, GetMaskStride(frame->_priv.mask_width) * frame->_priv.mask_height);
+	}
+	al_fclose(file);
+}
+
+static void LoadSpritesheetMasks(struct Game* game, struct Character* character, struct Spritesheet* spritesheet) {
+	if (!spritesheet->frame_count || spritesheet->frames[0]._priv.mask) {
+		return;
+	}
+	bool cache = strtol(GetConfigOptionDefault(game, "SuperDerpy", "maskCache", "0"), NULL, 10);
+	int64_t timestamp = 0;
+	if (cache) {
+		timestamp = GetSpritesheetTimestamp(game, spritesheet);
+		if (timestamp && LoadMaskCache(game, character, spritesheet, timestamp)) {
+			return;
+		}
+	}
+	for (int i = 0; i < spritesheet->frame_count; i++) {
+		if (!spritesheet->frames[i]._priv.mask) {
+			BuildFrameMask(&spritesheet->frames[i]);
+		}
+	}
+	if (cache && timestamp) {
+		SaveMaskCache(game, character, spritesheet, timestamp);
+	}
+}
+
+static void GetSpritesheetFilename(struct Character* character, const char* file, char* filename) {
+	if (strstr(file, "../") == file) {
+		snprintf(filename, 255, "sprites/%s", file + 3);
+	} else {
+		snprintf(filename, 255, "sprites/%s/%s", character->name, file);
+	}
+}
+
+static bool IsSpritesheetLazy(struct Character* character, struct Spritesheet* spritesheet) {
+	// library instances may not be lazy, so they couldn't load what another instance has evicted
+	return character->lazy.enabled && !character->library && !spritesheet->stream && !spritesheet->shared;
+}
+
+// Counts characters displaying each spritesheet, so it's never evicted from under any of them (e.g. copies).
+static void SetCharacterSpritesheet(struct Character* character, struct Spritesheet* spritesheet) {
+	if (character->spritesheet) {
+		character->spritesheet->_priv.users--;
+	}
+	if (spritesheet) {
+		spritesheet->_priv.users++;
+	}
+	character->spritesheet = spritesheet;
+}
+
+// Bitmaps of a lazily loaded spritesheet decoded ahead of time into memory bitmaps
+struct SpritesheetPrefetch {
+	ALLEGRO_THREAD* thread;
+	ALLEGRO_STATE state;
+	int count;
+	char** filenames;
+	char** paths;
+	ALLEGRO_BITMAP** bitmaps;
+	volatile bool done;
+};
+
+static ALLEGRO_BITMAP* LoadSpritesheetBitmap(struct Game* game, struct Spritesheet* spritesheet, char* filename) {
+	struct SpritesheetPrefetch* prefetch = spritesheet->_priv.prefetch;
+	if (prefetch) {
+		for (int i = 0; i < prefetch->count; i++) {
+			if (prefetch->bitmaps[i] && !strcmp(prefetch->filenames[i], filename)) {
+				ALLEGRO_BITMAP* bitmap = AddPreloadedBitmap(game, filename, prefetch->bitmaps[i]);
+				prefetch->bitmaps[i] = NULL;
+				return bitmap;
+			}
+		}
+	}
+	return AddBitmap(game, filename);
+}
+
+// Packed copy of the frame data read by DrawCharacter and AnimateCharacter, so that the hot paths
+// don't have to walk over the much larger SpritesheetFrame structs
+struct SpritesheetHotFrame {
+	ALLEGRO_BITMAP* image; // sub-bitmap with the frame
+	ALLEGRO_COLOR tint;
+	int width, height; // size of the image in pixels
+	float x, y; // offset of the frame
+	float duration;
+	int flip; // ALLEGRO_FLIP_* flags of the frame
+	bool start;
+	bool end;
+};
+
+// Packed timing data of a spritesheet, used to jump over many frames at once
+struct SpritesheetTiming {
+	double offset; // sum of durations of all preceding frames
+	int first; // nearest frame marked as start at or before this one
+	int last; // nearest frame marked as end at or after this one
+};
+
+static void FillHotFrame(struct SpritesheetHotFrame* hot, struct SpritesheetFrame* frame) {
+	hot->image = frame->_priv.image;
+	hot->tint = frame->tint;
+	hot->width = hot->image ? al_get_bitmap_width(hot->image) : 0;
+	hot->height = hot->image ? al_get_bitmap_height(hot->image) : 0;
+	hot->x = frame->x;
+	hot->y = frame->y;
+	hot->duration = frame->duration;
+	hot->flip = (frame->flipX ? ALLEGRO_FLIP_HORIZONTAL : 0) | (frame->flipY ? ALLEGRO_FLIP_VERTICAL : 0);
+	hot->start = frame->start;
+	hot->end = frame->end;
+}
+
+static void FreeSpritesheetFrameData(struct Spritesheet* spritesheet) {
+	free(spritesheet->_priv.hot);
+	spritesheet->_priv.hot = NULL;
+	free(spritesheet->_priv.timing);
+	spritesheet->_priv.timing = NULL;
+}
+
+static void BuildSpritesheetFrameData(struct Spritesheet* spritesheet) {
+	FreeSpritesheetFrameData(spritesheet);
+	int count = spritesheet->frame_count;
+	if (!count) {
+		return;
+	}
+	struct SpritesheetHotFrame* hot = malloc(sizeof(struct SpritesheetHotFrame) * count);
+	for (int i = 0; i < count; i++) {
+		FillHotFrame(&hot[i], &spritesheet->frames[i]);
+	}
+	spritesheet->_priv.hot = hot;
+
+	struct SpritesheetTiming* timing = malloc(sizeof(struct SpritesheetTiming) * (count + 1));
+	timing[0].offset = 0.0;
+	int first = 0;
+	for (int i = 0; i < count; i++) {
+		if (hot[i].start) {
+			first = i;
+		}
+		timing[i].first = first;
+		timing[i + 1].offset = timing[i].offset + hot[i].duration;
+	}
+	int last = count - 1;
+	for (int i = count - 1; i >= 0; i--) {
+		if (hot[i].end) {
+			last = i;
+		}
+		timing[i].last = last;
+	}
+	spritesheet->_priv.timing = timing;
+}
+
+// Returns the packed data of the current frame. Streamed frames are replaced in place, so they
+// get copied into the given storage instead.
+static struct SpritesheetHotFrame* GetHotFrame(struct Character* character, struct SpritesheetHotFrame* streamed) {
+	if (!character->frame) {
+		return NULL;
+	}
+	if (character->spritesheet->_priv.hot && !character->spritesheet->stream) {
+		return &character->spritesheet->_priv.hot[character->pos];
+	}
+	FillHotFrame(streamed, character->frame);
+	return streamed;
+}
+
+// Jumps straight to the frame the accumulated delta lands on, as long as only plain frames
+// (neither start nor end ones, which have side effects) would be passed on the way.
+static void SkipCharacterFrames(struct Character* character) {
+	struct SpritesheetTiming* timing = character->spritesheet->_priv.timing;
+	int pos = character->pos;
+	if (character->reversing) {
+		double target = timing[pos + 1].offset - character->delta;
+		int lo = timing[pos].first, hi = pos;
+		while (lo < hi) {
+			int mid = (lo + hi) / 2;
+			if (timing[mid + 1].offset >= target) {
+				hi = mid;
+			} else {
+				lo = mid + 1;
+			}
+		}
+		character->delta = timing[lo + 1].offset - target;
+		character->pos = lo;
+	} else {
+		double target = timing[pos].offset + character->delta;
+		int lo = pos, hi = timing[pos].last;
+		while (lo < hi) {
+			int mid = (lo + hi + 1) / 2;
+			if (timing[mid].offset <= target) {
+				lo = mid;
+			} else {
+				hi = mid - 1;
+			}
+		}
+		character->delta = target - timing[lo].offset;
+		character->pos = lo;
+	}
+	character->frame = &character->spritesheet->frames[character->pos];
+}
+
+static void LoadSpritesheet(struct Game* game, struct Character* character, struct Spritesheet* tmp, void (*progress)(struct Game*)) {
+	tmp->_priv.loaded = true;
+	tmp->_priv.size = 0;
+	if (tmp->stream) {
+		return;
+	}
+	if ((!tmp->bitmap) && (tmp->file)) {
+		char filename[255] = {0};
+		GetSpritesheetFilename(character, tmp->file, filename);
+		tmp->filepath = strdup(filename);
+		tmp->bitmap = LoadSpritesheetBitmap(game, tmp, filename);
+		tmp->width = (al_get_bitmap_width(tmp->bitmap) / tmp->scale) / tmp->cols;
+		tmp->height = (al_get_bitmap_height(tmp->bitmap) / tmp->scale) / tmp->rows;
+		tmp->_priv.size += al_get_bitmap_width(tmp->bitmap) * al_get_bitmap_height(tmp->bitmap) * 4;
+	}
+	for (int i = 0; i < tmp->frame_count; i++) {
+		if ((!tmp->frames[i].bitmap) && (tmp->frames[i].file)) {
+			if (game->config.debug.enabled) {
+				PrintConsole(game, "  - %s", tmp->frames[i].file);
+			}
+			char filename[255] = {0};
+			GetSpritesheetFilename(character, tmp->frames[i].file, filename);
+			tmp->frames[i].bitmap = LoadSpritesheetBitmap(game, tmp, filename);
+			tmp->frames[i]._priv.filepath = strdup(filename);
+			tmp->_priv.size += al_get_bitmap_width(tmp->frames[i].bitmap) * al_get_bitmap_height(tmp->frames[i].bitmap) * 4;
+		} else if (!tmp->frames[i].bitmap) {
+			tmp->frames[i].bitmap = al_create_sub_bitmap(tmp->bitmap, tmp->frames[i].col * tmp->width * tmp->scale, tmp->frames[i].row * tmp->height * tmp->scale, tmp->width * tmp->scale, tmp->height * tmp->scale);
+		}
+		tmp->frames[i]._priv.image = al_create_sub_bitmap(tmp->frames[i].bitmap, tmp->frames[i].sx * tmp->scale, tmp->frames[i].sy * tmp->scale, (tmp->frames[i].sw > 0) ? (tmp->frames[i].sw * tmp->scale) : al_get_bitmap_width(tmp->frames[i].bitmap), (tmp->frames[i].sh > 0) ? (tmp->frames[i].sh * tmp->scale) : al_get_bitmap_height(tmp->frames[i].bitmap));
+
+		int width = al_get_bitmap_width(tmp->frames[i]._priv.image) / tmp->scale + MAX(0, tmp->frames[i].x) + MAX(0, tmp->offsetX);
+		if (width > tmp->width) {
+			tmp->width = width;
+		}
+		int height = al_get_bitmap_height(tmp->frames[i]._priv.image) / tmp->scale + MAX(0, tmp->frames[i].y) + MAX(0, tmp->offsetY);
+		if (height > tmp->height) {
+			tmp->height = height;
+		}
+		if (character->detailed_progress && progress) {
+			progress(game);
+		}
+	}
+	BuildSpritesheetFrameData(tmp);
+	LoadSpritesheetMasks(game, character, tmp);
+}
+
+static void UnloadSpritesheet(struct Game* game, struct Spritesheet* tmp) {
+	for (int i = 0; i < tmp->frame_count; i++) {
+		if (tmp->frames[i]._priv.filepath) {
+			RemoveBitmap(game, tmp->frames[i]._priv.filepath);
+			free(tmp->frames[i]._priv.filepath);
+			tmp->frames[i]._priv.filepath = NULL;
+			tmp->frames[i].bitmap = NULL;
+		} else if (tmp->frames[i].owned) {
+			al_destroy_bitmap(tmp->frames[i].bitmap);
+		} else if (tmp->bitmap) {
+			// sub-bitmap of the spritesheet
+			al_destroy_bitmap(tmp->frames[i].bitmap);
+			tmp->frames[i].bitmap = NULL;
+		}
+		al_destroy_bitmap(tmp->frames[i]._priv.image);
+		tmp->frames[i]._priv.image = NULL;
+		FreeFrameMask(&tmp->frames[i]);
+	}
+	if (tmp->bitmap && tmp->filepath) {
+		RemoveBitmap(game, tmp->filepath);
+		free(tmp->filepath);
+		tmp->filepath = NULL;
+	}
+	tmp->bitmap = NULL;
+	tmp->_priv.loaded = false;
+	FreeSpritesheetFrameData(tmp);
+}
+
+#ifndef LIBSUPERDERPY_SINGLE_THREAD
+static void* SpritesheetPrefetchThread(ALLEGRO_THREAD* thread, void* arg) {
+	struct SpritesheetPrefetch* prefetch = arg;
+	al_restore_state(&prefetch->state);
+	al_set_new_bitmap_flags(ALLEGRO_MEMORY_BITMAP);
+	for (int i = 0; i < prefetch->count; i++) {
+		if (prefetch->paths[i]) {
+			prefetch->bitmaps[i] = al_load_bitmap(prefetch->paths[i]);
+		}
+	}
+	prefetch->done = true;
+	return NULL;
+}
+#endif
+
+static void JoinSpritesheetPrefetch(struct SpritesheetPrefetch* prefetch) {
+	if (!prefetch || !prefetch->thread) {
+		return;
+	}
+	al_join_thread(prefetch->thread, NULL);
+	al_destroy_thread(prefetch->thread);
+	prefetch->thread = NULL;
+}
+
+static void FinishSpritesheetPrefetch(struct Game* game, struct Spritesheet* spritesheet) {
+	struct SpritesheetPrefetch* prefetch = spritesheet->_priv.prefetch;
+	if (!prefetch) {
+		return;
+	}
+	JoinSpritesheetPrefetch(prefetch);
+	for (int i = 0; i < prefetch->count; i++) {
+		if (prefetch->bitmaps[i]) {
+			al_destroy_bitmap(prefetch->bitmaps[i]);
+		}
+		free(prefetch->filenames[i]);
+		free(prefetch->paths[i]);
+	}
+	free(prefetch->filenames);
+	free(prefetch->paths);
+	free(prefetch->bitmaps);
+	free(prefetch);
+	spritesheet->_priv.prefetch = NULL;
+}
+
+static void PrefetchSpritesheet(struct Game* game, struct Character* character, struct Spritesheet* spritesheet) {
+#ifndef LIBSUPERDERPY_SINGLE_THREAD
+	if (!spritesheet || !IsSpritesheetLazy(character, spritesheet) || spritesheet->_priv.loaded || spritesheet->_priv.prefetch) {
+		return;
+	}
+	struct SpritesheetPrefetch* prefetch = calloc(1, sizeof(struct SpritesheetPrefetch));
+	prefetch->filenames = calloc(spritesheet->frame_count + 1, sizeof(char*));
+	prefetch->paths = calloc(spritesheet->frame_count + 1, sizeof(char*));
+	prefetch->bitmaps = calloc(spritesheet->frame_count + 1, sizeof(ALLEGRO_BITMAP*));
+	for (int i = -1; i < spritesheet->frame_count; i++) {
+		const char* file = (i < 0) ? (spritesheet->bitmap ? NULL : spritesheet->file) : (spritesheet->frames[i].bitmap ? NULL : spritesheet->frames[i].file);
+		if (!file) {
+			continue;
+		}
+		char filename[255] = {0};
+		GetSpritesheetFilename(character, file, filename);
+		const char* path = FindDataFilePath(game, filename);
+		prefetch->filenames[prefetch->count] = strdup(filename);
+		prefetch->paths[prefetch->count] = path ? strdup(path) : NULL;
+		prefetch->count++;
+	}
+	al_store_state(&prefetch->state, ALLEGRO_STATE_NEW_FILE_INTERFACE);
+	spritesheet->_priv.prefetch = prefetch;
+	prefetch->thread = al_create_thread(SpritesheetPrefetchThread, prefetch);
+	if (!prefetch->thread) {
+		// without the prefetch the spritesheet simply gets loaded synchronously once it's needed
+		PrintConsole(game, "Could not start prefetching %s spritesheet: %s", character->name, spritesheet->name);
+		FinishSpritesheetPrefetch(game, spritesheet);
+		return;
+	}
+	al_start_thread(prefetch->thread);
+#endif
+}
+
+static void PrefetchSpritesheetChain(struct Game* game, struct Character* character, const char* id, bool successors) {
+	for (int i = 0; id && i < SPRITESHEET_PREFETCH_DEPTH; i++) {
+		struct Spritesheet* spritesheet = GetSpritesheetByID(game, character, id);
+		if (!spritesheet) {
+			return;
+		}
+		PrefetchSpritesheet(game, character, spritesheet);
+		id = successors ? spritesheet->_priv.successor.id : spritesheet->_priv.predecessor.id;
+	}
+}
+
+static const char* GetSuccessorID(struct Game* game, struct Character* character) {
+	if (!character->successor) {
+		return NULL;
+	}
+	if (character->spritesheet && character->successor == character->spritesheet->_priv.successor.name) {
+		return character->spritesheet->_priv.successor.id;
+	}
+	// enqueued by hand
+	return FindInternedString(game, character->successor + (character->successor[0] == '-'));
+}
+
+static void EvictSpritesheets(struct Game* game, struct Character* character, struct Spritesheet* keep) {
+	size_t budget = character->lazy.budget;
+	if (!budget) {
+		budget = strtol(GetConfigOptionDefault(game, "SuperDerpy", "spritesheetBudget", "0"), NULL, 10) * 1024 * 1024;
+	}
+	if (!budget) {
+		return;
+	}
+	while (true) {
+		size_t used = 0;
+		struct Spritesheet* lru = NULL;
+		for (struct Spritesheet* tmp = character->spritesheets; tmp; tmp = tmp->next) {
+			if (!tmp->_priv.loaded || !IsSpritesheetLazy(character, tmp)) {
+				continue;
+			}
+			used += tmp->_priv.size;
+			if (tmp == keep || tmp->_priv.users > 0 || tmp->_priv.id == GetSuccessorID(game, character)) {
+				continue;
+			}
+			if (!lru || tmp->_priv.last_used < lru->_priv.last_used) {
+				lru = tmp;
+			}
+		}
+		if (used <= budget || !lru) {
+			return;
+		}
+		PrintConsole(game, "Evicting %s spritesheet: %s", character->name, lru->name);
+		UnloadSpritesheet(game, lru);
+	}
+}
+
+static void EnsureSpritesheetLoaded(struct Game* game, struct Character* character, struct Spritesheet* spritesheet) {
+	spritesheet->_priv.last_used = al_get_time();
+	if (spritesheet->_priv.loaded) {
+		return;
+	}
+	// prefetched bitmaps are picked up by LoadSpritesheet, so they have to be complete
+	JoinSpritesheetPrefetch(spritesheet->_priv.prefetch);
+	PrintConsole(game, "Loading %s spritesheet on demand: %s", character->name, spritesheet->name);
+	LoadSpritesheet(game, character, spritesheet, NULL);
+	FinishSpritesheetPrefetch(game, spritesheet);
+	EvictSpritesheets(game, character, spritesheet);
+}
+
+static void PollSpritesheetPrefetches(struct Game* game, struct Character* character) {
+	for (struct Spritesheet* tmp = character->spritesheets; tmp; tmp = tmp->next) {
+		if (tmp->_priv.prefetch && tmp->_priv.prefetch->done) {
+			EnsureSpritesheetLoaded(game, character, tmp);
+		}
+	}
+}
+
+struct StreamPrefetchEntry {
+	struct SpritesheetFrame frame;
+	int pos;
+};
+
+// Ring of frames of a streamed spritesheet, produced by calling the stream callback on a worker thread
+struct SpritesheetStreamPrefetch {
+	struct Game* game;
+	struct Spritesheet* spritesheet;
+	ALLEGRO_THREAD* thread;
+	ALLEGRO_MUTEX* mutex;
+	ALLEGRO_COND* cond;
+	ALLEGRO_STATE state;
+	struct StreamPrefetchEntry* ring;
+	int depth, head, count;
+	int next_pos;
+	double next_delta;
+	unsigned int generation; // bumped on flush, so frames produced for an old position get discarded
+	bool end, stop;
+};
+
+#ifndef LIBSUPERDERPY_SINGLE_THREAD
+static void* StreamPrefetchThread(ALLEGRO_THREAD* thread, void* arg) {
+	struct SpritesheetStreamPrefetch* prefetch = arg;
+	al_restore_state(&prefetch->state);
+	al_set_new_bitmap_flags(ALLEGRO_MEMORY_BITMAP);
+	al_lock_mutex(prefetch->mutex);
+	while (!prefetch->stop) {
+		if (prefetch->count == prefetch->depth || prefetch->end) {
+			al_wait_cond(prefetch->cond, prefetch->mutex);
+			continue;
+		}
+		int pos = prefetch->next_pos;
+		double delta = prefetch->next_delta;
+		unsigned int generation = prefetch->generation;
+		al_unlock_mutex(prefetch->mutex);
+
+		struct SpritesheetFrame frame = prefetch->spritesheet->stream(prefetch->game, delta, pos, prefetch->spritesheet->stream_data);
+		if (!frame.owned) {
+			frame.bitmap = al_clone_bitmap(frame.bitmap);
+			frame.owned = true;
+		}
+
+		al_lock_mutex(prefetch->mutex);
+		if (generation != prefetch->generation) {
+			al_destroy_bitmap(frame.bitmap);
+			continue;
+		}
+		struct StreamPrefetchEntry* entry = &prefetch->ring[(prefetch->head + prefetch->count) % prefetch->depth];
+		entry->frame = frame;
+		entry->pos = pos;
+		prefetch->count++;
+		prefetch->next_pos = pos + 1;
+		prefetch->next_delta = frame.duration;
+		prefetch->end = frame.end;
+		al_broadcast_cond(prefetch->cond);
+	}
+	al_unlock_mutex(prefetch->mutex);
+	return NULL;
+}
+#endif
+
+static void FlushStreamPrefetch(struct SpritesheetStreamPrefetch* prefetch) {
+	for (int i = 0; i < prefetch->count; i++) {
+		al_destroy_bitmap(prefetch->ring[(prefetch->head + i) % prefetch->depth].frame.bitmap);
+	}
+	prefetch->head = 0;
+	prefetch->count = 0;
+	prefetch->generation++;
+}
+
+static void StopStreamPrefetch(struct Game* game, struct Spritesheet* spritesheet) {
+	struct SpritesheetStreamPrefetch* prefetch = spritesheet->_priv.stream_prefetch;
+	if (!prefetch) {
+		return;
+	}
+	al_lock_mutex(prefetch->mutex);
+	prefetch->stop = true;
+	al_broadcast_cond(prefetch->cond);
+	al_unlock_mutex(prefetch->mutex);
+	al_join_thread(prefetch->thread, NULL);
+	al_destroy_thread(prefetch->thread);
+	FlushStreamPrefetch(prefetch);
+	al_destroy_cond(prefetch->cond);
+	al_destroy_mutex(prefetch->mutex);
+	free(prefetch->ring);
+	free(prefetch);
+	spritesheet->_priv.stream_prefetch = NULL;
+}
+
+static struct SpritesheetFrame GetStreamedFrame(struct Game* game, struct Spritesheet* spritesheet, double delta, int pos) {
+#ifndef LIBSUPERDERPY_SINGLE_THREAD
+	if (spritesheet->prefetch > 0) {
+		struct SpritesheetStreamPrefetch* prefetch = spritesheet->_priv.stream_prefetch;
+		if (!prefetch) {
+			prefetch = calloc(1, sizeof(struct SpritesheetStreamPrefetch));
+			prefetch->game = game;
+			prefetch->spritesheet = spritesheet;
+			prefetch->depth = spritesheet->prefetch;
+			prefetch->ring = calloc(prefetch->depth, sizeof(struct StreamPrefetchEntry));
+			prefetch->next_pos = pos;
+			prefetch->next_delta = delta;
+			prefetch->mutex = al_create_mutex();
+			prefetch->cond = al_create_cond();
+			al_store_state(&prefetch->state, ALLEGRO_STATE_NEW_FILE_INTERFACE);
+			prefetch->thread = al_create_thread(StreamPrefetchThread, prefetch);
+			spritesheet->_priv.stream_prefetch = prefetch;
+			al_start_thread(prefetch->thread);
+		}
+
+		al_lock_mutex(prefetch->mutex);
+		bool ahead = prefetch->count ? (prefetch->ring[prefetch->head].pos == pos) : (prefetch->next_pos == pos && !prefetch->end);
+		if (!ahead) {
+			// the position has been changed from outside, start over from the requested frame
+			FlushStreamPrefetch(prefetch);
+			prefetch->next_pos = pos;
+			prefetch->next_delta = delta;
+			prefetch->end = false;
+			al_broadcast_cond(prefetch->cond);
+		}
+		while (!prefetch->count) {
+			al_wait_cond(prefetch->cond, prefetch->mutex);
+		}
+		struct SpritesheetFrame frame = prefetch->ring[prefetch->head].frame;
+		prefetch->head = (prefetch->head + 1) % prefetch->depth;
+		prefetch->count--;
+		al_broadcast_cond(prefetch->cond);
+		al_unlock_mutex(prefetch->mutex);
+
+		// upload the decoded memory bitmap just before it's needed
+		ALLEGRO_BITMAP* bitmap = al_clone_bitmap(frame.bitmap);
+		al_destroy_bitmap(frame.bitmap);
+		frame.bitmap = bitmap;
+		return frame;
+	}
+#endif
+	return spritesheet->stream(game, delta, pos, spritesheet->stream_data);
+}
+
+static void DestroySpritesheet(struct Game* game, struct Spritesheet* tmp) {
+	UnwatchFile(game, tmp);
+	if (tmp->successor) {
+		free(tmp->successor);
+	}
+	if (tmp->predecessor) {
+		free(tmp->predecessor);
+	}
+	if (tmp->file) {
+		free(tmp->file);
+	}
+	FinishSpritesheetPrefetch(game, tmp);
+	for (int i = 0; i < tmp->frame_count; i++) {
+		if (tmp->frames[i]._priv.filepath && !tmp->shared) {
+			RemoveBitmap(game, tmp->frames[i]._priv.filepath);
+		} else {
+			al_destroy_bitmap(tmp->frames[i]._priv.image);
+		}
+		FreeFrameMask(&tmp->frames[i]);
+		if (tmp->frames[i].file) {
+			free(tmp->frames[i].file);
+		}
+		if (tmp->frames[i]._priv.filepath) {
+			free(tmp->frames[i]._priv.filepath);
+		}
+	}
+	StopStreamPrefetch(game, tmp);
+	if (tmp->stream && tmp->stream_destructor) {
+		tmp->stream_destructor(game, tmp->stream_data);
+	}
+	if (tmp->bitmap && !tmp->shared) {
+		RemoveBitmap(game, tmp->filepath);
+	}
+	if (tmp->filepath) {
+		free(tmp->filepath);
+	}
+	free(tmp->frames);
+	FreeSpritesheetFrameData(tmp);
+	free(tmp->name);
+	free(tmp);
+}
+
+// Spritesheet definitions shared by all characters created with CreateSharedCharacter under the same name
+struct SpritesheetLibrary {
+	char* name;
+	struct Spritesheet* spritesheets;
+	struct Spritesheet** map;
+	int references;
+	int loads;
+	bool loaded; // by the first LoadSpritesheets call, which other instances have to wait for
+};
+
+static bool SpritesheetLibraryIdentity(struct List* elem, void* data) {
+	struct SpritesheetLibrary* library = elem->data;
+	return strcmp(data, library->name) == 0;
+}
+
+static void ReleaseSpritesheetLibrary(struct Game* game, struct SpritesheetLibrary* library) {
+	al_lock_mutex(game->_priv.mutex);
+	bool last = --library->references == 0;
+	if (last) {
+		RemoveFromList(&game->_priv.spritesheet_library, library->name, SpritesheetLibraryIdentity);
+	}
+	al_unlock_mutex(game->_priv.mutex);
+	if (!last) {
+		return;
+	}
+	PrintConsole(game, "Destroying shared spritesheets of %s...", library->name);
+	struct Spritesheet* s = library->spritesheets;
+	while (s) {
+		struct Spritesheet* tmp = s;
+		s = s->next;
+		DestroySpritesheet(game, tmp);
+	}
+	free(library->map);
+	free(library->name);
+	free(library);
+}
+
+// Other instances may have registered new spritesheets in the meantime.
+static void SyncSpritesheetLibrary(struct Character* character) {
+	if (character->library) {
+		character->spritesheets = character->library->spritesheets;
+		character->spritesheets_map = character->library->map;
+	}
+}
+
+// Interned names are unique, so their addresses can be hashed directly.
+static int GetSpritesheetBucket(const char* id) {
+	return ((uintptr_t)id >> 4) % LIBSUPERDERPY_SPRITESHEET_HASHMAP_BUCKETS;
+}
+
+static struct SpritesheetLink ResolveSpritesheetLink(struct Game* game, const char* name) {
+	struct SpritesheetLink link = {.name = NULL, .id = NULL, .reversed = false};
+	if (name) {
+		link.name = InternString(game, name);
+		link.reversed = name[0] == '-';
+		link.id = InternString(game, link.reversed ? name + 1 : name);
+	}
+	return link;
+}
+
+static void InternSpritesheetNames(struct Game* game, struct Spritesheet* s) {
+	s->_priv.id = InternString(game, s->name);
+	s->_priv.successor = ResolveSpritesheetLink(game, s->successor);
+	s->_priv.predecessor = ResolveSpritesheetLink(game, s->predecessor);
+}
+
+static void AddSpritesheetToMap(struct Spritesheet*** map, struct Spritesheet* s) {
+	if (!*map) {
+		*map = calloc(LIBSUPERDERPY_SPRITESHEET_HASHMAP_BUCKETS, sizeof(struct Spritesheet*));
+	}
+	int bucket = GetSpritesheetBucket(s->_priv.id);
+	s->_priv.bucket_next = (*map)[bucket];
+	(*map)[bucket] = s;
+}
+
+SYMBOL_EXPORT struct Spritesheet* GetSpritesheetByID(struct Game* game, struct Character* character, const char* id) {
+	SyncSpritesheetLibrary(character);
+	if (!id || !character->spritesheets_map) {
+		return NULL;
+	}
+	struct Spritesheet* tmp = character->spritesheets_map[GetSpritesheetBucket(id)];
+	while (tmp) {
+		if (tmp->_priv.id == id) {
+			return tmp;
+		}
+		tmp = tmp->_priv.bucket_next;
+	}
+	return NULL;
+}
+
+SYMBOL_EXPORT void SelectSpritesheet(struct Game* game, struct Character* character, const char* name) {
 	bool reversed = false;
 	if (name[0] == '-') {
 		reversed = true;
 		name++;
 	}
-	PrintConsole(game, "Selecting spritesheet for %s: %s", character->name, name);
-	if (!tmp) {
+	const char* id = FindInternedString(game, name);
+	if (!id) {
+		// never registered anywhere, but let SelectSpritesheetByID report it
+		id = name;
+	}
+	SelectSpritesheetByID(game, character, id, reversed);
+}
+
+SYMBOL_EXPORT void SelectSpritesheetByID(struct Game* game, struct Character* character, const char* id, bool reversed) {
+	SyncSpritesheetLibrary(character);
+	PrintConsole(game, "Selecting spritesheet for %s: %s", character->name, id);
+	if (!character->spritesheets) {
 		PrintConsole(game, "ERROR: No spritesheets registered for %s!", character->name);
 		return;
 	}
+	struct Spritesheet* tmp = GetSpritesheetByID(game, character, id);
+	if (!tmp) {
+		PrintConsole(game, "ERROR: No spritesheets registered for %s with given name: %s", character->name, id);
+		return;
+	}
 
 	if (character->spritesheet && character->spritesheet->stream && character->frame) {
+		StopStreamPrefetch(game, character->spritesheet);
 		if (character->frame->owned) {
 			al_destroy_bitmap(character->frame->bitmap);
 		}
@@ -43,50 +909,38 @@ SYMBOL_EXPORT void SelectSpritesheet(struct Game* game, struct Character* charac
 		character->frame = NULL;
 	}
 
-	while (tmp) {
-		if (!strcmp(tmp->name, name)) {
-			if (character->successor) {
-				free(character->successor);
-			}
-			if (tmp->successor) {
-				character->successor = strdup(tmp->successor);
-			} else {
-				character->successor = NULL;
-			}
-			if (character->predecessor) {
-				free(character->predecessor);
-			}
-			if (tmp->predecessor) {
-				character->predecessor = strdup(tmp->predecessor);
-			} else {
-				character->predecessor = NULL;
-			}
-			character->repeats = tmp->repeats;
-			character->pos = reversed ? (tmp->frame_count - 1) : 0;
-			character->reversed = reversed;
-			character->reversing = tmp->reversed ^ reversed;
-			if (tmp->stream) {
-				character->frame = calloc(1, sizeof(struct SpritesheetFrame));
-				*(character->frame) = tmp->stream(game, 0.0, character->pos, tmp->stream_data);
-				character->frame->_priv.image = al_create_sub_bitmap(character->frame->bitmap, character->frame->sx * tmp->scale, character->frame->sy * tmp->scale, (character->frame->sw > 0) ? (character->frame->sw * tmp->scale) : al_get_bitmap_width(character->frame->bitmap), (character->frame->sh > 0) ? (character->frame->sh * tmp->scale) : al_get_bitmap_height(character->frame->bitmap));
-
-				tmp->width = al_get_bitmap_width(character->frame->bitmap);
-				tmp->height = al_get_bitmap_height(character->frame->bitmap);
-
-				if (character->frame->end) {
-					tmp->frame_count = character->pos + 1;
-				}
-			} else {
-				character->frame = &tmp->frames[character->pos];
-			}
-			character->finished = false;
-			character->spritesheet = tmp;
-			PrintConsole(game, "SUCCESS: Spritesheet for %s activated: %s (%dx%d)", character->name, character->spritesheet->name, character->spritesheet->width, character->spritesheet->height);
-			return;
+	if (IsSpritesheetLazy(character, tmp)) {
+		EnsureSpritesheetLoaded(game, character, tmp);
+	}
+	character->successor = tmp->_priv.successor.name;
+	character->predecessor = tmp->_priv.predecessor.name;
+	character->repeats = tmp->repeats;
+	character->pos = reversed ? (tmp->frame_count - 1) : 0;
+	character->reversed = reversed;
+	character->reversing = tmp->reversed ^ reversed;
+	if (tmp->stream) {
+		character->frame = calloc(1, sizeof(struct SpritesheetFrame));
+		*(character->frame) = GetStreamedFrame(game, tmp, 0.0, character->pos);
+		character->frame->_priv.mask = NULL;
+		character->frame->_priv.image = al_create_sub_bitmap(character->frame->bitmap, character->frame->sx * tmp->scale, character->frame->sy * tmp->scale, (character->frame->sw > 0) ? (character->frame->sw * tmp->scale) : al_get_bitmap_width(character->frame->bitmap), (character->frame->sh > 0) ? (character->frame->sh * tmp->scale) : al_get_bitmap_height(character->frame->bitmap));
+
+		tmp->width = al_get_bitmap_width(character->frame->bitmap);
+		tmp->height = al_get_bitmap_height(character->frame->bitmap);
+
+		if (character->frame->end) {
+			tmp->frame_count = character->pos + 1;
 		}
-		tmp = tmp->next;
+	} else {
+		character->frame = &tmp->frames[character->pos];
+	}
+	character->finished = false;
+	SetCharacterSpritesheet(character, tmp);
+	UpdateCharacterSpatialIndex(game, character);
+	if (character->lazy.enabled) {
+		PrefetchSpritesheetChain(game, character, tmp->_priv.successor.id, true);
+		PrefetchSpritesheetChain(game, character, tmp->_priv.predecessor.id, false);
 	}
-	PrintConsole(game, "ERROR: No spritesheets registered for %s with given name: %s", character->name, name);
+	PrintConsole(game, "SUCCESS: Spritesheet for %s activated: %s (%dx%d)", character->name, character->spritesheet->name, character->spritesheet->width, character->spritesheet->height);
 }
 
 SYMBOL_EXPORT void SwitchSpritesheet(struct Game* game, struct Character* character, char* name) {
@@ -106,11 +960,12 @@ SYMBOL_EXPORT void SwitchSpritesheet(struct Game* game, struct Character* charac
 	}
 }
 
-SYMBOL_EXPORT void EnqueueSpritesheet(struct Game* game, struct Character* character, char* name) {
-	if (character->successor) {
-		free(character->successor);
+SYMBOL_EXPORT void EnqueueSpritesheet(struct Game* game, struct Character* character, const char* name) {
+	struct SpritesheetLink link = ResolveSpritesheetLink(game, name);
+	character->successor = link.name;
+	if (character->lazy.enabled) {
+		PrefetchSpritesheetChain(game, character, link.id, true);
 	}
-	character->successor = strdup(name);
 }
 
 SYMBOL_EXPORT void SetSpritesheetPosition(struct Game* game, struct Character* character, int frame) {
@@ -128,71 +983,45 @@ SYMBOL_EXPORT void SetSpritesheetPosition(struct Game* game, struct Character* c
 	}
 }
 
-SYMBOL_EXPORT struct Spritesheet* GetSpritesheet(struct Game* game, struct Character* character, char* name) {
-	struct Spritesheet* tmp = character->spritesheets;
-	while (tmp) {
-		if (!strcmp(tmp->name, name)) {
-			return tmp;
-		}
-		tmp = tmp->next;
-	}
-	return NULL;
+SYMBOL_EXPORT struct Spritesheet* GetSpritesheet(struct Game* game, struct Character* character, const char* name) {
+	return GetSpritesheetByID(game, character, FindInternedString(game, name));
 }
 
 SYMBOL_EXPORT void LoadSpritesheets(struct Game* game, struct Character* character, void (*progress)(struct Game*)) {
-	PrintConsole(game, "Loading spritesheets for character %s...", character->name);
+	bool shared = false;
+	if (character->library) {
+		SyncSpritesheetLibrary(character);
+		al_lock_mutex(game->_priv.mutex);
+		shared = character->library->loads++ > 0;
+		bool loaded = character->library->loaded;
+		al_unlock_mutex(game->_priv.mutex);
+		while (shared && !loaded) {
+			// another loading thread is still loading the bitmaps
+			YieldLoadingThread(game);
+			al_lock_mutex(game->_priv.mutex);
+			loaded = character->library->loaded;
+			al_unlock_mutex(game->_priv.mutex);
+		}
+	}
+	if (!shared) {
+		PrintConsole(game, "Loading spritesheets for character %s...", character->name);
+	}
 	struct Spritesheet* tmp = character->spritesheets;
 	while (tmp) {
-		PrintConsole(game, "- %s", tmp->name);
-		if (!tmp->stream) {
-			if ((!tmp->bitmap) && (tmp->file)) {
-				char filename[255] = {0};
-				if (strstr(tmp->file, "../") == tmp->file) {
-					snprintf(filename, 255, "sprites/%s", tmp->file + 3);
-				} else {
-					snprintf(filename, 255, "sprites/%s/%s", character->name, tmp->file);
-				}
-				tmp->filepath = strdup(filename);
-				tmp->bitmap = AddBitmap(game, filename);
-				tmp->width = (al_get_bitmap_width(tmp->bitmap) / tmp->scale) / tmp->cols;
-				tmp->height = (al_get_bitmap_height(tmp->bitmap) / tmp->scale) / tmp->rows;
-			}
-			for (int i = 0; i < tmp->frame_count; i++) {
-				if ((!tmp->frames[i].bitmap) && (tmp->frames[i].file)) {
-					if (game->config.debug.enabled) {
-						PrintConsole(game, "  - %s", tmp->frames[i].file);
-					}
-					char filename[255] = {0};
-					if (strstr(tmp->frames[i].file, "../") == tmp->frames[i].file) {
-						snprintf(filename, 255, "sprites/%s", tmp->frames[i].file + 3);
-					} else {
-						snprintf(filename, 255, "sprites/%s/%s", character->name, tmp->frames[i].file);
-					}
-					tmp->frames[i].bitmap = AddBitmap(game, filename);
-					tmp->frames[i]._priv.filepath = strdup(filename);
-				} else if (!tmp->frames[i].bitmap) {
-					tmp->frames[i].bitmap = al_create_sub_bitmap(tmp->bitmap, tmp->frames[i].col * tmp->width * tmp->scale, tmp->frames[i].row * tmp->height * tmp->scale, tmp->width * tmp->scale, tmp->height * tmp->scale);
-				}
-				tmp->frames[i]._priv.image = al_create_sub_bitmap(tmp->frames[i].bitmap, tmp->frames[i].sx * tmp->scale, tmp->frames[i].sy * tmp->scale, (tmp->frames[i].sw > 0) ? (tmp->frames[i].sw * tmp->scale) : al_get_bitmap_width(tmp->frames[i].bitmap), (tmp->frames[i].sh > 0) ? (tmp->frames[i].sh * tmp->scale) : al_get_bitmap_height(tmp->frames[i].bitmap));
-
-				int width = al_get_bitmap_width(tmp->frames[i]._priv.image) / tmp->scale + MAX(0, tmp->frames[i].x) + MAX(0, tmp->offsetX);
-				if (width > tmp->width) {
-					tmp->width = width;
-				}
-				int height = al_get_bitmap_height(tmp->frames[i]._priv.image) / tmp->scale + MAX(0, tmp->frames[i].y) + MAX(0, tmp->offsetY);
-				if (height > tmp->height) {
-					tmp->height = height;
-				}
-				if (character->detailed_progress && progress) {
-					progress(game);
-				}
-			}
+		if (!shared && !IsSpritesheetLazy(character, tmp)) {
+			PrintConsole(game, "- %s", tmp->name);
+			LoadSpritesheet(game, character, tmp, progress);
 		}
 		if (progress) {
 			progress(game);
 		}
 		tmp = tmp->next;
 	}
+	if (character->library && !shared) {
+		al_lock_mutex(game->_priv.mutex);
+		character->library->loaded = true;
+		al_unlock_mutex(game->_priv.mutex);
+	}
 
 	if ((!character->spritesheet) && (character->spritesheets)) {
 		SelectSpritesheet(game, character, character->spritesheets->name);
@@ -200,23 +1029,25 @@ SYMBOL_EXPORT void LoadSpritesheets(struct Game* game, struct Character* charact
 }
 
 SYMBOL_EXPORT void UnloadSpritesheets(struct Game* game, struct Character* character) {
+	if (character->library) {
+		al_lock_mutex(game->_priv.mutex);
+		bool shared = --character->library->loads > 0;
+		if (!shared) {
+			character->library->loaded = false;
+		}
+		al_unlock_mutex(game->_priv.mutex);
+		if (shared) {
+			return;
+		}
+		SyncSpritesheetLibrary(character);
+	}
 	PrintConsole(game, "Unloading spritesheets for character %s...", character->name);
 	struct Spritesheet* tmp = character->spritesheets;
 	while (tmp) {
-		for (int i = 0; i < tmp->frame_count; i++) {
-			if (tmp->frames[i]._priv.filepath) {
-				RemoveBitmap(game, tmp->frames[i]._priv.filepath);
-			} else {
-				if (tmp->frames[i].owned) {
-					al_destroy_bitmap(tmp->frames[i].bitmap);
-				}
-			}
-			al_destroy_bitmap(tmp->frames[i]._priv.image);
+		FinishSpritesheetPrefetch(game, tmp);
+		if (tmp->_priv.loaded) {
+			UnloadSpritesheet(game, tmp);
 		}
-		if (tmp->bitmap) {
-			RemoveBitmap(game, tmp->filepath);
-		}
-		tmp->bitmap = NULL;
 		tmp = tmp->next;
 	}
 }
@@ -241,6 +1072,7 @@ SYMBOL_EXPORT void PreloadStreamedSpritesheet(struct Game* game, struct Characte
 		PrintConsole(game, "%s: tried to preload non-streaming spritesheet %s!", character->name, name);
 		return;
 	}
+	StopStreamPrefetch(game, spritesheet);
 
 	for (int i = 0; i < spritesheet->frame_count; i++) {
 		if (spritesheet->frames[i].file) {
@@ -259,6 +1091,7 @@ SYMBOL_EXPORT void PreloadStreamedSpritesheet(struct Game* game, struct Characte
 	while (true) {
 		PrintConsole(game, " - frame %d", i);
 		spritesheet->frames[i] = spritesheet->stream(game, delta, i, spritesheet->stream_data);
+		spritesheet->frames[i]._priv.mask = NULL;
 
 		if (!spritesheet->frames[i].owned) {
 			spritesheet->frames[i].bitmap = al_clone_bitmap(spritesheet->frames[i].bitmap);
@@ -289,36 +1122,108 @@ SYMBOL_EXPORT void PreloadStreamedSpritesheet(struct Game* game, struct Characte
 		}
 	}
 	spritesheet->frames = realloc(spritesheet->frames, sizeof(struct SpritesheetFrame) * spritesheet->frame_count);
+	for (i = 0; i < spritesheet->frame_count; i++) {
+		BuildFrameMask(&spritesheet->frames[i]);
+	}
 	if (spritesheet->stream_destructor) {
 		spritesheet->stream_destructor(game, spritesheet->stream_data);
 	}
 	spritesheet->stream = NULL;
 	spritesheet->stream_data = NULL;
 	spritesheet->stream_destructor = NULL;
+	spritesheet->_priv.loaded = true;
+	BuildSpritesheetFrameData(spritesheet);
+}
+
+// Parameters that can be changed without reloading the spritesheet.
+static void ParseSpritesheetParameters(struct Spritesheet* s, ALLEGRO_CONFIG* config) {
+	s->flipX = strtolnull(al_get_config_value(config, "animation", "flipX"), 0);
+	s->flipY = strtolnull(al_get_config_value(config, "animation", "flipY"), 0);
+
+	s->bidir = strtolnull(al_get_config_value(config, "animation", "bidir"), 0);
+	s->reversed = strtolnull(al_get_config_value(config, "animation", "reversed"), 0);
+
+	s->duration = strtodnull(al_get_config_value(config, "animation", "duration"), 16.66);
+	s->repeats = strtolnull(al_get_config_value(config, "animation", "repeats"), -1);
+
+	s->pivotX = strtodnull(al_get_config_value(config, "pivot", "x"), 0.5);
+	s->pivotY = strtodnull(al_get_config_value(config, "pivot", "y"), 0.5);
+
+	s->offsetX = strtolnull(al_get_config_value(config, "offset", "x"), 0);
+	s->offsetY = strtolnull(al_get_config_value(config, "offset", "y"), 0);
+
+	s->hitbox.x1 = strtodnull(al_get_config_value(config, "hitbox", "x1"), 0.0);
+	s->hitbox.y1 = strtodnull(al_get_config_value(config, "hitbox", "y1"), 0.0);
+	s->hitbox.x2 = strtodnull(al_get_config_value(config, "hitbox", "x2"), 0.0);
+	s->hitbox.y2 = strtodnull(al_get_config_value(config, "hitbox", "y2"), 0.0);
+
+	s->scale = strtodnull(al_get_config_value(config, "animation", "scale"), 1.0) * LIBSUPERDERPY_IMAGE_SCALE;
+}
+
+static void ParseSpritesheetFrameParameters(struct Spritesheet* s, int i, ALLEGRO_CONFIG* config) {
+	char framename[255];
+	snprintf(framename, 255, "frame%d", i);
+	s->frames[i].duration = strtodnull(al_get_config_value(config, framename, "duration"), s->duration);
+
+	s->frames[i].x = strtolnull(al_get_config_value(config, framename, "x"), 0);
+	s->frames[i].y = strtolnull(al_get_config_value(config, framename, "y"), 0);
+	s->frames[i].flipX = strtolnull(al_get_config_value(config, framename, "flipX"), 0);
+	s->frames[i].flipY = strtolnull(al_get_config_value(config, framename, "flipY"), 0);
+
+	double r = strtodnull(al_get_config_value(config, framename, "r"), 1.0);
+	double g = strtodnull(al_get_config_value(config, framename, "g"), 1.0);
+	double b = strtodnull(al_get_config_value(config, framename, "b"), 1.0);
+	double a = strtodnull(al_get_config_value(config, framename, "a"), 1.0);
+	s->frames[i].tint = al_premul_rgba_f(r, g, b, a);
+}
+
+SYMBOL_INTERNAL void ReloadSpritesheet(struct Game* game, struct Spritesheet* spritesheet, const char* path) {
+	ALLEGRO_CONFIG* config = al_load_config_file(path);
+	if (!config) {
+		PrintConsole(game, "Failed to reload spritesheet %s!", path);
+		return;
+	}
+	ParseSpritesheetParameters(spritesheet, config);
+
+	int frame_count = strtolnull(al_get_config_value(config, "animation", "frames"), 0);
+	if (frame_count == 0) {
+		int rows = strtolnull(al_get_config_value(config, "animation", "rows"), 0);
+		int cols = strtolnull(al_get_config_value(config, "animation", "cols"), 0);
+		frame_count = rows * cols - strtolnull(al_get_config_value(config, "animation", "blanks"), 0);
+	}
+	if (frame_count == spritesheet->frame_count) {
+		for (int i = 0; i < spritesheet->frame_count; i++) {
+			ParseSpritesheetFrameParameters(spritesheet, i, config);
+		}
+	} else {
+		PrintConsole(game, "Spritesheet %s has changed its frame count, reload the gamestate to see all the changes.", path);
+	}
+	if (spritesheet->_priv.hot) {
+		BuildSpritesheetFrameData(spritesheet);
+	}
+	al_destroy_config(config);
 }
 
 SYMBOL_EXPORT void RegisterSpritesheet(struct Game* game, struct Character* character, char* name) {
-	struct Spritesheet* s = character->spritesheets;
-	while (s) {
-		if (!strcmp(s->name, name)) {
+	if (GetSpritesheet(game, character, name)) {
+		if (!character->library) {
 			PrintConsole(game, "%s: spritesheet %s already registered!", character->name, name);
-			return;
 		}
-		s = s->next;
+		// otherwise already parsed by another instance
+		return;
 	}
 	PrintConsole(game, "Registering %s spritesheet: %s", character->name, name);
 	char filename[255] = {0};
 	snprintf(filename, 255, "sprites/%s/%s.ini", character->name, name);
-	ALLEGRO_CONFIG* config = al_load_config_file(GetDataFilePath(game, filename));
-	s = calloc(1, sizeof(struct Spritesheet));
+	const char* path = GetDataFilePath(game, filename);
+	ALLEGRO_CONFIG* config = al_load_config_file(path);
+	struct Spritesheet* s = calloc(1, sizeof(struct Spritesheet));
 	s->shared = false;
 	s->name = strdup(name);
 	s->bitmap = NULL;
 	s->frame_count = strtolnull(al_get_config_value(config, "animation", "frames"), 0);
 	s->rows = strtolnull(al_get_config_value(config, "animation", "rows"), 0);
 	s->cols = strtolnull(al_get_config_value(config, "animation", "cols"), 0);
-	s->flipX = strtolnull(al_get_config_value(config, "animation", "flipX"), 0);
-	s->flipY = strtolnull(al_get_config_value(config, "animation", "flipY"), 0);
 	int blanks = strtolnull(al_get_config_value(config, "animation", "blanks"), 0);
 	if (s->frame_count == 0) {
 		s->frame_count = s->rows * s->cols - blanks;
@@ -327,15 +1232,12 @@ SYMBOL_EXPORT void RegisterSpritesheet(struct Game* game, struct Character* char
 		s->cols = ceil(s->frame_count / (double)s->rows);
 	}
 
-	s->bidir = strtolnull(al_get_config_value(config, "animation", "bidir"), 0);
-	s->reversed = strtolnull(al_get_config_value(config, "animation", "reversed"), 0);
-
-	s->duration = strtodnull(al_get_config_value(config, "animation", "duration"), 16.66);
+	ParseSpritesheetParameters(s, config);
 
 	s->width = strtolnull(al_get_config_value(config, "animation", "width"), 0);
 	s->height = strtolnull(al_get_config_value(config, "animation", "height"), 0);
 
-	s->repeats = strtolnull(al_get_config_value(config, "animation", "repeats"), -1);
+	s->prefetch = strtolnull(al_get_config_value(config, "animation", "prefetch"), 0);
 
 	s->successor = NULL;
 	const char* successor = al_get_config_value(config, "animation", "successor");
@@ -365,40 +1267,19 @@ SYMBOL_EXPORT void RegisterSpritesheet(struct Game* game, struct Character* char
 		}
 	}
 
-	s->pivotX = strtodnull(al_get_config_value(config, "pivot", "x"), 0.5);
-	s->pivotY = strtodnull(al_get_config_value(config, "pivot", "y"), 0.5);
-
-	s->offsetX = strtolnull(al_get_config_value(config, "offset", "x"), 0);
-	s->offsetY = strtolnull(al_get_config_value(config, "offset", "y"), 0);
-
-	s->hitbox.x1 = strtodnull(al_get_config_value(config, "hitbox", "x1"), 0.0);
-	s->hitbox.y1 = strtodnull(al_get_config_value(config, "hitbox", "y1"), 0.0);
-	s->hitbox.x2 = strtodnull(al_get_config_value(config, "hitbox", "x2"), 0.0);
-	s->hitbox.y2 = strtodnull(al_get_config_value(config, "hitbox", "y2"), 0.0);
-
 	s->frames = calloc(s->frame_count, sizeof(struct SpritesheetFrame));
 
 	for (int i = 0; i < s->frame_count; i++) {
 		char framename[255];
 		snprintf(framename, 255, "frame%d", i);
-		s->frames[i].duration = strtodnull(al_get_config_value(config, framename, "duration"), s->duration);
+		ParseSpritesheetFrameParameters(s, i, config);
 
 		s->frames[i].bitmap = NULL;
 		s->frames[i]._priv.image = NULL;
-		s->frames[i].x = strtolnull(al_get_config_value(config, framename, "x"), 0);
-		s->frames[i].y = strtolnull(al_get_config_value(config, framename, "y"), 0);
 		s->frames[i].sx = strtolnull(al_get_config_value(config, framename, "sx"), 0);
 		s->frames[i].sy = strtolnull(al_get_config_value(config, framename, "sy"), 0);
 		s->frames[i].sw = strtolnull(al_get_config_value(config, framename, "sw"), 0);
 		s->frames[i].sh = strtolnull(al_get_config_value(config, framename, "sh"), 0);
-		s->frames[i].flipX = strtolnull(al_get_config_value(config, framename, "flipX"), 0);
-		s->frames[i].flipY = strtolnull(al_get_config_value(config, framename, "flipY"), 0);
-
-		double r = strtodnull(al_get_config_value(config, framename, "r"), 1.0);
-		double g = strtodnull(al_get_config_value(config, framename, "g"), 1.0);
-		double b = strtodnull(al_get_config_value(config, framename, "b"), 1.0);
-		double a = strtodnull(al_get_config_value(config, framename, "a"), 1.0);
-		s->frames[i].tint = al_premul_rgba_f(r, g, b, a);
 
 		s->frames[i].file = NULL;
 		const char* file = al_get_config_value(config, framename, "file");
@@ -426,18 +1307,46 @@ SYMBOL_EXPORT void RegisterSpritesheet(struct Game* game, struct Character* char
 		s->frames[i].end = i == (s->frame_count - 1) ? true : false;
 	}
 
-	s->scale = strtodnull(al_get_config_value(config, "animation", "scale"), 1.0) * LIBSUPERDERPY_IMAGE_SCALE;
-
 	s->stream = NULL;
 	s->stream_data = NULL;
 	s->stream_destructor = NULL;
 
+	al_destroy_config(config);
+
+	// interning takes the engine mutex, so it has to be done before publishing in the library
+	InternSpritesheetNames(game, s);
+	WatchFile(game, path, WATCHED_SPRITESHEET, s);
+
+	if (character->library) {
+		al_lock_mutex(game->_priv.mutex);
+		bool found = false;
+		for (struct Spritesheet* tmp = character->library->spritesheets; tmp; tmp = tmp->next) {
+			found |= !strcmp(tmp->name, name);
+		}
+		if (!found) {
+			AddSpritesheetToMap(&character->library->map, s);
+			s->next = character->library->spritesheets;
+			character->library->spritesheets = s;
+		}
+		SyncSpritesheetLibrary(character);
+		al_unlock_mutex(game->_priv.mutex);
+		if (found) {
+			// registered concurrently by another instance
+			DestroySpritesheet(game, s);
+		}
+		return;
+	}
+
+	AddSpritesheetToMap(&character->spritesheets_map, s);
 	s->next = character->spritesheets;
 	character->spritesheets = s;
-	al_destroy_config(config);
 }
 
 SYMBOL_EXPORT void RegisterStreamedSpritesheet(struct Game* game, struct Character* character, char* name, SpritesheetStream* callback, SpritesheetStreamDestructor* destructor, void* data) {
+	if (character->library) {
+		PrintConsole(game, "ERROR: %s: streamed spritesheets can't be registered in shared characters!", character->name);
+		return;
+	}
 	RegisterSpritesheet(game, character, name);
 	struct Spritesheet* spritesheet = GetSpritesheet(game, character, name);
 	spritesheet->stream = callback;
@@ -447,16 +1356,16 @@ SYMBOL_EXPORT void RegisterStreamedSpritesheet(struct Game* game, struct Charact
 }
 
 SYMBOL_EXPORT void RegisterSpritesheetFromBitmap(struct Game* game, struct Character* character, char* name, ALLEGRO_BITMAP* bitmap) {
-	struct Spritesheet* s = character->spritesheets;
-	while (s) {
-		if (!strcmp(s->name, name)) {
-			PrintConsole(game, "%s: spritesheet %s already registered!", character->name, name);
-			return;
-		}
-		s = s->next;
+	if (character->library) {
+		PrintConsole(game, "ERROR: %s: spritesheets from bitmaps can't be registered in shared characters!", character->name);
+		return;
+	}
+	if (GetSpritesheet(game, character, name)) {
+		PrintConsole(game, "%s: spritesheet %s already registered!", character->name, name);
+		return;
 	}
 	PrintConsole(game, "Registering %s spritesheet: %s (from bitmap)", character->name, name);
-	s = calloc(1, sizeof(struct Spritesheet));
+	struct Spritesheet* s = calloc(1, sizeof(struct Spritesheet));
 	s->name = strdup(name);
 	s->bitmap = bitmap;
 	s->frame_count = 1;
@@ -505,6 +1414,8 @@ SYMBOL_EXPORT void RegisterSpritesheetFromBitmap(struct Game* game, struct Chara
 	s->frames[0].start = true;
 	s->frames[0].end = true;
 
+	InternSpritesheetNames(game, s);
+	AddSpritesheetToMap(&character->spritesheets_map, s);
 	s->next = character->spritesheets;
 	character->spritesheets = s;
 }
@@ -518,6 +1429,7 @@ SYMBOL_EXPORT struct Character* CreateCharacter(struct Game* game, char* name) {
 	character->frame = NULL;
 	character->spritesheet = NULL;
 	character->spritesheets = NULL;
+	character->spritesheets_map = NULL;
 	character->pos = 0;
 	character->delta = 0.0;
 	character->successor = NULL;
@@ -543,7 +1455,35 @@ SYMBOL_EXPORT struct Character* CreateCharacter(struct Game* game, char* name) {
 	character->callback_data = NULL;
 	character->destructor = NULL;
 	character->detailed_progress = false;
+	character->lazy.enabled = false;
+	character->lazy.budget = 0;
+	character->library = NULL;
 	character->bounds.enabled = false;
+	character->keyframes.animation = NULL;
+	character->spatial.index = NULL;
+	character->spatial.entry = NULL;
+
+	return character;
+}
+
+SYMBOL_EXPORT struct Character* CreateSharedCharacter(struct Game* game, char* name) {
+	struct Character* character = CreateCharacter(game, name);
+	character->shared = true;
+
+	al_lock_mutex(game->_priv.mutex);
+	struct List* item = FindInList(game->_priv.spritesheet_library, name, SpritesheetLibraryIdentity);
+	struct SpritesheetLibrary* library = NULL;
+	if (item) {
+		library = item->data;
+	} else {
+		library = calloc(1, sizeof(struct SpritesheetLibrary));
+		library->name = strdup(name);
+		game->_priv.spritesheet_library = AddToList(game->_priv.spritesheet_library, library);
+	}
+	library->references++;
+	character->library = library;
+	SyncSpritesheetLibrary(character);
+	al_unlock_mutex(game->_priv.mutex);
 
 	return character;
 }
@@ -557,7 +1497,13 @@ SYMBOL_EXPORT void DestroyCharacter(struct Game* game, struct Character* charact
 		character->destructor(game, character);
 	}
 
-	if (character->spritesheet && character->spritesheet->stream) {
+	if (character->spatial.index) {
+		RemoveFromSpatialIndex(game, character->spatial.index, character);
+	}
+
+	if (character->shared) {
+		SetCharacterSpritesheet(character, NULL);
+	} else if (character->spritesheet && character->spritesheet->stream) {
 		if (character->frame) {
 			if (character->frame->owned) {
 				al_destroy_bitmap(character->frame->bitmap);
@@ -567,61 +1513,42 @@ SYMBOL_EXPORT void DestroyCharacter(struct Game* game, struct Character* charact
 		}
 	}
 
-	if (!character->shared) {
+	if (character->library) {
+		ReleaseSpritesheetLibrary(game, character->library);
+	} else if (!character->shared) {
 		struct Spritesheet* s = character->spritesheets;
 		while (s) {
 			struct Spritesheet* tmp = s;
 			s = s->next;
-			if (tmp->successor) {
-				free(tmp->successor);
-			}
-			if (tmp->predecessor) {
-				free(tmp->predecessor);
-			}
-			if (tmp->file) {
-				free(tmp->file);
-			}
-			for (int i = 0; i < tmp->frame_count; i++) {
-				if (tmp->frames[i]._priv.filepath && !tmp->shared) {
-					RemoveBitmap(game, tmp->frames[i]._priv.filepath);
-				} else {
-					al_destroy_bitmap(tmp->frames[i]._priv.image);
-				}
-				if (tmp->frames[i].file) {
-					free(tmp->frames[i].file);
-				}
-				if (tmp->frames[i]._priv.filepath) {
-					free(tmp->frames[i]._priv.filepath);
-				}
-			}
-			if (tmp->stream && tmp->stream_destructor) {
-				tmp->stream_destructor(game, tmp->stream_data);
-			}
-			if (tmp->bitmap && !tmp->shared) {
-				RemoveBitmap(game, tmp->filepath);
-			}
-			if (tmp->filepath) {
-				free(tmp->filepath);
-			}
-			free(tmp->frames);
-			free(tmp->name);
-			free(tmp);
+			DestroySpritesheet(game, tmp);
 		}
+		free(character->spritesheets_map);
 	}
 
-	if (character->successor) {
-		free(character->successor);
-	}
-	if (character->predecessor) {
-		free(character->predecessor);
-	}
 	if (character->name) {
 		free(character->name);
 	}
 	free(character);
 }
 
+// Uses the link resolved at registration, unless the name has been changed since (e.g. with EnqueueSpritesheet).
+static void SelectLinkedSpritesheet(struct Game* game, struct Character* character, const char* name, struct SpritesheetLink* link) {
+	if (name == link->name) {
+		SelectSpritesheetByID(game, character, link->id, link->reversed);
+	} else {
+		SelectSpritesheet(game, character, name);
+	}
+}
+
 SYMBOL_EXPORT void AnimateCharacter(struct Game* game, struct Character* character, float delta, float speed_modifier) {
+	if (character->lazy.enabled) {
+		PollSpritesheetPrefetches(game, character);
+	}
+
+	delta *= speed_modifier;
+	// keyframed properties keep changing while hidden, so they don't jump once shown again
+	AnimateCharacterKeyframes(game, character, delta);
+
 	if (IsCharacterHidden(game, character)) {
 		return;
 	}
@@ -630,14 +1557,21 @@ SYMBOL_EXPORT void AnimateCharacter(struct Game* game, struct Character* charact
 		return;
 	}
 
-	delta *= speed_modifier;
 	character->delta += delta * 1000;
 
+	struct SpritesheetHotFrame streamed;
+	struct SpritesheetHotFrame* frame = GetHotFrame(character, &streamed);
+
+	if (frame && !character->spritesheet->stream && character->spritesheet->_priv.timing && character->delta >= frame->duration) {
+		SkipCharacterFrames(character);
+		frame = GetHotFrame(character, &streamed);
+	}
+
 	int pos = character->pos;
 
-	while (character->frame && character->delta >= character->frame->duration) {
+	while (frame && character->delta >= frame->duration) {
 		bool reachedEnd = false;
-		character->delta -= character->frame->duration;
+		character->delta -= frame->duration;
 
 		if (character->reversing) {
 			if (character->spritesheet->stream) {
@@ -646,9 +1580,9 @@ SYMBOL_EXPORT void AnimateCharacter(struct Game* game, struct Character* charact
 				return;
 			}
 
-			if (character->frame->start) {
+			if (frame->start) {
 				if (character->spritesheet->bidir) {
-					if (!character->frame->end) {
+					if (!frame->end) {
 						character->pos++;
 					}
 					character->reversing = false;
@@ -663,14 +1597,14 @@ SYMBOL_EXPORT void AnimateCharacter(struct Game* game, struct Character* charact
 				character->pos--;
 			}
 		} else {
-			if (character->frame->end) {
+			if (frame->end) {
 				if (character->spritesheet->bidir) {
 					if (character->spritesheet->stream) {
 						FatalError(game, true, "Tried to animate streaming spritesheet '%s' of character '%s' in bidir", character->spritesheet->name, character->name);
 						QuitGame(game, false);
 						return;
 					}
-					if (!character->frame->start) {
+					if (!frame->start) {
 						character->pos--;
 					}
 					character->reversing = true;
@@ -695,13 +1629,13 @@ SYMBOL_EXPORT void AnimateCharacter(struct Game* game, struct Character* charact
 			} else {
 				if ((!character->reversed) && (character->successor)) {
 					struct Spritesheet* old = character->spritesheet;
-					SelectSpritesheet(game, character, character->successor);
+					SelectLinkedSpritesheet(game, character, character->successor, &old->_priv.successor);
 					if (character->callback) {
 						character->callback(game, character, character->spritesheet, old, character->callback_data);
 					}
 				} else if ((character->reversed) && (character->predecessor)) {
 					struct Spritesheet* old = character->spritesheet;
-					SelectSpritesheet(game, character, character->predecessor);
+					SelectLinkedSpritesheet(game, character, character->predecessor, &old->_priv.predecessor);
 					if (character->callback) {
 						character->callback(game, character, character->spritesheet, old, character->callback_data);
 					}
@@ -729,13 +1663,15 @@ SYMBOL_EXPORT void AnimateCharacter(struct Game* game, struct Character* charact
 				if (character->frame->owned) {
 					al_destroy_bitmap(character->frame->bitmap);
 				}
-				*(character->frame) = character->spritesheet->stream(game, duration, pos, character->spritesheet->stream_data);
+				*(character->frame) = GetStreamedFrame(game, character->spritesheet, duration, pos);
 				character->frame->_priv.image = image;
+				character->frame->_priv.mask = NULL;
 				al_reparent_bitmap(character->frame->_priv.image, character->frame->bitmap, character->frame->sx * character->spritesheet->scale, character->frame->sy * character->spritesheet->scale, (character->frame->sw > 0) ? (character->frame->sw * character->spritesheet->scale) : al_get_bitmap_width(character->frame->bitmap), (character->frame->sh > 0) ? (character->frame->sh * character->spritesheet->scale) : al_get_bitmap_height(character->frame->bitmap));
 			}
 		} else {
 			character->frame = &character->spritesheet->frames[character->pos];
 		}
+		frame = GetHotFrame(character, &streamed);
 	}
 }
 
@@ -767,6 +1703,7 @@ SYMBOL_EXPORT void MoveCharacterF(struct Game* game, struct Character* character
 	character->y += y;
 	character->angle += angle;
 	BoundCharacter(game, character);
+	UpdateCharacterSpatialIndex(game, character);
 }
 
 SYMBOL_EXPORT void SetCharacterPositionF(struct Game* game, struct Character* character, float x, float y, float angle) {
@@ -774,6 +1711,7 @@ SYMBOL_EXPORT void SetCharacterPositionF(struct Game* game, struct Character* ch
 	character->y = y;
 	character->angle = angle;
 	BoundCharacter(game, character);
+	UpdateCharacterSpatialIndex(game, character);
 }
 
 SYMBOL_EXPORT void SetCharacterPosition(struct Game* game, struct Character* character, float x, float y, float angle) {
@@ -814,9 +1752,11 @@ SYMBOL_EXPORT ALLEGRO_COLOR GetCharacterTint(struct Game* game, struct Character
 		color = character->tint;
 	}
 
+	struct SpritesheetHotFrame streamed;
+	struct SpritesheetHotFrame* frame = GetHotFrame(character, &streamed);
 	float r = 0, g = 0, b = 0, a = 0, r2 = 0, g2 = 0, b2 = 0, a2 = 0;
 	al_unmap_rgba_f(color, &r, &g, &b, &a);
-	al_unmap_rgba_f(character->frame->tint, &r2, &g2, &b2, &a2);
+	al_unmap_rgba_f(frame->tint, &r2, &g2, &b2, &a2);
 	return al_map_rgba_f(r * r2, g * g2, b * b2, a * a2);
 }
 
@@ -824,23 +1764,54 @@ static bool HasValidHitbox(struct Spritesheet* spritesheet) {
 	return spritesheet->hitbox.x1 != 0.0 && spritesheet->hitbox.y1 != 0.0 && spritesheet->hitbox.x2 != 0.0 && spritesheet->hitbox.y2 != 0.0;
 }
 
+// Checks whether the drawn quad, transformed to target coordinates, misses the clipping rectangle.
+static bool IsCharacterCulled(struct Game* game, struct Character* character, struct SpritesheetHotFrame* frame, ALLEGRO_TRANSFORM* transform) {
+	float x = frame->x + character->spritesheet->offsetX, y = frame->y + character->spritesheet->offsetY;
+	float w = frame->width / character->spritesheet->scale;
+	float h = frame->height / character->spritesheet->scale;
+	float xs[4] = {x, x + w, x, x + w}, ys[4] = {y, y, y + h, y + h};
+	float x1 = INFINITY, y1 = INFINITY, x2 = -INFINITY, y2 = -INFINITY;
+	for (int i = 0; i < 4; i++) {
+		al_transform_coordinates(transform, &xs[i], &ys[i]);
+		x1 = fminf(x1, xs[i]);
+		y1 = fminf(y1, ys[i]);
+		x2 = fmaxf(x2, xs[i]);
+		y2 = fmaxf(y2, ys[i]);
+	}
+
+	int cx, cy, cw, ch;
+	al_get_clipping_rectangle(&cx, &cy, &cw, &ch);
+	return x2 < cx || y2 < cy || x1 > cx + cw || y1 > cy + ch;
+}
+
 SYMBOL_EXPORT void DrawCharacter(struct Game* game, struct Character* character) {
 	if (IsCharacterHidden(game, character)) {
 		return;
 	}
 
+	struct Spritesheet* spritesheet = character->spritesheet;
+	struct SpritesheetHotFrame streamed;
+	struct SpritesheetHotFrame* frame = GetHotFrame(character, &streamed);
+
 	ALLEGRO_TRANSFORM current = *al_get_current_transform();
 
 	ALLEGRO_TRANSFORM transform = GetCharacterTransform(game, character);
 	al_compose_transform(&transform, &current);
+
+	if (IsCharacterCulled(game, character, frame, &transform)) {
+		game->_priv.sprites.culled++;
+		return;
+	}
+	game->_priv.sprites.drawn++;
+
 	al_use_transform(&transform);
 
-	al_draw_tinted_scaled_bitmap(character->frame->_priv.image, GetCharacterTint(game, character),
+	al_draw_tinted_scaled_bitmap(frame->image, GetCharacterTint(game, character),
 		0, 0,
-		al_get_bitmap_width(character->frame->_priv.image), al_get_bitmap_height(character->frame->_priv.image),
-		character->frame->x + character->spritesheet->offsetX, character->frame->y + character->spritesheet->offsetY,
-		al_get_bitmap_width(character->frame->_priv.image) / character->spritesheet->scale, al_get_bitmap_height(character->frame->_priv.image) / character->spritesheet->scale,
-		((character->spritesheet->flipX ^ character->frame->flipX) ? ALLEGRO_FLIP_HORIZONTAL : 0) | ((character->spritesheet->flipY ^ character->frame->flipY) ? ALLEGRO_FLIP_VERTICAL : 0));
+		frame->width, frame->height,
+		frame->x + spritesheet->offsetX, frame->y + spritesheet->offsetY,
+		frame->width / spritesheet->scale, frame->height / spritesheet->scale,
+		frame->flip ^ ((spritesheet->flipX ? ALLEGRO_FLIP_HORIZONTAL : 0) | (spritesheet->flipY ? ALLEGRO_FLIP_VERTICAL : 0)));
 
 	al_use_transform(&current);
 }
@@ -880,15 +1851,17 @@ SYMBOL_EXPORT void CopyCharacter(struct Game* game, struct Character* from, stru
 	}
 	to->name = from->name ? strdup(from->name) : NULL;
 	to->spritesheets = from->spritesheets;
-	to->spritesheet = from->spritesheet;
+	to->spritesheets_map = from->spritesheets_map;
+	SetCharacterSpritesheet(to, from->spritesheet);
 	to->frame = from->frame;
 	to->delta = from->delta;
 	to->pos = from->pos;
-	to->predecessor = from->predecessor ? strdup(from->predecessor) : NULL;
+	to->predecessor = from->predecessor;
 	to->repeats = from->repeats;
 	to->reversed = from->reversed;
 	to->reversing = from->reversing;
-	to->successor = from->successor ? strdup(from->successor) : NULL;
+	to->successor = from->successor;
+	to->lazy = from->lazy;
 	to->frame = &to->spritesheet->frames[to->pos];
 }
 
@@ -935,11 +1908,34 @@ SYMBOL_EXPORT float GetCharacterY(struct Game* game, struct Character* character
 	return character->y * GetCharacterConfineY(game, character);
 }
 
-static void SortTwoFloats(float* v1, float* v2) {
-	float pom = *v1;
-	if (*v1 > *v2) {
-		*v1 = *v2;
-		*v2 = pom;
+SYMBOL_EXPORT void GetCharacterBounds(struct Game* game, struct Character* character, bool hitbox, float* x1, float* y1, float* x2, float* y2) {
+	if (!character->spritesheet || !character->frame) {
+		*x1 = *y1 = *x2 = *y2 = 0;
+		return;
+	}
+
+	float xs[4], ys[4];
+	xs[0] = xs[2] = MIN(0.0, character->spritesheet->offsetX) + MIN(0.0, character->frame->x);
+	ys[0] = ys[1] = MIN(0.0, character->spritesheet->offsetY) + MIN(0.0, character->frame->y);
+	xs[1] = xs[3] = character->spritesheet->width;
+	ys[2] = ys[3] = character->spritesheet->height;
+
+	if (hitbox && HasValidHitbox(character->spritesheet)) {
+		xs[0] = xs[2] = character->spritesheet->hitbox.x1 * character->spritesheet->width;
+		ys[0] = ys[1] = character->spritesheet->hitbox.y1 * character->spritesheet->height;
+		xs[1] = xs[3] = character->spritesheet->hitbox.x2 * character->spritesheet->width;
+		ys[2] = ys[3] = character->spritesheet->hitbox.y2 * character->spritesheet->height;
+	}
+
+	ALLEGRO_TRANSFORM transform = GetCharacterTransform(game, character);
+	*x1 = *y1 = INFINITY;
+	*x2 = *y2 = -INFINITY;
+	for (int i = 0; i < 4; i++) {
+		al_transform_coordinates(&transform, &xs[i], &ys[i]);
+		*x1 = fminf(*x1, xs[i]);
+		*y1 = fminf(*y1, ys[i]);
+		*x2 = fmaxf(*x2, xs[i]);
+		*y2 = fmaxf(*y2, ys[i]);
 	}
 }
 
@@ -948,34 +1944,33 @@ SYMBOL_EXPORT bool IsOnCharacter(struct Game* game, struct Character* character,
 		return false;
 	}
 
-	float x1 = MIN(0.0, character->spritesheet->offsetX) + MIN(0.0, character->frame->x), y1 = MIN(0.0, character->spritesheet->offsetY) + MIN(0.0, character->frame->y);
-	float x2 = character->spritesheet->width, y2 = character->spritesheet->height;
-
-	if (HasValidHitbox(character->spritesheet)) {
-		PrintConsole(game, "valid %f %d", character->spritesheet->hitbox.x1, isnan(character->spritesheet->hitbox.x1));
-		x1 = character->spritesheet->hitbox.x1 * character->spritesheet->width;
-		y1 = character->spritesheet->hitbox.y1 * character->spritesheet->height;
-		x2 = character->spritesheet->hitbox.x2 * character->spritesheet->width;
-		y2 = character->spritesheet->hitbox.y2 * character->spritesheet->height;
-	}
-
-	ALLEGRO_TRANSFORM transform = GetCharacterTransform(game, character);
-	al_transform_coordinates(&transform, &x1, &y1);
-	al_transform_coordinates(&transform, &x2, &y2);
-	SortTwoFloats(&x1, &x2);
-	SortTwoFloats(&y1, &y2);
+	float x1, y1, x2, y2;
+	GetCharacterBounds(game, character, true, &x1, &y1, &x2, &y2);
 
 	bool test = ((x >= x1) && (x <= x2) && (y >= y1) && (y <= y2));
 
 	if (test && pixelperfect) {
+		ALLEGRO_TRANSFORM transform = GetCharacterTransform(game, character);
 		al_invert_transform(&transform);
 		al_transform_coordinates(&transform, &x, &y);
-		int xpos = (x - character->frame->x - character->spritesheet->offsetX) * character->spritesheet->scale;
-		int ypos = (y - character->frame->y - character->spritesheet->offsetY) * character->spritesheet->scale;
-		if (xpos < 0 || ypos < 0 || xpos >= al_get_bitmap_width(character->frame->_priv.image) || ypos >= al_get_bitmap_height(character->frame->_priv.image)) {
+		struct SpritesheetFrame* frame = character->frame;
+		int width = al_get_bitmap_width(frame->_priv.image), height = al_get_bitmap_height(frame->_priv.image);
+		int xpos = (x - frame->x - character->spritesheet->offsetX) * character->spritesheet->scale;
+		int ypos = (y - frame->y - character->spritesheet->offsetY) * character->spritesheet->scale;
+		if (xpos < 0 || ypos < 0 || xpos >= width || ypos >= height) {
 			return false;
 		}
-		ALLEGRO_COLOR color = al_get_pixel(character->frame->_priv.image, xpos, ypos);
+		if (character->spritesheet->flipX ^ frame->flipX) {
+			xpos = width - 1 - xpos;
+		}
+		if (character->spritesheet->flipY ^ frame->flipY) {
+			ypos = height - 1 - ypos;
+		}
+		if (frame->_priv.mask && frame->_priv.mask_width == width && frame->_priv.mask_height == height) {
+			return TestFrameMask(frame, xpos, ypos);
+		}
+		// streamed frames have no precomputed mask
+		ALLEGRO_COLOR color = al_get_pixel(frame->_priv.image, xpos, ypos);
 		return (color.a > 0.0);
 	}
 
@@ -50,6 +50,9 @@ struct SpritesheetFrame {
 	struct {
 		ALLEGRO_BITMAP* image;
 		char* filepath;
+		uint8_t* mask; /*!< 1-bit alpha mask of the frame image used for pixel-perfect hit testing. */
+		int mask_width;
+		int mask_height;
 	} _priv;
 };
 
@@ -59,6 +62,20 @@ typedef struct SpritesheetFrame SpritesheetStream(struct Game*, double, int, voi
 typedef void SpritesheetStreamDestructor(struct Game*, void*);
 #define SPRITESHEET_STREAM_DESCTRUCTOR(x) void x(struct Game* game, void* data)
 
+#define LIBSUPERDERPY_SPRITESHEET_HASHMAP_BUCKETS 16
+
+struct SpritesheetPrefetch;
+struct SpritesheetStreamPrefetch;
+struct SpritesheetHotFrame;
+struct SpritesheetTiming;
+
+/*! \brief Successor or predecessor of a spritesheet, resolved once when it's registered. */
+struct SpritesheetLink {
+	const char* name; /*!< Interned name, as given in the config (with "-" prefix when reversed). */
+	const char* id; /*!< Interned name of the linked spritesheet, to be passed to SelectSpritesheetByID. */
+	bool reversed; /*!< Whether the linked spritesheet is played backwards. */
+};
+
 /*! \brief Structure representing one spritesheet for character animation. */
 struct Spritesheet {
 	char* name; /*!< Name of the spritesheet (used in file paths). */
@@ -81,11 +98,12 @@ struct Spritesheet {
 	bool flipX;
 	bool flipY;
 	double scale;
-	struct SpritesheetFrame* frames;
+	struct SpritesheetFrame* frames; /*!< Frames of the spritesheet. Drawing and animation use a copy made when the spritesheet gets loaded, so later changes to loaded frames show up only after reloading it. */
 	bool shared; /*!< Marks the spritesheet bitmaps as shared, so they won't be freed together with the spritesheet. */
 	SpritesheetStream* stream;
 	SpritesheetStreamDestructor* stream_destructor;
 	void* stream_data;
+	int prefetch; /*!< Number of frames of a streamed spritesheet to be produced ahead of time on a worker thread. The stream callback must not use the GPU then. 0 calls the stream synchronously. */
 
 	struct {
 		double x1;
@@ -99,10 +117,29 @@ struct Spritesheet {
 
 	struct Spritesheet* next; /*!< Next spritesheet in the queue. */
 
+	struct {
+		const char* id; /*!< Interned name of the spritesheet. */
+		struct SpritesheetLink successor;
+		struct SpritesheetLink predecessor;
+		struct Spritesheet* bucket_next; /*!< Next spritesheet in the same hash map bucket. */
+		bool loaded;
+		size_t size; /*!< Estimated texture memory used by the spritesheet's bitmaps. */
+		double last_used;
+		int users; /*!< Number of characters currently displaying the spritesheet, which keeps it from being evicted. */
+		struct SpritesheetPrefetch* prefetch;
+		struct SpritesheetStreamPrefetch* stream_prefetch;
+		struct SpritesheetHotFrame* hot; /*!< Packed copy of the frame data used for drawing and animating, built when the spritesheet gets loaded. */
+		struct SpritesheetTiming* timing;
+	} _priv;
+
 	// TODO: missing docs
 };
 
 struct Character;
+struct KeyframeAnimation;
+struct SpatialIndex;
+struct SpatialIndexEntry;
+struct SpritesheetLibrary;
 typedef void CharacterCallback(struct Game*, struct Character*, struct Spritesheet* newAnim, struct Spritesheet* oldAnim, void*);
 #define CHARACTER_CALLBACK(x) void x(struct Game* game, struct Character* character, struct Spritesheet* new, struct Spritesheet* old, void* data)
 typedef void CharacterDestructor(struct Game*, struct Character*);
@@ -115,10 +152,11 @@ struct Character {
 	struct SpritesheetFrame* frame; /*!< Current frame. */
 	struct Spritesheet* spritesheet; /*!< Current spritesheet used by character. */
 	struct Spritesheet* spritesheets; /*!< List of all spritesheets registered to character. */
+	struct Spritesheet** spritesheets_map; /*!< Registered spritesheets hashed by their interned names. Shared together with the list. */
 	int pos; /*!< Current spritesheet position. */
 	double delta; /*!< A counter used internally to slow down spritesheet animation. */ // TODO: change to delta
-	char* successor; /*!< Name of the next spritesheet to be played when the current one finishes. */
-	char* predecessor; /*!< Name of the next spritesheet to be played when the current one finishes when in reverse mode. */
+	const char* successor; /*!< Name of the next spritesheet to be played when the current one finishes. Interned and not owned by the character: never free it, use EnqueueSpritesheet to change it. */
+	const char* predecessor; /*!< Name of the next spritesheet to be played when the current one finishes when in reverse mode. Interned and not owned by the character, same as successor. */
 	float x; /*!< Horizontal position of character. */
 	float y; /*!< Vertical position of character. */
 	ALLEGRO_COLOR tint; /*!< Color with which the character's pixels will be multiplied (tinted). White for no effect. */
@@ -140,8 +178,25 @@ struct Character {
 	void* callback_data;
 	CharacterDestructor* destructor;
 	bool shared; /*!< Marks the list of spritesheets as shared, so it won't be freed together with the character. */
+	struct SpritesheetLibrary* library; /*!< Spritesheet definitions shared with other instances created with CreateSharedCharacter. */
 	bool detailed_progress; /*!< Reports progress of loading individual frames. */
 
+	struct {
+		bool enabled; /*!< Loads spritesheets on first use instead of in LoadSpritesheets, prefetching their successors in background. Ignored for characters created with CreateSharedCharacter. */
+		size_t budget; /*!< Texture memory in bytes that lazily loaded spritesheets can occupy before the least recently used ones get evicted. When 0, the "spritesheetBudget" config option (in MiB) is used; no limit if it's not set. */
+	} lazy;
+
+	struct {
+		struct KeyframeAnimation* animation; /*!< Keyframe animation driving character's properties. NULL if none. */
+		double pos; /*!< Current position in the keyframe animation, in seconds. */
+		bool finished;
+	} keyframes;
+
+	struct {
+		struct SpatialIndex* index; /*!< Spatial index the character is registered in. NULL if none. */
+		struct SpatialIndexEntry* entry;
+	} spatial;
+
 	struct {
 		double x1;
 		double y1;
@@ -153,22 +208,34 @@ struct Character {
 
 // TODO: document functions
 
-void SelectSpritesheet(struct Game* game, struct Character* character, char* name);
+void SelectSpritesheet(struct Game* game, struct Character* character, const char* name);
+/*! \brief Selects the spritesheet by its name interned with InternString, without any string comparisons. */
+void SelectSpritesheetByID(struct Game* game, struct Character* character, const char* id, bool reversed);
 void SwitchSpritesheet(struct Game* game, struct Character* character, char* name);
-void EnqueueSpritesheet(struct Game* game, struct Character* character, char* name);
+void EnqueueSpritesheet(struct Game* game, struct Character* character, const char* name);
 void RegisterSpritesheet(struct Game* game, struct Character* character, char* name);
 void RegisterStreamedSpritesheet(struct Game* game, struct Character* character, char* name, SpritesheetStream* callback, SpritesheetStreamDestructor* destructor, void* data);
 void RegisterSpritesheetFromBitmap(struct Game* game, struct Character* character, char* name, ALLEGRO_BITMAP* bitmap);
-struct Spritesheet* GetSpritesheet(struct Game* game, struct Character* character, char* name);
+struct Spritesheet* GetSpritesheet(struct Game* game, struct Character* character, const char* name);
+/*! \brief Finds the spritesheet by its name interned with InternString. */
+struct Spritesheet* GetSpritesheetByID(struct Game* game, struct Character* character, const char* id);
 void SetSpritesheetPosition(struct Game* game, struct Character* character, int frame);
 
 ALLEGRO_TRANSFORM GetCharacterTransform(struct Game* game, struct Character* character);
 ALLEGRO_COLOR GetCharacterTint(struct Game* game, struct Character* character);
+/*! \brief Returns axis-aligned bounds of the character after applying its transform, optionally limited to the spritesheet's hitbox. */
+void GetCharacterBounds(struct Game* game, struct Character* character, bool hitbox, float* x1, float* y1, float* x2, float* y2);
 
 void DrawCharacter(struct Game* game, struct Character* character);
 void DrawDebugCharacter(struct Game* game, struct Character* character);
 
 struct Character* CreateCharacter(struct Game* game, char* name);
+/*! \brief Creates a character that shares its spritesheet definitions with all other characters created this way with the same name.
+ *
+ * Spritesheets get parsed and loaded only once; each instance carries just its own animation state.
+ * Loading and unloading is reference counted, so every instance still has to call LoadSpritesheets and UnloadSpritesheets.
+ */
+struct Character* CreateSharedCharacter(struct Game* game, char* name);
 void DestroyCharacter(struct Game* game, struct Character* character);
 
 void LoadSpritesheets(struct Game* game, struct Character* character, void (*progress)(struct Game*));
@@ -33,6 +33,7 @@ static struct Gamestate* AddNewGamestate(struct Game* game, const char* name) {
 		tmp->next = AllocateGamestate(game, name);
 		tmp = tmp->next;
 	}
+	AddGamestateToMap(game, tmp);
 	return tmp;
 }
 
@@ -67,6 +68,26 @@ SYMBOL_EXPORT void LoadGamestate(struct Game* game, const char* name) {
 	PrintConsole(game, "Gamestate \"%s\" marked to be LOADED.", name);
 }
 
+SYMBOL_EXPORT void PreloadGamestate(struct Game* game, const char* name) {
+	struct Gamestate* gs = GetGamestate(game, name);
+	if (gs) {
+		if ((gs->loaded && !gs->pending_unload) || gs->pending_load || gs->pending_preload) {
+			PrintConsole(game, "Gamestate \"%s\" already loaded.", name);
+			return;
+		}
+	} else {
+		gs = AddNewGamestate(game, name);
+	}
+#ifdef LIBSUPERDERPY_SINGLE_THREAD
+	// there's no way to load in background, so at least don't show the loading screen
+	gs->pending_load = true;
+	gs->show_loading = false;
+#else
+	gs->pending_preload = true;
+#endif
+	PrintConsole(game, "Gamestate \"%s\" marked to be PRELOADED.", name);
+}
+
 SYMBOL_EXPORT void UnloadGamestate(struct Game* game, const char* name) {
 	struct Gamestate* gs = GetGamestate(game, name);
 	if (gs) {
@@ -75,6 +96,17 @@ SYMBOL_EXPORT void UnloadGamestate(struct Game* game, const char* name) {
 			PrintConsole(game, "Canceling loading of gamestate \"%s\".", name);
 			return;
 		}
+		if (gs->pending_preload) {
+			if (game->_priv.preload.gamestate != gs) {
+				gs->pending_preload = false;
+				PrintConsole(game, "Canceling preloading of gamestate \"%s\".", name);
+				return;
+			}
+			// already being loaded, it will be unloaded once finished
+			gs->pending_unload = true;
+			PrintConsole(game, "Gamestate \"%s\" marked to be UNLOADED.", name);
+			return;
+		}
 		if (!gs->loaded) {
 			PrintConsole(game, "Gamestate \"%s\" already unloaded.", name);
 			return;
@@ -139,6 +171,7 @@ SYMBOL_EXPORT void PauseGamestate(struct Game* game, const char* name) {
 			return;
 		}
 		gs->paused = true;
+		InvalidateGamestateDispatch(game);
 		game->_priv.current_gamestate = gs;
 		if (gs->api->pause) {
 			(*gs->api->pause)(game, gs->data);
@@ -161,6 +194,7 @@ SYMBOL_EXPORT void ResumeGamestate(struct Game* game, const char* name) {
 			return;
 		}
 		gs->paused = false;
+		InvalidateGamestateDispatch(game);
 		game->_priv.current_gamestate = gs;
 		if (gs->api->resume) {
 			(*gs->api->resume)(game, gs->data);
@@ -213,41 +247,34 @@ SYMBOL_EXPORT void ChangeGamestate(struct Game* game, const char* current, const
 }
 
 SYMBOL_EXPORT void SwitchCurrentGamestate(struct Game* game, const char* n) {
-	SwitchGamestate(game, game->_priv.current_gamestate->name, n);
+	SwitchGamestate(game, GetContextGamestate(game)->name, n);
 }
 
 SYMBOL_EXPORT void ChangeCurrentGamestate(struct Game* game, const char* n) {
-	ChangeGamestate(game, game->_priv.current_gamestate->name, n);
+	ChangeGamestate(game, GetContextGamestate(game)->name, n);
 }
 
 SYMBOL_EXPORT void StopCurrentGamestate(struct Game* game) {
-	StopGamestate(game, game->_priv.current_gamestate->name);
+	StopGamestate(game, GetContextGamestate(game)->name);
 }
 
 SYMBOL_EXPORT void PauseCurrentGamestate(struct Game* game) {
-	PauseGamestate(game, game->_priv.current_gamestate->name);
+	PauseGamestate(game, GetContextGamestate(game)->name);
 }
 
 SYMBOL_EXPORT void UnloadCurrentGamestate(struct Game* game) {
-	UnloadGamestate(game, game->_priv.current_gamestate->name);
+	UnloadGamestate(game, GetContextGamestate(game)->name);
 }
 
 SYMBOL_EXPORT struct Gamestate* GetCurrentGamestate(struct Game* game) {
-	return game->_priv.current_gamestate;
+	return GetContextGamestate(game);
 }
 
 SYMBOL_EXPORT struct Gamestate* GetGamestate(struct Game* game, const char* name) {
-	struct Gamestate* tmp = game->_priv.gamestates;
 	if (!name) {
 		return game->_priv.loading.gamestate;
 	}
-	while (tmp) {
-		if (!strcmp(name, tmp->name)) {
-			return tmp;
-		}
-		tmp = tmp->next;
-	}
-	return NULL;
+	return FindGamestate(game, name);
 }
 
 SYMBOL_EXPORT ALLEGRO_BITMAP* GetGamestateFramebuffer(struct Game* game, struct Gamestate* gamestate) {
@@ -265,6 +292,37 @@ SYMBOL_EXPORT struct Gamestate* GetNextGamestate(struct Game* game, struct Games
 	return gamestate->next;
 }
 
+SYMBOL_EXPORT void SetCurrentGamestateStatic(struct Game* game, bool is_static) {
+	GetContextGamestate(game)->cache.enabled = is_static;
+}
+
+SYMBOL_EXPORT void SetCurrentGamestateEventFilter(struct Game* game, int events, bool coalesce) {
+	struct Gamestate* gamestate = GetContextGamestate(game);
+	gamestate->events.mask = events;
+	gamestate->events.coalesce = coalesce;
+	InvalidateGamestateDispatch(game);
+}
+
+SYMBOL_EXPORT void InvalidateCurrentGamestate(struct Game* game) {
+	GetContextGamestate(game)->cache.valid = false;
+}
+
+SYMBOL_EXPORT void InvalidateCurrentGamestateRect(struct Game* game, float x, float y, float w, float h) {
+	struct Gamestate* gamestate = GetContextGamestate(game);
+	if (gamestate->cache.dirty) {
+		gamestate->cache.x1 = fminf(gamestate->cache.x1, x);
+		gamestate->cache.y1 = fminf(gamestate->cache.y1, y);
+		gamestate->cache.x2 = fmaxf(gamestate->cache.x2, x + w);
+		gamestate->cache.y2 = fmaxf(gamestate->cache.y2, y + h);
+	} else {
+		gamestate->cache.x1 = x;
+		gamestate->cache.y1 = y;
+		gamestate->cache.x2 = x + w;
+		gamestate->cache.y2 = y + h;
+		gamestate->cache.dirty = true;
+	}
+}
+
 SYMBOL_EXPORT bool IsGamestateVisible(struct Game* game, struct Gamestate* gamestate) {
 	return (gamestate->loaded) && (gamestate->started);
 }
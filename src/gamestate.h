@@ -43,11 +43,36 @@ struct GamestateAPI {
 	void (*reload)(struct Game* game, void* data);
 
 	int* progress_count;
+	const char** dependencies; /*!< NULL-terminated list of gamestates that have to be loaded before this one. */
 };
 
 struct Gamestate;
 
+/*! \brief Categories of events that can be delivered to Gamestate_ProcessEvent. */
+typedef enum GAMESTATE_EVENTS {
+	GAMESTATE_EVENTS_KEYBOARD = 1 << 0,
+	GAMESTATE_EVENTS_MOUSE = 1 << 1, /*!< Mouse buttons and the cursor entering or leaving the display. */
+	GAMESTATE_EVENTS_MOUSE_AXES = 1 << 2, /*!< Mouse movement and scrolling. */
+	GAMESTATE_EVENTS_TOUCH = 1 << 3, /*!< Touches beginning, ending and being cancelled. */
+	GAMESTATE_EVENTS_TOUCH_MOVE = 1 << 4,
+	GAMESTATE_EVENTS_JOYSTICK = 1 << 5, /*!< Joystick buttons and configuration changes. */
+	GAMESTATE_EVENTS_JOYSTICK_AXES = 1 << 6,
+	GAMESTATE_EVENTS_DISPLAY = 1 << 7,
+	GAMESTATE_EVENTS_USER = 1 << 8, /*!< User events, including the ones emitted through game->event_source. */
+	GAMESTATE_EVENTS_OTHER = 1 << 9, /*!< Timers, audio and everything else. */
+	GAMESTATE_EVENTS_ALL = (1 << 10) - 1
+} GAMESTATE_EVENTS;
+
 void LoadGamestate(struct Game* game, const char* name);
+/*! \brief Loads the gamestate in background while other gamestates keep running, so starting it later doesn't show the loading screen.
+ *
+ * Textures are uploaded a few at a time, within the per-frame budget set by "preloadBudget" config option (in milliseconds).
+ * This applies only to bitmaps loaded with AddBitmap. Bitmaps and fonts loaded directly with Allegro in Gamestate_Load
+ * are all converted at once in a single frame, which may take longer than the budget.
+ * Dependencies that aren't loaded yet are preloaded first.
+ * Gamestate_Load is executed on another thread in parallel with the main loop, so it shouldn't touch state shared with running gamestates.
+ */
+void PreloadGamestate(struct Game* game, const char* name);
 void UnloadGamestate(struct Game* game, const char* name);
 void RegisterGamestate(struct Game* game, const char* name, struct GamestateAPI* api);
 void StartGamestate(struct Game* game, const char* name);
@@ -64,6 +89,7 @@ void ChangeCurrentGamestate(struct Game* game, const char* n);
 void StopCurrentGamestate(struct Game* game);
 void PauseCurrentGamestate(struct Game* game);
 void UnloadCurrentGamestate(struct Game* game);
+/*! \brief Returns the gamestate whose callback is being executed. Inside Gamestate_Load it's the gamestate being loaded by the calling thread, even when several of them are loaded concurrently. */
 struct Gamestate* GetCurrentGamestate(struct Game* game);
 struct Gamestate* GetGamestate(struct Game* game, const char* name);
 ALLEGRO_BITMAP* GetGamestateFramebuffer(struct Game* game, struct Gamestate* gamestate);
@@ -71,6 +97,25 @@ char* GetGamestateName(struct Game* game, struct Gamestate* gamestate);
 struct Gamestate* GetNextGamestate(struct Game* game, struct Gamestate* gamestate);
 bool IsGamestateVisible(struct Game* game, struct Gamestate* gamestate);
 
+/*! \brief Keeps the current gamestate's framebuffer between frames, so its draw is called only after invalidation.
+ *
+ * Meant for static overlays drawn with a compositor enabled; without one, the gamestate is drawn every frame anyway.
+ * The framebuffer is invalidated automatically when it gets recreated, e.g. after resizing the window.
+ */
+void SetCurrentGamestateStatic(struct Game* game, bool is_static);
+/*! \brief Limits events delivered to the current gamestate to given GAMESTATE_EVENTS categories.
+ *
+ * With coalescing enabled, mouse movement, touch movement and joystick axis events are delivered at the end of each
+ * event processing pass (which happens both before and after logic in every frame), with the latest position and
+ * relative movement accumulated since the previous pass. Pending movement is delivered right before button events
+ * of the same device, and dropped when its touch ends.
+ */
+void SetCurrentGamestateEventFilter(struct Game* game, int events, bool coalesce);
+/*! \brief Redraws the whole framebuffer of the current static gamestate on the next frame. */
+void InvalidateCurrentGamestate(struct Game* game);
+/*! \brief Redraws given rectangle of the current static gamestate on the next frame. Draw is called with the clipping rectangle set to the area to be redrawn. */
+void InvalidateCurrentGamestateRect(struct Game* game, float x, float y, float w, float h);
+
 // Gamestate API
 
 #if defined(LIBSUPERDERPY_STATIC_GAMESTATES) && defined(LIBSUPERDERPY_GAMESTATE)
@@ -79,6 +124,7 @@ bool IsGamestateVisible(struct Game* game, struct Gamestate* gamestate);
 #define GAMESTATE_CONCAT(x, y) GAMESTATE_CONCAT_STR(x, y)
 
 #define Gamestate_ProgressCount GAMESTATE_CONCAT(LIBSUPERDERPY_GAMESTATE, _Gamestate_ProgressCount)
+#define Gamestate_Dependencies GAMESTATE_CONCAT(LIBSUPERDERPY_GAMESTATE, _Gamestate_Dependencies)
 #define Gamestate_Draw GAMESTATE_CONCAT(LIBSUPERDERPY_GAMESTATE, _Gamestate_Draw)
 #define Gamestate_Logic GAMESTATE_CONCAT(LIBSUPERDERPY_GAMESTATE, _Gamestate_Logic)
 #define Gamestate_Tick GAMESTATE_CONCAT(LIBSUPERDERPY_GAMESTATE, _Gamestate_Tick)
@@ -96,6 +142,7 @@ bool IsGamestateVisible(struct Game* game, struct Gamestate* gamestate);
 #endif
 
 extern int Gamestate_ProgressCount;
+extern const char* Gamestate_Dependencies[];
 __attribute__((used)) void Gamestate_Draw(struct Game* game, struct GamestateResources* data);
 __attribute__((used)) void Gamestate_Logic(struct Game* game, struct GamestateResources* data, double delta);
 __attribute__((used)) void Gamestate_Tick(struct Game* game, struct GamestateResources* data);
@@ -135,6 +182,7 @@ void GAMESTATE_INIT_NAME(LIBSUPERDERPY_GAMESTATE)(void) {
 		.process_event = (void*)Gamestate_ProcessEvent,
 		.reload = (void*)Gamestate_Reload,
 		.progress_count = &Gamestate_ProgressCount,
+		.dependencies = Gamestate_Dependencies,
 	};
 	__libsuperderpy_register_gamestate(GAMESTATE_STRINGIFY(LIBSUPERDERPY_GAMESTATE), &api, NULL);
 }
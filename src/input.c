@@ -0,0 +1,255 @@
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This file is part of libsuperderpy.
+ *
+ * libsuperderpy is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libsuperderpy is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libsuperderpy. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Also, ponies.
+ */
+
+
+#include "internal.h"
+
+static bool IsValidKey(int keycode) {
+	return keycode > 0 && keycode < ALLEGRO_KEY_MAX;
+}
+
+static unsigned int GetButtonMask(int button) {
+	if (button < 1 || button > 32) {
+		return 0;
+	}
+	return 1U << (button - 1);
+}
+
+static struct InputTouch* FindInputTouch(struct InputState* state, int id) {
+	for (int i = 0; i < state->touch_count; i++) {
+		if (state->touches[i].id == id) {
+			return &state->touches[i];
+		}
+	}
+	return NULL;
+}
+
+static struct InputJoystick* FindInputJoystick(struct InputState* state, ALLEGRO_JOYSTICK* joystick, bool add) {
+	for (int i = 0; i < state->joystick_count; i++) {
+		if (state->joysticks[i].joystick == joystick) {
+			return &state->joysticks[i];
+		}
+	}
+	if (!add || state->joystick_count == LIBSUPERDERPY_INPUT_JOYSTICKS) {
+		return NULL;
+	}
+	struct InputJoystick* slot = &state->joysticks[state->joystick_count++];
+	memset(slot, 0, sizeof(struct InputJoystick));
+	slot->joystick = joystick;
+	return slot;
+}
+
+SYMBOL_INTERNAL void UpdateInputState(struct Game* game, ALLEGRO_EVENT* ev) {
+	struct InputState* state = game->_priv.input;
+	if (!state) {
+		return;
+	}
+	switch (ev->type) {
+		case ALLEGRO_EVENT_KEY_DOWN:
+			if (IsValidKey(ev->keyboard.keycode)) {
+				state->down[ev->keyboard.keycode] = true;
+				state->pressed[ev->keyboard.keycode] = true;
+			}
+			break;
+		case ALLEGRO_EVENT_KEY_UP:
+			if (IsValidKey(ev->keyboard.keycode)) {
+				state->down[ev->keyboard.keycode] = false;
+				state->released[ev->keyboard.keycode] = true;
+			}
+			break;
+		case ALLEGRO_EVENT_MOUSE_AXES:
+		case ALLEGRO_EVENT_MOUSE_WARPED:
+			// warping isn't user's movement, so it only updates the position
+			if (ev->type == ALLEGRO_EVENT_MOUSE_AXES) {
+				state->mouse.dx += ev->mouse.dx;
+				state->mouse.dy += ev->mouse.dy;
+				state->mouse.dz += ev->mouse.dz;
+				state->mouse.dw += ev->mouse.dw;
+			}
+			state->mouse.x = ev->mouse.x;
+			state->mouse.y = ev->mouse.y;
+			state->mouse.z = ev->mouse.z;
+			state->mouse.w = ev->mouse.w;
+			break;
+		case ALLEGRO_EVENT_MOUSE_BUTTON_DOWN:
+			state->mouse.buttons |= GetButtonMask(ev->mouse.button);
+			state->mouse.pressed |= GetButtonMask(ev->mouse.button);
+			break;
+		case ALLEGRO_EVENT_MOUSE_BUTTON_UP:
+			state->mouse.buttons &= ~GetButtonMask(ev->mouse.button);
+			state->mouse.released |= GetButtonMask(ev->mouse.button);
+			break;
+		case ALLEGRO_EVENT_MOUSE_ENTER_DISPLAY:
+			state->mouse.inside = true;
+			break;
+		case ALLEGRO_EVENT_MOUSE_LEAVE_DISPLAY:
+			state->mouse.inside = false;
+			break;
+		case ALLEGRO_EVENT_TOUCH_BEGIN: {
+			struct InputTouch* touch = FindInputTouch(state, ev->touch.id);
+			if (!touch) {
+				if (state->touch_count == LIBSUPERDERPY_INPUT_TOUCHES) {
+					break;
+				}
+				touch = &state->touches[state->touch_count++];
+			}
+			touch->id = ev->touch.id;
+			touch->x = ev->touch.x;
+			touch->y = ev->touch.y;
+			touch->dx = 0;
+			touch->dy = 0;
+			touch->primary = ev->touch.primary;
+			touch->began = true;
+			touch->ended = false;
+			break;
+		}
+		case ALLEGRO_EVENT_TOUCH_MOVE:
+		case ALLEGRO_EVENT_TOUCH_END:
+		case ALLEGRO_EVENT_TOUCH_CANCEL: {
+			struct InputTouch* touch = FindInputTouch(state, ev->touch.id);
+			if (!touch) {
+				break;
+			}
+			touch->dx += ev->touch.x - touch->x;
+			touch->dy += ev->touch.y - touch->y;
+			touch->x = ev->touch.x;
+			touch->y = ev->touch.y;
+			if (ev->type != ALLEGRO_EVENT_TOUCH_MOVE) {
+				touch->ended = true;
+			}
+			break;
+		}
+		case ALLEGRO_EVENT_JOYSTICK_AXIS: {
+			if (ev->joystick.stick >= LIBSUPERDERPY_INPUT_JOYSTICK_STICKS || ev->joystick.axis >= LIBSUPERDERPY_INPUT_JOYSTICK_AXES) {
+				break;
+			}
+			struct InputJoystick* joystick = FindInputJoystick(state, ev->joystick.id, true);
+			if (joystick) {
+				joystick->axes[ev->joystick.stick][ev->joystick.axis] = ev->joystick.pos;
+			}
+			break;
+		}
+		case ALLEGRO_EVENT_JOYSTICK_BUTTON_DOWN:
+		case ALLEGRO_EVENT_JOYSTICK_BUTTON_UP: {
+			struct InputJoystick* joystick = FindInputJoystick(state, ev->joystick.id, true);
+			if (!joystick) {
+				break;
+			}
+			unsigned int mask = GetButtonMask(ev->joystick.button + 1);
+			if (ev->type == ALLEGRO_EVENT_JOYSTICK_BUTTON_DOWN) {
+				joystick->buttons |= mask;
+				joystick->pressed |= mask;
+			} else {
+				joystick->buttons &= ~mask;
+				joystick->released |= mask;
+			}
+			break;
+		}
+		case ALLEGRO_EVENT_JOYSTICK_CONFIGURATION:
+			// handles of disconnected joysticks are no longer valid
+			state->joystick_count = 0;
+			break;
+		case ALLEGRO_EVENT_DISPLAY_SWITCH_OUT:
+			// key releases won't be delivered while unfocused
+			memset(state->down, 0, sizeof(state->down));
+			state->mouse.buttons = 0;
+			break;
+		default:
+			break;
+	}
+}
+
+SYMBOL_INTERNAL void AdvanceInputState(struct Game* game) {
+	struct InputState* state = game->_priv.input;
+	if (!state) {
+		return;
+	}
+	memset(state->pressed, 0, sizeof(state->pressed));
+	memset(state->released, 0, sizeof(state->released));
+	state->mouse.dx = 0;
+	state->mouse.dy = 0;
+	state->mouse.dz = 0;
+	state->mouse.dw = 0;
+	state->mouse.pressed = 0;
+	state->mouse.released = 0;
+
+	int count = 0;
+	for (int i = 0; i < state->touch_count; i++) {
+		if (state->touches[i].ended) {
+			continue;
+		}
+		state->touches[count] = state->touches[i];
+		state->touches[count].dx = 0;
+		state->touches[count].dy = 0;
+		state->touches[count].began = false;
+		count++;
+	}
+	state->touch_count = count;
+
+	for (int i = 0; i < state->joystick_count; i++) {
+		state->joysticks[i].pressed = 0;
+		state->joysticks[i].released = 0;
+	}
+}
+
+SYMBOL_EXPORT const struct InputState* GetInputState(struct Game* game) {
+	return game->_priv.input;
+}
+
+SYMBOL_EXPORT bool IsKeyDown(struct Game* game, int keycode) {
+	return game->_priv.input && IsValidKey(keycode) && game->_priv.input->down[keycode];
+}
+
+SYMBOL_EXPORT bool WasKeyPressed(struct Game* game, int keycode) {
+	return game->_priv.input && IsValidKey(keycode) && game->_priv.input->pressed[keycode];
+}
+
+SYMBOL_EXPORT bool WasKeyReleased(struct Game* game, int keycode) {
+	return game->_priv.input && IsValidKey(keycode) && game->_priv.input->released[keycode];
+}
+
+SYMBOL_EXPORT bool IsMouseButtonDown(struct Game* game, int button) {
+	return game->_priv.input && (game->_priv.input->mouse.buttons & GetButtonMask(button));
+}
+
+SYMBOL_EXPORT bool WasMouseButtonPressed(struct Game* game, int button) {
+	return game->_priv.input && (game->_priv.input->mouse.pressed & GetButtonMask(button));
+}
+
+SYMBOL_EXPORT bool WasMouseButtonReleased(struct Game* game, int button) {
+	return game->_priv.input && (game->_priv.input->mouse.released & GetButtonMask(button));
+}
+
+SYMBOL_EXPORT float GetJoystickAxis(struct Game* game, ALLEGRO_JOYSTICK* joystick, int stick, int axis) {
+	if (!game->_priv.input || stick < 0 || stick >= LIBSUPERDERPY_INPUT_JOYSTICK_STICKS || axis < 0 || axis >= LIBSUPERDERPY_INPUT_JOYSTICK_AXES) {
+		return 0.0;
+	}
+	struct InputJoystick* slot = FindInputJoystick(game->_priv.input, joystick, false);
+	return slot ? slot->axes[stick][axis] : 0.0;
+}
+
+SYMBOL_EXPORT bool IsJoystickButtonDown(struct Game* game, ALLEGRO_JOYSTICK* joystick, int button) {
+	if (!game->_priv.input) {
+		return false;
+	}
+	struct InputJoystick* slot = FindInputJoystick(game->_priv.input, joystick, false);
+	return slot && (slot->buttons & GetButtonMask(button + 1));
+}
@@ -0,0 +1,91 @@
+/*! \file input.h
+ *  \brief Per-frame snapshot of input devices' state.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This file is part of libsuperderpy.
+ *
+ * libsuperderpy is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libsuperderpy is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libsuperderpy. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Also, ponies.
+ */
+
+#ifndef LIBSUPERDERPY_INPUT_H
+#define LIBSUPERDERPY_INPUT_H
+
+#include "libsuperderpy.h"
+
+#define LIBSUPERDERPY_INPUT_TOUCHES 16
+#define LIBSUPERDERPY_INPUT_JOYSTICKS 8
+#define LIBSUPERDERPY_INPUT_JOYSTICK_STICKS 8
+#define LIBSUPERDERPY_INPUT_JOYSTICK_AXES 3
+
+/*! \brief Touch point active during the current frame. */
+struct InputTouch {
+	int id;
+	float x, y; /*!< Latest position, in display coordinates. */
+	float dx, dy; /*!< Movement accumulated during the frame. */
+	bool primary;
+	bool began; /*!< The touch has begun during the frame. */
+	bool ended; /*!< The touch has ended or has been cancelled during the frame. It's removed on the next frame. */
+};
+
+struct InputJoystick {
+	ALLEGRO_JOYSTICK* joystick;
+	float axes[LIBSUPERDERPY_INPUT_JOYSTICK_STICKS][LIBSUPERDERPY_INPUT_JOYSTICK_AXES];
+	unsigned int buttons; /*!< Bitmask of held buttons. */
+	unsigned int pressed, released; /*!< Bitmasks of buttons pressed and released during the frame. */
+};
+
+/*! \brief State of input devices, accumulated from events processed since the last Gamestate_Logic call.
+ *
+ * A key can be both pressed and released during a single frame, so a quick tap can't go unnoticed.
+ */
+struct InputState {
+	bool down[ALLEGRO_KEY_MAX];
+	bool pressed[ALLEGRO_KEY_MAX];
+	bool released[ALLEGRO_KEY_MAX];
+
+	struct {
+		float x, y; /*!< Latest position, in display coordinates. */
+		float dx, dy; /*!< Movement accumulated during the frame. */
+		int z, w; /*!< Scroll wheel positions. */
+		int dz, dw;
+		unsigned int buttons; /*!< Bitmask of held buttons; button 1 is the lowest bit. */
+		unsigned int pressed, released;
+		bool inside; /*!< Whether the cursor is over the display. */
+	} mouse;
+
+	struct InputTouch touches[LIBSUPERDERPY_INPUT_TOUCHES];
+	int touch_count;
+
+	struct InputJoystick joysticks[LIBSUPERDERPY_INPUT_JOYSTICKS]; /*!< Joysticks in order of their first use. */
+	int joystick_count;
+};
+
+/*! \brief Returns the current input snapshot, or NULL when Params.input_snapshot wasn't enabled. */
+const struct InputState* GetInputState(struct Game* game);
+bool IsKeyDown(struct Game* game, int keycode);
+bool WasKeyPressed(struct Game* game, int keycode);
+bool WasKeyReleased(struct Game* game, int keycode);
+/*! \brief Checks whether given mouse button (starting from 1, as in Allegro events) is held. */
+bool IsMouseButtonDown(struct Game* game, int button);
+bool WasMouseButtonPressed(struct Game* game, int button);
+bool WasMouseButtonReleased(struct Game* game, int button);
+/*! \brief Returns the latest position of a joystick's axis, or 0 if it hasn't moved yet. */
+float GetJoystickAxis(struct Game* game, ALLEGRO_JOYSTICK* joystick, int stick, int axis);
+bool IsJoystickButtonDown(struct Game* game, ALLEGRO_JOYSTICK* joystick, int button);
+
+#endif /* LIBSUPERDERPY_INPUT_H */
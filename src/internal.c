@@ -47,15 +47,60 @@ SYMBOL_INTERNAL void SimpleCompositor(struct Game* game) {
 	}
 }
 
+SYMBOL_INTERNAL void InvalidateGamestateDispatch(struct Game* game) {
+	game->_priv.dispatch.dirty = true;
+}
+
+// Rebuilds the arrays of gamestates to dispatch callbacks to, so per-frame loops don't have to walk through all known gamestates.
+static void UpdateGamestateDispatch(struct Game* game) {
+	if (!game->_priv.dispatch.dirty) {
+		return;
+	}
+	int count = 0;
+	for (struct Gamestate* tmp = game->_priv.gamestates; tmp; tmp = tmp->next) {
+		count++;
+	}
+	if (count > game->_priv.dispatch.size) {
+		game->_priv.dispatch.size = count;
+		game->_priv.dispatch.active = realloc(game->_priv.dispatch.active, sizeof(struct Gamestate*) * count);
+		game->_priv.dispatch.drawable = realloc(game->_priv.dispatch.drawable, sizeof(struct Gamestate*) * count);
+	}
+	game->_priv.dispatch.active_count = 0;
+	game->_priv.dispatch.drawable_count = 0;
+	game->_priv.dispatch.events = 0;
+	game->_priv.dispatch.coalesce = false;
+	for (struct Gamestate* tmp = game->_priv.gamestates; tmp; tmp = tmp->next) {
+		if (tmp->loaded && tmp->started) {
+			game->_priv.dispatch.drawable[game->_priv.dispatch.drawable_count++] = tmp;
+			if (!tmp->paused) {
+				game->_priv.dispatch.active[game->_priv.dispatch.active_count++] = tmp;
+				game->_priv.dispatch.events |= tmp->events.mask;
+				game->_priv.dispatch.coalesce |= tmp->events.coalesce;
+			}
+		}
+	}
+	game->_priv.dispatch.dirty = false;
+}
+
+SYMBOL_INTERNAL void GetGamestateDirtyRect(struct Gamestate* gamestate, int* x, int* y, int* w, int* h) {
+	// round outwards, so partially covered pixels on the edges get redrawn too
+	*x = floorf(gamestate->cache.x1);
+	*y = floorf(gamestate->cache.y1);
+	*w = (int)ceilf(gamestate->cache.x2) - *x;
+	*h = (int)ceilf(gamestate->cache.y2) - *y;
+}
+
 SYMBOL_INTERNAL void DrawGamestates(struct Game* game) {
-	struct Gamestate* tmp = game->_priv.gamestates;
+	UpdateGamestateDispatch(game);
+	struct Gamestate* tmp = NULL;
 
-	while (tmp) {
+	// flags are checked again, as gamestates can be stopped or paused by callbacks of other ones
+	for (int i = 0; i < game->_priv.dispatch.drawable_count; i++) {
+		tmp = game->_priv.dispatch.drawable[i];
 		if (tmp->loaded && tmp->started && tmp->api->predraw) {
 			game->_priv.current_gamestate = tmp;
 			tmp->api->predraw(game, tmp->data);
 		}
-		tmp = tmp->next;
 	}
 	if (game->loading.shown && game->_priv.loading.gamestate && game->_priv.loading.gamestate->api->predraw) {
 		game->_priv.current_gamestate = game->_priv.loading.gamestate;
@@ -74,19 +119,34 @@ SYMBOL_INTERNAL void DrawGamestates(struct Game* game) {
 		al_set_clipping_rectangle(game->clip_rect.x, game->clip_rect.y, game->clip_rect.w, game->clip_rect.h);
 	}
 
-	tmp = game->_priv.gamestates;
-	while (tmp) {
+	for (int i = 0; i < game->_priv.dispatch.drawable_count; i++) {
+		tmp = game->_priv.dispatch.drawable[i];
 		if ((tmp->loaded) && (tmp->started)) {
-			game->_priv.current_gamestate = tmp;
-			SetFramebufferAsTarget(game);
-			if (!game->_priv.params.disable_bg_clear && game->_priv.params.handlers.compositor) { // don't clear when uncomposited
-				al_reset_clipping_rectangle();
-				al_clear_to_color(game->_priv.bg); // even if everything is going to be redrawn, it optimizes tiled rendering
+			// the backbuffer is undefined after flipping, so only composited framebuffers can be kept
+			bool cached = game->_priv.params.handlers.compositor && tmp->cache.enabled && tmp->cache.valid;
+			if (!cached || tmp->cache.dirty) {
+				game->_priv.current_gamestate = tmp;
+				SetFramebufferAsTarget(game);
+				if (cached) {
+					int x = 0, y = 0, w = 0, h = 0;
+					GetGamestateDirtyRect(tmp, &x, &y, &w, &h);
+					SetClippingRectangle(x, y, w, h);
+					if (!game->_priv.params.disable_bg_clear) {
+						al_clear_to_color(game->_priv.bg);
+					}
+				} else if (!game->_priv.params.disable_bg_clear && game->_priv.params.handlers.compositor) { // don't clear when uncomposited
+					al_reset_clipping_rectangle();
+					al_clear_to_color(game->_priv.bg); // even if everything is going to be redrawn, it optimizes tiled rendering
+				}
+				tmp->api->draw(game, tmp->data);
+				if (cached) {
+					al_reset_clipping_rectangle();
+				}
+				tmp->cache.valid = true;
+				tmp->cache.dirty = false;
+				// TODO: save and restore more state for careless gamestating
 			}
-			tmp->api->draw(game, tmp->data);
-			// TODO: save and restore more state for careless gamestating
 		}
-		tmp = tmp->next;
 	}
 
 	if (game->loading.shown) {
@@ -120,7 +180,7 @@ SYMBOL_INTERNAL void DrawGamestates(struct Game* game) {
 }
 
 SYMBOL_INTERNAL void LogicGamestates(struct Game* game, double delta) {
-	struct Gamestate* tmp = game->_priv.gamestates;
+	UpdateGamestateDispatch(game);
 	if (delta > 1) {
 		PrintConsole(game, "delta > 1 second!");
 		delta = 1;
@@ -130,17 +190,17 @@ SYMBOL_INTERNAL void LogicGamestates(struct Game* game, double delta) {
 	if (game->_priv.params.handlers.prelogic) {
 		game->_priv.params.handlers.prelogic(game, delta);
 	}
-	while (tmp) {
+	for (int i = 0; i < game->_priv.dispatch.active_count; i++) {
+		struct Gamestate* tmp = game->_priv.dispatch.active[i];
 		if ((tmp->loaded) && (tmp->started) && (!tmp->paused) && (!tmp->pending_stop)) {
 			game->_priv.current_gamestate = tmp;
 			if (tmp->api->tick) {
-				for (int i = 0; i < ticks; i++) {
+				for (int j = 0; j < ticks; j++) {
 					tmp->api->tick(game, tmp->data);
 				}
 			}
 			tmp->api->logic(game, tmp->data, delta);
 		}
-		tmp = tmp->next;
 	}
 	game->_priv.current_gamestate = NULL;
 	if (game->_priv.params.handlers.postlogic) {
@@ -167,18 +227,195 @@ SYMBOL_INTERNAL void ReloadGamestates(struct Game* game) {
 	game->_priv.current_gamestate = NULL;
 }
 
+static int GetEventCategory(ALLEGRO_EVENT_TYPE type) {
+	if (ALLEGRO_EVENT_TYPE_IS_USER(type)) {
+		return GAMESTATE_EVENTS_USER;
+	}
+	switch (type) {
+		case ALLEGRO_EVENT_KEY_DOWN:
+		case ALLEGRO_EVENT_KEY_CHAR:
+		case ALLEGRO_EVENT_KEY_UP:
+			return GAMESTATE_EVENTS_KEYBOARD;
+		case ALLEGRO_EVENT_MOUSE_BUTTON_DOWN:
+		case ALLEGRO_EVENT_MOUSE_BUTTON_UP:
+		case ALLEGRO_EVENT_MOUSE_ENTER_DISPLAY:
+		case ALLEGRO_EVENT_MOUSE_LEAVE_DISPLAY:
+			return GAMESTATE_EVENTS_MOUSE;
+		case ALLEGRO_EVENT_MOUSE_AXES:
+		case ALLEGRO_EVENT_MOUSE_WARPED:
+			return GAMESTATE_EVENTS_MOUSE_AXES;
+		case ALLEGRO_EVENT_TOUCH_BEGIN:
+		case ALLEGRO_EVENT_TOUCH_END:
+		case ALLEGRO_EVENT_TOUCH_CANCEL:
+			return GAMESTATE_EVENTS_TOUCH;
+		case ALLEGRO_EVENT_TOUCH_MOVE:
+			return GAMESTATE_EVENTS_TOUCH_MOVE;
+		case ALLEGRO_EVENT_JOYSTICK_BUTTON_DOWN:
+		case ALLEGRO_EVENT_JOYSTICK_BUTTON_UP:
+		case ALLEGRO_EVENT_JOYSTICK_CONFIGURATION:
+			return GAMESTATE_EVENTS_JOYSTICK;
+		case ALLEGRO_EVENT_JOYSTICK_AXIS:
+			return GAMESTATE_EVENTS_JOYSTICK_AXES;
+		case ALLEGRO_EVENT_DISPLAY_EXPOSE:
+		case ALLEGRO_EVENT_DISPLAY_RESIZE:
+		case ALLEGRO_EVENT_DISPLAY_CLOSE:
+		case ALLEGRO_EVENT_DISPLAY_LOST:
+		case ALLEGRO_EVENT_DISPLAY_FOUND:
+		case ALLEGRO_EVENT_DISPLAY_SWITCH_IN:
+		case ALLEGRO_EVENT_DISPLAY_SWITCH_OUT:
+		case ALLEGRO_EVENT_DISPLAY_ORIENTATION:
+		case ALLEGRO_EVENT_DISPLAY_HALT_DRAWING:
+		case ALLEGRO_EVENT_DISPLAY_RESUME_DRAWING:
+			return GAMESTATE_EVENTS_DISPLAY;
+		default:
+			return GAMESTATE_EVENTS_OTHER;
+	}
+}
+
+static bool IsCoalescableEvent(ALLEGRO_EVENT* ev) {
+	return ev->type == ALLEGRO_EVENT_MOUSE_AXES || ev->type == ALLEGRO_EVENT_TOUCH_MOVE || ev->type == ALLEGRO_EVENT_JOYSTICK_AXIS;
+}
+
+static bool IsSameEventSource(ALLEGRO_EVENT* a, ALLEGRO_EVENT* b) {
+	if (a->type != b->type) {
+		return false;
+	}
+	switch (a->type) {
+		case ALLEGRO_EVENT_TOUCH_MOVE:
+			return a->touch.id == b->touch.id;
+		case ALLEGRO_EVENT_JOYSTICK_AXIS:
+			return a->joystick.id == b->joystick.id && a->joystick.stick == b->joystick.stick && a->joystick.axis == b->joystick.axis;
+		default:
+			return true;
+	}
+}
+
+// Replaces the stored event from the same source with the new one, keeping relative movement accumulated.
+static void CoalesceEvent(struct Game* game, ALLEGRO_EVENT* ev) {
+	for (int i = 0; i < game->_priv.coalesced.count; i++) {
+		ALLEGRO_EVENT* stored = &game->_priv.coalesced.events[i];
+		if (!IsSameEventSource(stored, ev)) {
+			continue;
+		}
+		ALLEGRO_EVENT old = *stored;
+		*stored = *ev;
+		if (ev->type == ALLEGRO_EVENT_MOUSE_AXES) {
+			stored->mouse.dx += old.mouse.dx;
+			stored->mouse.dy += old.mouse.dy;
+			stored->mouse.dz += old.mouse.dz;
+			stored->mouse.dw += old.mouse.dw;
+		} else if (ev->type == ALLEGRO_EVENT_TOUCH_MOVE) {
+			stored->touch.dx += old.touch.dx;
+			stored->touch.dy += old.touch.dy;
+		}
+		return;
+	}
+	if (game->_priv.coalesced.count == game->_priv.coalesced.size) {
+		game->_priv.coalesced.size = game->_priv.coalesced.size ? game->_priv.coalesced.size * 2 : 8;
+		game->_priv.coalesced.events = realloc(game->_priv.coalesced.events, sizeof(ALLEGRO_EVENT) * game->_priv.coalesced.size);
+	}
+	game->_priv.coalesced.events[game->_priv.coalesced.count++] = *ev;
+}
+
+static void DispatchCoalescedEvent(struct Game* game, ALLEGRO_EVENT* ev) {
+	int category = GetEventCategory(ev->type);
+	for (int i = 0; i < game->_priv.dispatch.active_count; i++) {
+		struct Gamestate* tmp = game->_priv.dispatch.active[i];
+		if (!tmp->events.coalesce || !(tmp->events.mask & category)) {
+			continue;
+		}
+		if ((tmp->loaded) && (tmp->started) && (!tmp->paused)) {
+			game->_priv.current_gamestate = tmp;
+			tmp->api->process_event(game, tmp->data, ev);
+		}
+	}
+	game->_priv.current_gamestate = NULL;
+}
+
+static void RemoveCoalescedEvent(struct Game* game, int i) {
+	game->_priv.coalesced.count--;
+	memmove(&game->_priv.coalesced.events[i], &game->_priv.coalesced.events[i + 1], sizeof(ALLEGRO_EVENT) * (game->_priv.coalesced.count - i));
+}
+
+// Keeps coalesced movement ordered with other events of the same device: pending movement is delivered
+// before button presses, and dropped once the touch has ended.
+static void FlushCoalescedEvents(struct Game* game, ALLEGRO_EVENT* ev) {
+	int i = 0;
+	while (i < game->_priv.coalesced.count) {
+		ALLEGRO_EVENT* stored = &game->_priv.coalesced.events[i];
+		bool flush = false, drop = false;
+		switch (ev->type) {
+			case ALLEGRO_EVENT_MOUSE_BUTTON_DOWN:
+			case ALLEGRO_EVENT_MOUSE_BUTTON_UP:
+			case ALLEGRO_EVENT_MOUSE_ENTER_DISPLAY:
+			case ALLEGRO_EVENT_MOUSE_LEAVE_DISPLAY:
+			case ALLEGRO_EVENT_MOUSE_WARPED:
+				flush = stored->type == ALLEGRO_EVENT_MOUSE_AXES;
+				break;
+			case ALLEGRO_EVENT_TOUCH_END:
+			case ALLEGRO_EVENT_TOUCH_CANCEL:
+				drop = stored->type == ALLEGRO_EVENT_TOUCH_MOVE && stored->touch.id == ev->touch.id;
+				break;
+			case ALLEGRO_EVENT_JOYSTICK_BUTTON_DOWN:
+			case ALLEGRO_EVENT_JOYSTICK_BUTTON_UP:
+				flush = stored->type == ALLEGRO_EVENT_JOYSTICK_AXIS && stored->joystick.id == ev->joystick.id;
+				break;
+			case ALLEGRO_EVENT_JOYSTICK_CONFIGURATION:
+				// joysticks could have been disconnected
+				drop = stored->type == ALLEGRO_EVENT_JOYSTICK_AXIS;
+				break;
+			default:
+				break;
+		}
+		if (flush) {
+			ALLEGRO_EVENT pending = *stored;
+			RemoveCoalescedEvent(game, i);
+			DispatchCoalescedEvent(game, &pending);
+		} else if (drop) {
+			RemoveCoalescedEvent(game, i);
+		} else {
+			i++;
+		}
+	}
+}
+
 SYMBOL_INTERNAL void EventGamestates(struct Game* game, ALLEGRO_EVENT* ev) {
-	struct Gamestate* tmp = game->_priv.gamestates;
-	while (tmp) {
+	UpdateGamestateDispatch(game);
+	if (game->_priv.coalesced.count && !IsCoalescableEvent(ev)) {
+		FlushCoalescedEvents(game, ev);
+	}
+	int category = GetEventCategory(ev->type);
+	if (!(game->_priv.dispatch.events & category)) {
+		return;
+	}
+	bool coalesce = game->_priv.dispatch.coalesce && IsCoalescableEvent(ev);
+	if (coalesce) {
+		CoalesceEvent(game, ev);
+	}
+	for (int i = 0; i < game->_priv.dispatch.active_count; i++) {
+		struct Gamestate* tmp = game->_priv.dispatch.active[i];
+		if (!(tmp->events.mask & category) || (coalesce && tmp->events.coalesce)) {
+			continue;
+		}
 		if ((tmp->loaded) && (tmp->started) && (!tmp->paused)) {
 			game->_priv.current_gamestate = tmp;
 			tmp->api->process_event(game, tmp->data, ev);
 		}
-		tmp = tmp->next;
 	}
 	game->_priv.current_gamestate = NULL;
 }
 
+SYMBOL_INTERNAL void DispatchCoalescedEvents(struct Game* game) {
+	if (!game->_priv.coalesced.count) {
+		return;
+	}
+	UpdateGamestateDispatch(game);
+	for (int i = 0; i < game->_priv.coalesced.count; i++) {
+		DispatchCoalescedEvent(game, &game->_priv.coalesced.events[i]);
+	}
+	game->_priv.coalesced.count = 0;
+}
+
 SYMBOL_INTERNAL void FreezeGamestates(struct Game* game) {
 	struct Gamestate* tmp = game->_priv.gamestates;
 	while (tmp) {
@@ -201,26 +438,41 @@ SYMBOL_INTERNAL void UnfreezeGamestates(struct Game* game) {
 	}
 }
 
+SYMBOL_INTERNAL void CreateGamestateFramebuffer(struct Game* game, struct Gamestate* gamestate) {
+	if (game->_priv.params.handlers.compositor) {
+		gamestate->fb = BorrowRenderTarget(game, game->clip_rect.w, game->clip_rect.h);
+	} else {
+		gamestate->fb = al_create_sub_bitmap(al_get_backbuffer(game->display), game->clip_rect.x, game->clip_rect.y, game->clip_rect.w, game->clip_rect.h);
+	}
+	gamestate->cache.valid = false;
+}
+
+SYMBOL_INTERNAL void DestroyGamestateFramebuffer(struct Game* game, struct Gamestate* gamestate) {
+	if (!gamestate->fb) {
+		return;
+	}
+	// the compositor could have been toggled since the framebuffer was created
+	if (al_is_sub_bitmap(gamestate->fb)) {
+		al_destroy_bitmap(gamestate->fb);
+	} else {
+		ReturnRenderTarget(game, gamestate->fb);
+	}
+	gamestate->fb = NULL;
+	gamestate->cache.valid = false;
+}
+
 SYMBOL_INTERNAL void ResizeGamestates(struct Game* game) {
 	struct Gamestate* tmp = game->_priv.gamestates;
 	while (tmp) {
 		if (tmp->started) {
-			al_destroy_bitmap(tmp->fb);
-			if (game->_priv.params.handlers.compositor) {
-				tmp->fb = CreateNotPreservedBitmap(game->clip_rect.w, game->clip_rect.h);
-			} else {
-				tmp->fb = al_create_sub_bitmap(al_get_backbuffer(game->display), game->clip_rect.x, game->clip_rect.y, game->clip_rect.w, game->clip_rect.h);
-			}
+			DestroyGamestateFramebuffer(game, tmp);
+			CreateGamestateFramebuffer(game, tmp);
 		}
 		tmp = tmp->next;
 	}
 	if (game->_priv.loading.gamestate && game->_priv.loading.gamestate->open) {
-		al_destroy_bitmap(game->_priv.loading.gamestate->fb);
-		if (game->_priv.params.handlers.compositor) {
-			game->_priv.loading.gamestate->fb = CreateNotPreservedBitmap(game->clip_rect.w, game->clip_rect.h);
-		} else {
-			game->_priv.loading.gamestate->fb = al_create_sub_bitmap(al_get_backbuffer(game->display), game->clip_rect.x, game->clip_rect.y, game->clip_rect.w, game->clip_rect.h);
-		}
+		DestroyGamestateFramebuffer(game, game->_priv.loading.gamestate);
+		CreateGamestateFramebuffer(game, game->_priv.loading.gamestate);
 	}
 	if (game->_priv.started) {
 		DrawGamestates(game);
@@ -228,6 +480,10 @@ SYMBOL_INTERNAL void ResizeGamestates(struct Game* game) {
 }
 
 SYMBOL_INTERNAL int SetupAudio(struct Game* game) {
+	if (game->_priv.params.headless) {
+		// mixers keep working, they're just not connected to any output
+		return 0;
+	}
 #ifdef __EMSCRIPTEN__
 	game->audio.v = al_create_voice(game->_priv.samplerate, ALLEGRO_AUDIO_DEPTH_FLOAT32, ALLEGRO_CHANNEL_CONF_2);
 #else
@@ -287,6 +543,9 @@ SYMBOL_INTERNAL void DrawConsole(struct Game* game) {
 		DrawTextWithShadow(game->_priv.font_console, al_map_rgb(255, 255, 255), al_get_display_width(game->display), 0, ALLEGRO_ALIGN_RIGHT, sfps);
 		snprintf(sfps, 16, "%.2f ms", 1000 * (game_time - game->_priv.fps_count.time));
 		DrawTextWithShadow(game->_priv.font_console, al_map_rgb(255, 255, 255), al_get_display_width(game->display), al_get_font_line_height(game->_priv.font_console), ALLEGRO_ALIGN_RIGHT, sfps);
+		char ssprites[32] = {0};
+		snprintf(ssprites, 32, "%d/%d sprites", game->_priv.sprites.drawn, game->_priv.sprites.drawn + game->_priv.sprites.culled);
+		DrawTextWithShadow(game->_priv.font_console, al_map_rgb(255, 255, 255), al_get_display_width(game->display), al_get_font_line_height(game->_priv.font_console) * 2, ALLEGRO_ALIGN_RIGHT, ssprites);
 
 		DrawTimelines(game);
 
@@ -302,6 +561,8 @@ SYMBOL_INTERNAL void DrawConsole(struct Game* game) {
 	}
 	game->_priv.fps_count.time = game_time;
 	game->_priv.fps_count.frames_done++;
+	game->_priv.sprites.drawn = 0;
+	game->_priv.sprites.culled = 0;
 }
 
 SYMBOL_INTERNAL void Console_Load(struct Game* game) {
@@ -325,15 +586,18 @@ SYMBOL_INTERNAL void Console_Unload(struct Game* game) {
 	}
 }
 
+// gamestate being loaded by the current thread, so progress can be tracked for each loading thread separately
+static __thread struct Gamestate* loading_gamestate = NULL;
+
 SYMBOL_INTERNAL void* GamestateLoadingThread(void* arg) {
 	struct GamestateLoadingThreadData* data = arg;
-	data->game->_priv.loading.in_progress = true;
+	loading_gamestate = data->gamestate;
 	al_restore_state(&data->state);
 	data->gamestate->data = data->gamestate->api->load(data->game, &GamestateProgress);
-	if (data->game->_priv.loading.progress != data->gamestate->progress_count) {
-		PrintConsole(data->game, "[%s] WARNING: Gamestate_ProgressCount does not match the number of progress invokations (%d)!", data->gamestate->name, data->game->_priv.loading.progress);
+	if (data->gamestate->progress != data->gamestate->progress_count) {
+		PrintConsole(data->game, "[%s] WARNING: Gamestate_ProgressCount does not match the number of progress invokations (%d)!", data->gamestate->name, data->gamestate->progress);
 #ifndef LIBSUPERDERPY_SINGLE_THREAD
-		if (data->game->config.debug.enabled) {
+		if (data->game->config.debug.enabled && data->gamestate != data->game->_priv.preload.gamestate) {
 			PrintConsole(data->game, "(sleeping for 3 seconds...)");
 			data->game->show_console = true;
 			al_rest(3.0);
@@ -342,10 +606,194 @@ SYMBOL_INTERNAL void* GamestateLoadingThread(void* arg) {
 	}
 	al_store_state(&data->state, ALLEGRO_STATE_NEW_FILE_INTERFACE | ALLEGRO_STATE_NEW_BITMAP_PARAMETERS | ALLEGRO_STATE_BLENDER);
 
-	data->game->_priv.loading.in_progress = false;
+	loading_gamestate = NULL;
+	data->done = true;
 	return NULL;
 }
 
+#ifndef LIBSUPERDERPY_SINGLE_THREAD
+// Called by loading threads after each progress step; blocks until the main thread uploads their bitmaps.
+static void WaitForTextureSync(struct Game* game) {
+	al_lock_mutex(game->_priv.texture_sync_mutex);
+	unsigned int generation = game->_priv.texture_sync_generation;
+	game->_priv.texture_sync_waiting++;
+	while (generation == game->_priv.texture_sync_generation) {
+		al_wait_cond(game->_priv.texture_sync_cond, game->_priv.texture_sync_mutex);
+	}
+	al_unlock_mutex(game->_priv.texture_sync_mutex);
+}
+#endif
+
+SYMBOL_INTERNAL bool SyncTextures(struct Game* game, int threads, bool force) {
+	// memory bitmaps can only be converted when none of the running loading threads is working on them
+	al_lock_mutex(game->_priv.texture_sync_mutex);
+	bool ready = game->_priv.texture_sync_waiting >= threads && (force || game->_priv.texture_sync_waiting > 0);
+	if (ready) {
+		al_convert_memory_bitmaps();
+		if (game->_priv.texture_sync_waiting) {
+			game->_priv.texture_sync_waiting = 0;
+			game->_priv.texture_sync_generation++;
+			al_broadcast_cond(game->_priv.texture_sync_cond);
+		}
+	}
+	al_unlock_mutex(game->_priv.texture_sync_mutex);
+	return ready;
+}
+
+// Lets the calling thread wait for another loading thread without holding up the texture synchronization it may be blocked on.
+SYMBOL_INTERNAL void YieldLoadingThread(struct Game* game) {
+#ifndef LIBSUPERDERPY_SINGLE_THREAD
+	if (loading_gamestate) {
+		WaitForTextureSync(game);
+		return;
+	}
+	if (game->_priv.preload.gamestate) {
+		// main thread waiting for the preloading thread
+		SyncTextures(game, 1, false);
+	}
+#endif
+	al_rest(0.001);
+}
+
+SYMBOL_INTERNAL struct Gamestate* GetContextGamestate(struct Game* game) {
+	// concurrently loading gamestates can't share the global one
+	return loading_gamestate ? loading_gamestate : game->_priv.current_gamestate;
+}
+
+#ifndef LIBSUPERDERPY_SINGLE_THREAD
+// Returns true once all dependencies of the gamestate are loaded; missing ones get marked for preloading.
+static bool PrepareGamestateForPreloading(struct Game* game, struct Gamestate* gamestate) {
+	if (!gamestate->open) {
+		if (!OpenGamestate(game, gamestate, true) || !LinkGamestate(game, gamestate)) {
+			gamestate->pending_preload = false;
+			return false;
+		}
+	}
+	if (!gamestate->api) {
+		gamestate->pending_preload = false;
+		return false;
+	}
+	bool ready = true;
+	for (const char** name = gamestate->api->dependencies; name && *name; name++) {
+		struct Gamestate* dependency = GetGamestate(game, *name);
+		if (dependency == gamestate || (dependency && dependency->loaded && !dependency->pending_unload)) {
+			continue;
+		}
+		if (!dependency || !(dependency->pending_load || dependency->pending_preload)) {
+			PrintConsole(game, "Gamestate \"%s\" depends on \"%s\", preloading it as well.", gamestate->name, *name);
+			PreloadGamestate(game, *name);
+		}
+		ready = false;
+	}
+	return ready;
+}
+#endif
+
+SYMBOL_INTERNAL void StartPreloading(struct Game* game) {
+#ifndef LIBSUPERDERPY_SINGLE_THREAD
+	if (game->_priv.preload.gamestate) {
+		return;
+	}
+	struct Gamestate* tmp = game->_priv.gamestates;
+	while (tmp && !(tmp->pending_preload && !tmp->pending_load && PrepareGamestateForPreloading(game, tmp))) {
+		tmp = tmp->next;
+	}
+	if (!tmp) {
+		return;
+	}
+	PrintConsole(game, "Preloading gamestate \"%s\"...", tmp->name);
+	struct GamestateLoadingThreadData* data = calloc(1, sizeof(struct GamestateLoadingThreadData));
+	data->game = game;
+	data->gamestate = tmp;
+	al_store_state(&data->state, ALLEGRO_STATE_NEW_FILE_INTERFACE | ALLEGRO_STATE_NEW_BITMAP_PARAMETERS | ALLEGRO_STATE_BLENDER);
+	tmp->progress = 0;
+	game->_priv.preload.gamestate = tmp;
+	game->_priv.preload.data = data;
+	game->_priv.preload.credit = 0;
+	game->_priv.preload.time = al_get_time();
+	al_run_detached_thread(GamestateLoadingThread, data);
+#endif
+}
+
+// Converts bitmaps that the preloading thread can't touch anymore, until the time limit runs out.
+// Returns true when there's nothing left to convert individually.
+static bool UploadPreloadedBitmaps(struct Game* game, bool done, double limit) {
+	al_lock_mutex(game->_priv.texture_sync_mutex);
+	bool waiting = game->_priv.texture_sync_waiting > 0;
+	al_unlock_mutex(game->_priv.texture_sync_mutex);
+	if (!done && !waiting) {
+		return false;
+	}
+	double start = al_get_time();
+	ALLEGRO_STATE state;
+	al_store_state(&state, ALLEGRO_STATE_NEW_BITMAP_PARAMETERS);
+	al_lock_mutex(game->_priv.cache_mutex);
+	// at least one bitmap gets uploaded per call, even if it takes longer than the limit
+	while (game->_priv.preload.bitmaps && al_get_time() - start < limit) {
+		struct List* item = game->_priv.preload.bitmaps;
+		ALLEGRO_BITMAP* bitmap = item->data;
+		game->_priv.preload.bitmaps = item->next;
+		free(item);
+		// keep the flags the bitmap was loaded with
+		al_set_new_bitmap_flags(al_get_bitmap_flags(bitmap) & ~ALLEGRO_MEMORY_BITMAP);
+		al_set_new_bitmap_format(al_get_bitmap_format(bitmap));
+		al_convert_bitmap(bitmap);
+	}
+	bool finished = !game->_priv.preload.bitmaps;
+	al_unlock_mutex(game->_priv.cache_mutex);
+	al_restore_state(&state);
+	return finished;
+}
+
+static void FinishPreloading(struct Game* game) {
+	struct Gamestate* tmp = game->_priv.preload.gamestate;
+	al_convert_memory_bitmaps();
+	ReloadShaders(game, false);
+	if (tmp->api->post_load) {
+		PrintConsole(game, "[%s] Post-loading...", tmp->name);
+		struct Gamestate* current = game->_priv.current_gamestate;
+		game->_priv.current_gamestate = tmp;
+		tmp->api->post_load(game, tmp->data);
+		game->_priv.current_gamestate = current;
+	}
+	PrintConsole(game, "Gamestate \"%s\" preloaded successfully in %f seconds.", tmp->name, al_get_time() - game->_priv.preload.time);
+	tmp->loaded = true;
+	tmp->pending_load = false;
+	tmp->pending_preload = false;
+	free(game->_priv.preload.data);
+	game->_priv.preload.data = NULL;
+	game->_priv.preload.gamestate = NULL;
+}
+
+SYMBOL_INTERNAL void ProcessPreloading(struct Game* game, bool wait) {
+	if (!game->_priv.preload.gamestate) {
+		return;
+	}
+	double budget = game->config.preload_budget;
+	game->_priv.preload.credit = fmin(game->_priv.preload.credit + budget, budget);
+	while (true) {
+		bool done = game->_priv.preload.data->done;
+		bool uploaded = false;
+		if (wait || budget <= 0 || game->_priv.preload.credit > 0) {
+			double time = al_get_time();
+			// the thread is released only after all bitmaps from its last step have been uploaded
+			uploaded = UploadPreloadedBitmaps(game, done, (wait || budget <= 0) ? INFINITY : game->_priv.preload.credit);
+			if (uploaded) {
+				SyncTextures(game, done ? 0 : 1, false);
+			}
+			game->_priv.preload.credit -= al_get_time() - time;
+		}
+		if (done && uploaded) {
+			FinishPreloading(game);
+			return;
+		}
+		if (!wait) {
+			return;
+		}
+		al_rest(0.001);
+	}
+}
+
 SYMBOL_INTERNAL void* ScreenshotThread(void* arg) {
 	struct ScreenshotThreadData* data = arg;
 	ALLEGRO_PATH* path = al_get_standard_path(ALLEGRO_USER_DOCUMENTS_PATH);
@@ -360,27 +808,35 @@ SYMBOL_INTERNAL void* ScreenshotThread(void* arg) {
 	return NULL;
 }
 
-SYMBOL_INTERNAL void CalculateProgress(struct Game* game) {
-	struct Gamestate* tmp = game->_priv.loading.current;
-	float progress = ((game->_priv.loading.progress / (float)(tmp->progress_count + 1)) / (float)game->_priv.loading.to_load) + (game->_priv.loading.loaded / (float)game->_priv.loading.to_load);
+SYMBOL_INTERNAL void CalculateProgress(struct Game* game, struct Gamestate* gamestate) {
+	float progress = game->_priv.loading.loaded;
+	for (struct Gamestate* tmp = game->_priv.gamestates; tmp; tmp = tmp->next) {
+		if (tmp->pending_load) {
+			progress += tmp->progress / (float)(tmp->progress_count + 1);
+		}
+	}
+	progress /= (float)game->_priv.loading.to_load;
 	if (game->config.debug.enabled) {
-		PrintConsole(game, "[%s] Progress: %d%% (%d/%d)", tmp->name, (int)(progress * 100), game->_priv.loading.progress, tmp->progress_count + 1);
+		PrintConsole(game, "[%s] Progress: %d%% (%d/%d)", gamestate->name, (int)(progress * 100), gamestate->progress, gamestate->progress_count + 1);
 	}
 	game->loading.progress = progress;
 }
 
 SYMBOL_INTERNAL void GamestateProgress(struct Game* game) {
-	game->_priv.loading.progress++;
-	CalculateProgress(game);
+	struct Gamestate* gamestate = loading_gamestate;
+	gamestate->progress++;
 #ifndef LIBSUPERDERPY_SINGLE_THREAD
-	// TODO: debounce thread synchronization to reduce overhead
-	al_lock_mutex(game->_priv.texture_sync_mutex);
-	game->_priv.texture_sync = true;
-	while (game->_priv.texture_sync) {
-		al_wait_cond(game->_priv.texture_sync_cond, game->_priv.texture_sync_mutex);
+	if (gamestate == game->_priv.preload.gamestate) {
+		if (game->config.debug.enabled) {
+			PrintConsole(game, "[%s] Preloading progress: %d/%d", gamestate->name, gamestate->progress, gamestate->progress_count + 1);
+		}
+	} else {
+		CalculateProgress(game, gamestate);
 	}
-	al_unlock_mutex(game->_priv.texture_sync_mutex);
+	// TODO: debounce thread synchronization to reduce overhead
+	WaitForTextureSync(game);
 #else
+	CalculateProgress(game, gamestate);
 	al_convert_memory_bitmaps();
 	double delta = al_get_time() - game->_priv.loading.time;
 	game->time += delta; // TODO: ability to disable passing time during loading
@@ -442,6 +898,7 @@ SYMBOL_INTERNAL bool LinkGamestate(struct Game* game, struct Gamestate* gamestat
 	gamestate->api->resume = dlsym(gamestate->handle, "Gamestate_Resume");
 	gamestate->api->reload = dlsym(gamestate->handle, "Gamestate_Reload");
 	gamestate->api->progress_count = dlsym(gamestate->handle, "Gamestate_ProgressCount");
+	gamestate->api->dependencies = dlsym(gamestate->handle, "Gamestate_Dependencies");
 
 #undef GS_ERROR
 
@@ -470,14 +927,22 @@ SYMBOL_INTERNAL struct Gamestate* AllocateGamestate(struct Game* game, const cha
 	tmp->pending_start = false;
 	tmp->pending_stop = false;
 	tmp->pending_unload = false;
+	tmp->pending_preload = false;
 	tmp->next = NULL;
+	tmp->bucket_next = NULL;
 	tmp->api = NULL;
 	tmp->fromlib = true;
 	tmp->progress_count = 0;
+	tmp->progress = 0;
 	tmp->open = false;
 	tmp->fb = NULL;
 	tmp->show_loading = true;
 	tmp->data = NULL;
+	tmp->cache.enabled = false;
+	tmp->cache.valid = false;
+	tmp->cache.dirty = false;
+	tmp->events.mask = GAMESTATE_EVENTS_ALL;
+	tmp->events.coalesce = false;
 	return tmp;
 }
 
@@ -688,7 +1153,7 @@ SYMBOL_INTERNAL void PauseExecution(struct Game* game) {
 }
 
 SYMBOL_INTERNAL void ReloadCode(struct Game* game) {
-	ReloadShaders(game, true);
+	ReloadModifiedShaders(game);
 	PrintConsole(game, "DEBUG: Reloading the gamestates...");
 	struct Gamestate* tmp = game->_priv.gamestates;
 	while (tmp) {
@@ -728,7 +1193,7 @@ SYMBOL_INTERNAL char* GetGameName(struct Game* game, const char* format) {
 	return AddGarbage(game, result);
 }
 
-static int HashString(struct Game* game, const char* str) {
+static int HashString(struct Game* game, const char* str, int buckets) {
 	unsigned long hash = 5381;
 	char c = 0;
 
@@ -736,8 +1201,37 @@ static int HashString(struct Game* game, const char* str) {
 		hash = ((hash << 5) + hash) + c; /* hash * 33 + c */
 	}
 
-	//PrintConsole(game, "sum %d, bucket %d", hash, hash % LIBSUPERDERPY_BITMAP_HASHMAP_BUCKETS);
-	return hash % LIBSUPERDERPY_BITMAP_HASHMAP_BUCKETS;
+	//PrintConsole(game, "sum %d, bucket %d", hash, hash % buckets);
+	return hash % buckets;
+}
+
+SYMBOL_INTERNAL void AddGamestateToMap(struct Game* game, struct Gamestate* gamestate) {
+	int bucket = HashString(game, gamestate->name, LIBSUPERDERPY_GAMESTATE_HASHMAP_BUCKETS);
+	gamestate->bucket_next = game->_priv.gamestates_map[bucket];
+	game->_priv.gamestates_map[bucket] = gamestate;
+}
+
+SYMBOL_INTERNAL void RemoveGamestateFromMap(struct Game* game, struct Gamestate* gamestate) {
+	struct Gamestate** tmp = &game->_priv.gamestates_map[HashString(game, gamestate->name, LIBSUPERDERPY_GAMESTATE_HASHMAP_BUCKETS)];
+	while (*tmp) {
+		if (*tmp == gamestate) {
+			*tmp = gamestate->bucket_next;
+			gamestate->bucket_next = NULL;
+			return;
+		}
+		tmp = &(*tmp)->bucket_next;
+	}
+}
+
+SYMBOL_INTERNAL struct Gamestate* FindGamestate(struct Game* game, const char* name) {
+	struct Gamestate* tmp = game->_priv.gamestates_map[HashString(game, name, LIBSUPERDERPY_GAMESTATE_HASHMAP_BUCKETS)];
+	while (tmp) {
+		if (!strcmp(name, tmp->name)) {
+			return tmp;
+		}
+		tmp = tmp->bucket_next;
+	}
+	return NULL;
 }
 
 static bool RefCountIdentity(struct List* elem, void* data) {
@@ -764,40 +1258,149 @@ SYMBOL_INTERNAL void RedrawScreen(struct Game* game) {
 }
 
 SYMBOL_INTERNAL ALLEGRO_BITMAP* AddBitmap(struct Game* game, char* filename) {
-	int bucket = HashString(game, filename);
+	return AddPreloadedBitmap(game, filename, NULL);
+}
+
+static struct RefCount* AcquireBitmap(struct Game* game, int bucket, char* filename) {
 	struct List* item = FindInList(game->_priv.bitmaps[bucket], filename, RefCountIdentity);
-	struct RefCount* rc = NULL;
-	if (item) {
-		rc = item->data;
-		rc->counter++;
+	if (!item) {
+		return NULL;
+	}
+	struct RefCount* rc = item->data;
+	rc->counter++;
+	return rc;
+}
+
+SYMBOL_INTERNAL ALLEGRO_BITMAP* AddPreloadedBitmap(struct Game* game, char* filename, ALLEGRO_BITMAP* preloaded) {
+	int bucket = HashString(game, filename, LIBSUPERDERPY_BITMAP_HASHMAP_BUCKETS);
+	al_lock_mutex(game->_priv.cache_mutex);
+	struct RefCount* rc = AcquireBitmap(game, bucket, filename);
+	al_unlock_mutex(game->_priv.cache_mutex);
+	if (rc) {
+		if (preloaded) {
+			al_destroy_bitmap(preloaded);
+		}
+		return rc->data;
+	}
+
+	// decoding happens without holding the lock, so other loading threads aren't blocked by it
+	ALLEGRO_BITMAP* bitmap = NULL;
+	if (preloaded) {
+		// decoded into a memory bitmap by another thread; upload it with current flags
+		bitmap = al_clone_bitmap(preloaded);
+		al_destroy_bitmap(preloaded);
+	} else {
+		bitmap = al_load_bitmap(GetDataFilePath(game, filename));
+	}
+	if (!bitmap) {
+		FatalError(game, false, "Bitmap %s (%s) failed to load.", filename, GetDataFilePath(game, filename));
+	}
+
+	al_lock_mutex(game->_priv.cache_mutex);
+	rc = AcquireBitmap(game, bucket, filename);
+	if (rc) {
+		// another thread has loaded it in the meantime
+		al_destroy_bitmap(bitmap);
 	} else {
 		rc = malloc(sizeof(struct RefCount));
 		rc->counter = 1;
 		rc->id = strdup(filename);
-		rc->data = al_load_bitmap(GetDataFilePath(game, filename));
-		if (!rc->data) {
-			FatalError(game, false, "Bitmap %s (%s) failed to load.", filename, GetDataFilePath(game, filename));
-		}
+		rc->data = bitmap;
 		game->_priv.bitmaps[bucket] = AddToList(game->_priv.bitmaps[bucket], rc);
+		if (bitmap && loading_gamestate && loading_gamestate == game->_priv.preload.gamestate && (al_get_bitmap_flags(bitmap) & ALLEGRO_MEMORY_BITMAP)) {
+			// uploaded one by one by ProcessPreloading, within the frame budget
+			game->_priv.preload.bitmaps = AddToList(game->_priv.preload.bitmaps, bitmap);
+		}
+		WatchFile(game, GetDataFilePath(game, filename), WATCHED_BITMAP, rc->data);
 	}
+	al_unlock_mutex(game->_priv.cache_mutex);
 	return rc->data;
 }
 
 SYMBOL_INTERNAL void RemoveBitmap(struct Game* game, char* filename) {
-	int bucket = HashString(game, filename);
+	int bucket = HashString(game, filename, LIBSUPERDERPY_BITMAP_HASHMAP_BUCKETS);
+	al_lock_mutex(game->_priv.cache_mutex);
 	struct List* item = FindInList(game->_priv.bitmaps[bucket], filename, RefCountIdentity);
-	if (item) {
-		struct RefCount* rc = item->data;
-		rc->counter--;
-		if (rc->counter == 0) {
-			RemoveFromList(&game->_priv.bitmaps[bucket], filename, RefCountIdentity);
-			al_destroy_bitmap(rc->data);
-			free(rc->id);
-			free(rc);
-		}
+	struct RefCount* rc = item ? item->data : NULL;
+	if (rc && --rc->counter == 0) {
+		RemoveFromList(&game->_priv.bitmaps[bucket], filename, RefCountIdentity);
+		RemoveFromList(&game->_priv.preload.bitmaps, rc->data, Identity);
 	} else {
+		rc = NULL;
+	}
+	al_unlock_mutex(game->_priv.cache_mutex);
+	if (!item) {
 		PrintConsole(game, "Tried to remove non-existent bitmap %s!", filename);
 	}
+	if (rc) {
+		UnwatchFile(game, rc->data);
+		al_destroy_bitmap(rc->data);
+		free(rc->id);
+		free(rc);
+	}
+}
+
+SYMBOL_INTERNAL void ReloadBitmap(struct Game* game, ALLEGRO_BITMAP* bitmap, const char* path) {
+	ALLEGRO_BITMAP* fresh = al_load_bitmap(path);
+	if (!fresh) {
+		PrintConsole(game, "Failed to reload bitmap %s!", path);
+		return;
+	}
+	if (al_get_bitmap_width(fresh) != al_get_bitmap_width(bitmap) || al_get_bitmap_height(fresh) != al_get_bitmap_height(bitmap)) {
+		// the bitmap can't be replaced without invalidating pointers held by gamestates
+		PrintConsole(game, "Bitmap %s has changed its size, reload the gamestate to see the changes.", path);
+		al_destroy_bitmap(fresh);
+		return;
+	}
+	// overwrite the contents in place, so sub-bitmaps and existing references stay valid
+	ALLEGRO_STATE state;
+	al_store_state(&state, ALLEGRO_STATE_TARGET_BITMAP | ALLEGRO_STATE_BLENDER);
+	al_set_target_bitmap(bitmap);
+	al_set_blender(ALLEGRO_ADD, ALLEGRO_ONE, ALLEGRO_ZERO);
+	al_draw_bitmap(fresh, 0, 0, 0);
+	al_restore_state(&state);
+	al_destroy_bitmap(fresh);
+}
+
+static bool InternedStringIdentity(struct List* elem, void* data) {
+	return strcmp(data, elem->data) == 0;
+}
+
+SYMBOL_INTERNAL const char* FindInternedString(struct Game* game, const char* str) {
+	int bucket = HashString(game, str, LIBSUPERDERPY_INTERNED_STRINGS_HASHMAP_BUCKETS);
+	al_lock_mutex(game->_priv.mutex);
+	struct List* item = FindInList(game->_priv.interned_strings[bucket], (void*)str, InternedStringIdentity);
+	al_unlock_mutex(game->_priv.mutex);
+	return item ? item->data : NULL;
+}
+
+SYMBOL_EXPORT const char* InternString(struct Game* game, const char* str) {
+	if (!str) {
+		return NULL;
+	}
+	int bucket = HashString(game, str, LIBSUPERDERPY_INTERNED_STRINGS_HASHMAP_BUCKETS);
+	al_lock_mutex(game->_priv.mutex);
+	struct List* item = FindInList(game->_priv.interned_strings[bucket], (void*)str, InternedStringIdentity);
+	char* result = NULL;
+	if (item) {
+		result = item->data;
+	} else {
+		result = strdup(str);
+		game->_priv.interned_strings[bucket] = AddToList(game->_priv.interned_strings[bucket], result);
+	}
+	al_unlock_mutex(game->_priv.mutex);
+	return result;
+}
+
+SYMBOL_INTERNAL void ClearInternedStrings(struct Game* game) {
+	for (int i = 0; i < LIBSUPERDERPY_INTERNED_STRINGS_HASHMAP_BUCKETS; i++) {
+		while (game->_priv.interned_strings[i]) {
+			struct List* tmp = game->_priv.interned_strings[i];
+			game->_priv.interned_strings[i] = tmp->next;
+			free(tmp->data);
+			free(tmp);
+		}
+	}
 }
 
 SYMBOL_INTERNAL void SetupViewport(struct Game* game) {
@@ -858,6 +1461,8 @@ SYMBOL_INTERNAL void SetupViewport(struct Game* game) {
 	al_use_transform(&game->_priv.projection);
 	Console_Unload(game);
 	Console_Load(game);
+	ClearTextLayouts(game);
+	ClearTextCache(game);
 	ResizeGamestates(game);
 
 	PrintConsole(game, "Viewport %dx%d; display %dx%d", game->viewport.width, game->viewport.height, al_get_display_width(game->display), al_get_display_height(game->display));
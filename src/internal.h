@@ -85,6 +85,8 @@ struct GamestateLoadingThreadData {
 	struct Game* game;
 	struct Gamestate* gamestate;
 	ALLEGRO_STATE state;
+	volatile bool done;
+	bool finishing;
 };
 
 struct ScreenshotThreadData {
@@ -95,7 +97,7 @@ struct ScreenshotThreadData {
 struct Gamestate {
 	char* name;
 	void* handle;
-	bool loaded, pending_load, pending_unload;
+	bool loaded, pending_load, pending_unload, pending_preload;
 	bool started, pending_start, pending_stop;
 	bool frozen;
 	bool show_loading;
@@ -103,16 +105,51 @@ struct Gamestate {
 	bool fromlib;
 	bool open;
 	struct Gamestate* next;
+	struct Gamestate* bucket_next; // next gamestate in the same bucket of the name map
 	struct GamestateAPI* api;
 	ALLEGRO_BITMAP* fb;
 	int progress_count;
+	int progress;
 	void* data;
+
+	struct {
+		bool enabled; // framebuffer is kept between frames and redrawn only when invalidated
+		bool valid; // framebuffer holds a complete frame
+		bool dirty; // the dirty rectangle has to be redrawn
+		float x1, y1, x2, y2; // dirty rectangle in viewport coordinates
+	} cache;
+
+	struct {
+		int mask; // GAMESTATE_EVENTS categories to be delivered
+		bool coalesce; // movement events are delivered once per frame
+	} events;
 };
 
+typedef enum WATCHED_FILE_TYPE {
+	WATCHED_BITMAP,
+	WATCHED_SPRITESHEET,
+	WATCHED_SHADER
+} WATCHED_FILE_TYPE;
+
 void SimpleCompositor(struct Game* game);
+void GetGamestateDirtyRect(struct Gamestate* gamestate, int* x, int* y, int* w, int* h);
 void DrawGamestates(struct Game* game);
 void LogicGamestates(struct Game* game, double delta);
 void EventGamestates(struct Game* game, ALLEGRO_EVENT* ev);
+void DispatchCoalescedEvents(struct Game* game);
+void UpdateInputState(struct Game* game, ALLEGRO_EVENT* ev);
+void AdvanceInputState(struct Game* game);
+bool StartRecording(struct Game* game, const char* filename);
+bool StartReplay(struct Game* game, const char* filename);
+bool IsReplaying(struct Game* game);
+bool IsReplacedByReplay(struct Game* game, ALLEGRO_EVENT* ev);
+void RecordEvent(struct Game* game, ALLEGRO_EVENT* ev);
+void RecordFrame(struct Game* game, double delta);
+bool GetNextReplayedEvent(struct Game* game, ALLEGRO_EVENT* ev);
+bool GetReplayedFrame(struct Game* game, double* delta);
+void StopReplay(struct Game* game);
+void MeasureFrameTime(struct Game* game);
+void ReportFrameTimes(struct Game* game);
 void ReloadGamestates(struct Game* game);
 void FreezeGamestates(struct Game* game);
 void UnfreezeGamestates(struct Game* game);
@@ -123,8 +160,13 @@ void DrawConsole(struct Game* game);
 void Console_Load(struct Game* game);
 void Console_Unload(struct Game* game);
 void* GamestateLoadingThread(void* arg);
+bool SyncTextures(struct Game* game, int threads, bool force);
+void YieldLoadingThread(struct Game* game);
+struct Gamestate* GetContextGamestate(struct Game* game);
+void StartPreloading(struct Game* game);
+void ProcessPreloading(struct Game* game, bool wait);
 void* ScreenshotThread(void* arg);
-void CalculateProgress(struct Game* game);
+void CalculateProgress(struct Game* game, struct Gamestate* gamestate);
 void GamestateProgress(struct Game* game);
 void* AddGarbage(struct Game* game, void* data);
 void ClearGarbage(struct Game* game);
@@ -139,16 +181,44 @@ bool OpenGamestate(struct Game* game, struct Gamestate* gamestate, bool required
 bool LinkGamestate(struct Game* game, struct Gamestate* gamestate);
 void CloseGamestate(struct Game* game, struct Gamestate* gamestate);
 struct Gamestate* AllocateGamestate(struct Game* game, const char* name);
+void AddGamestateToMap(struct Game* game, struct Gamestate* gamestate);
+void RemoveGamestateFromMap(struct Game* game, struct Gamestate* gamestate);
+struct Gamestate* FindGamestate(struct Game* game, const char* name);
+void InvalidateGamestateDispatch(struct Game* game);
 char* GetLibraryPath(struct Game* game, char* filename);
 void PauseExecution(struct Game* game);
 void ReloadCode(struct Game* game);
 void ResumeExecution(struct Game* game);
 void ReloadShaders(struct Game* game, bool force);
+void ReloadModifiedShaders(struct Game* game);
+void CompilePendingShaders(struct Game* game);
 void DestroyShaders(struct Game* game);
 __attribute__((__format__(__printf__, 2, 0))) char* GetGameName(struct Game* game, const char* format);
 ALLEGRO_BITMAP* AddBitmap(struct Game* game, char* filename);
+ALLEGRO_BITMAP* AddPreloadedBitmap(struct Game* game, char* filename, ALLEGRO_BITMAP* preloaded);
 void RemoveBitmap(struct Game* game, char* filename);
+void ReloadBitmap(struct Game* game, ALLEGRO_BITMAP* bitmap, const char* path);
+void ReloadSpritesheet(struct Game* game, struct Spritesheet* spritesheet, const char* path);
+void WatchFile(struct Game* game, const char* path, WATCHED_FILE_TYPE type, void* data);
+void UnwatchFile(struct Game* game, void* data);
+void PollWatchedFiles(struct Game* game);
+void DestroyFileWatcher(struct Game* game);
 void SetupViewport(struct Game* game);
+void CreateGamestateFramebuffer(struct Game* game, struct Gamestate* gamestate);
+void DestroyGamestateFramebuffer(struct Game* game, struct Gamestate* gamestate);
+void ExpireRenderTargets(struct Game* game);
+void ClearRenderTargets(struct Game* game);
+const char* FindInternedString(struct Game* game, const char* str);
+void ClearInternedStrings(struct Game* game);
+void ExpireTextLayouts(struct Game* game);
+void ClearTextLayouts(struct Game* game);
+void ClearTextCache(struct Game* game);
+bool GetTextCacheSlot(struct Game* game, ALLEGRO_FONT* font, ALLEGRO_COLOR color, int width, int flags, bool shadow, char const* text, int* x, int* y, int* w, int* h);
+void DestroyTextCache(struct Game* game);
+TWEEN_STYLE ParseTweenStyle(struct Game* game, const char* str);
+void InsertKeyframe(struct KeyframeTrack* track, double time, float value, TWEEN_STYLE style);
+void AnimateCharacterKeyframes(struct Game* game, struct Character* character, double delta);
+void UpdateCharacterSpatialIndex(struct Game* game, struct Character* character);
 void RedrawScreen(struct Game* game);
 
 #endif /* LIBSUPERDERPY_INTERNAL_H */
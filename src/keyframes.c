@@ -0,0 +1,342 @@
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This file is part of libsuperderpy.
+ *
+ * libsuperderpy is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libsuperderpy is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libsuperderpy. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Also, ponies.
+ */
+
+#include "internal.h"
+
+#define KEYFRAMES_MAGIC "SDKF"
+#define KEYFRAMES_VERSION 1
+
+static const char* PROPERTY_NAMES[KEYFRAME_PROPERTY_COUNT] = {
+	"x", "y", "scaleX", "scaleY", "angle", "r", "g", "b", "a"};
+
+// in the same order as TWEEN_STYLE
+static const char* STYLE_NAMES[] = {
+	"linear",
+	"quadratic_in", "quadratic_out", "quadratic_in_out",
+	"cubic_in", "cubic_out", "cubic_in_out",
+	"quartic_in", "quartic_out", "quartic_in_out",
+	"quintic_in", "quintic_out", "quintic_in_out",
+	"sine_in", "sine_out", "sine_in_out",
+	"circular_in", "circular_out", "circular_in_out",
+	"exponential_in", "exponential_out", "exponential_in_out",
+	"elastic_in", "elastic_out", "elastic_in_out",
+	"back_in", "back_out", "back_in_out",
+	"bounce_in", "bounce_out", "bounce_in_out"};
+
+SYMBOL_INTERNAL TWEEN_STYLE ParseTweenStyle(struct Game* game, const char* str) {
+	while (*str == ' ' || *str == '\t') {
+		str++;
+	}
+	if (!*str) {
+		return TWEEN_STYLE_LINEAR;
+	}
+	for (unsigned int i = 0; i < sizeof(STYLE_NAMES) / sizeof(STYLE_NAMES[0]); i++) {
+		if (!strcmp(str, STYLE_NAMES[i])) {
+			return i;
+		}
+	}
+	PrintConsole(game, "Unknown keyframe easing style: %s", str);
+	return TWEEN_STYLE_LINEAR;
+}
+
+SYMBOL_EXPORT struct KeyframeAnimation* CreateKeyframeAnimation(struct Game* game, const char* name) {
+	struct KeyframeAnimation* animation = calloc(1, sizeof(struct KeyframeAnimation));
+	animation->name = name ? strdup(name) : NULL;
+	animation->duration = 0.0;
+	animation->loop = false;
+	return animation;
+}
+
+SYMBOL_EXPORT void DestroyKeyframeAnimation(struct Game* game, struct KeyframeAnimation* animation) {
+	for (int i = 0; i < KEYFRAME_PROPERTY_COUNT; i++) {
+		free(animation->tracks[i].keyframes);
+	}
+	if (animation->name) {
+		free(animation->name);
+	}
+	free(animation);
+}
+
+SYMBOL_INTERNAL void InsertKeyframe(struct KeyframeTrack* track, double time, float value, TWEEN_STYLE style) {
+	int pos = track->count;
+	while (pos > 0 && track->keyframes[pos - 1].time > time) {
+		pos--;
+	}
+	if (pos > 0 && track->keyframes[pos - 1].time == time) {
+		track->keyframes[pos - 1].value = value;
+		track->keyframes[pos - 1].style = style;
+		return;
+	}
+
+	if (track->count == track->size) {
+		track->size = track->size ? track->size * 2 : 8;
+		track->keyframes = realloc(track->keyframes, sizeof(struct Keyframe) * track->size);
+	}
+	memmove(&track->keyframes[pos + 1], &track->keyframes[pos], sizeof(struct Keyframe) * (track->count - pos));
+	track->keyframes[pos] = (struct Keyframe){.time = time, .value = value, .style = style};
+	track->count++;
+	track->hint = 0;
+}
+
+SYMBOL_EXPORT void AddKeyframe(struct Game* game, struct KeyframeAnimation* animation, KEYFRAME_PROPERTY property, double time, float value, TWEEN_STYLE style) {
+	InsertKeyframe(&animation->tracks[property], time, value, style);
+	if (time > animation->duration) {
+		animation->duration = time;
+	}
+}
+
+SYMBOL_EXPORT float EvaluateKeyframeTrack(struct KeyframeTrack* track, double time) {
+	struct Keyframe* k = track->keyframes;
+	int count = track->count;
+
+	if (!count) {
+		return 0.0;
+	}
+	if (time <= k[0].time) {
+		return k[0].value;
+	}
+	if (time >= k[count - 1].time) {
+		return k[count - 1].value;
+	}
+
+	// playback moves forward most of the time, so try the cached segment and its successor before searching
+	int i = track->hint;
+	if (i < 0 || i >= count - 1 || k[i].time > time || k[i + 1].time <= time) {
+		if (i >= 0 && i + 2 < count && k[i + 1].time <= time && k[i + 2].time > time) {
+			i++;
+		} else {
+			int lo = 0, hi = count - 1;
+			while (hi - lo > 1) {
+				int mid = (lo + hi) / 2;
+				if (k[mid].time <= time) {
+					lo = mid;
+				} else {
+					hi = mid;
+				}
+			}
+			i = lo;
+		}
+		track->hint = i;
+	}
+
+	double length = k[i + 1].time - k[i].time;
+	double pos = (length > 0.0) ? ((time - k[i].time) / length) : 1.0;
+	return k[i].value + (k[i + 1].value - k[i].value) * Interpolate(pos, k[i + 1].style);
+}
+
+SYMBOL_EXPORT void ApplyKeyframeAnimation(struct Game* game, struct KeyframeAnimation* animation, struct Character* character, double time) {
+	struct KeyframeTrack* tracks = animation->tracks;
+
+	if (tracks[KEYFRAME_X].count) {
+		character->x = EvaluateKeyframeTrack(&tracks[KEYFRAME_X], time);
+	}
+	if (tracks[KEYFRAME_Y].count) {
+		character->y = EvaluateKeyframeTrack(&tracks[KEYFRAME_Y], time);
+	}
+	if (tracks[KEYFRAME_SCALE_X].count) {
+		character->scaleX = EvaluateKeyframeTrack(&tracks[KEYFRAME_SCALE_X], time);
+	}
+	if (tracks[KEYFRAME_SCALE_Y].count) {
+		character->scaleY = EvaluateKeyframeTrack(&tracks[KEYFRAME_SCALE_Y], time);
+	}
+	if (tracks[KEYFRAME_ANGLE].count) {
+		character->angle = EvaluateKeyframeTrack(&tracks[KEYFRAME_ANGLE], time);
+	}
+	if (tracks[KEYFRAME_TINT_R].count || tracks[KEYFRAME_TINT_G].count || tracks[KEYFRAME_TINT_B].count || tracks[KEYFRAME_TINT_A].count) {
+		// channels without their own track stay at full intensity
+		float c[4];
+		for (int i = 0; i < 4; i++) {
+			struct KeyframeTrack* track = &tracks[KEYFRAME_TINT_R + i];
+			c[i] = track->count ? EvaluateKeyframeTrack(track, time) : 1.0;
+		}
+		character->tint = al_premul_rgba_f(c[0], c[1], c[2], c[3]);
+	}
+	UpdateCharacterSpatialIndex(game, character);
+}
+
+SYMBOL_EXPORT void PlayCharacterKeyframes(struct Game* game, struct Character* character, struct KeyframeAnimation* animation) {
+	character->keyframes.animation = animation;
+	character->keyframes.pos = 0.0;
+	character->keyframes.finished = false;
+	if (animation) {
+		ApplyKeyframeAnimation(game, animation, character, 0.0);
+	}
+}
+
+SYMBOL_EXPORT void StopCharacterKeyframes(struct Game* game, struct Character* character) {
+	character->keyframes.animation = NULL;
+	character->keyframes.pos = 0.0;
+	character->keyframes.finished = false;
+}
+
+SYMBOL_INTERNAL void AnimateCharacterKeyframes(struct Game* game, struct Character* character, double delta) {
+	struct KeyframeAnimation* animation = character->keyframes.animation;
+	if (!animation || character->keyframes.finished) {
+		return;
+	}
+
+	character->keyframes.pos += delta;
+	if (character->keyframes.pos >= animation->duration) {
+		if (animation->loop && animation->duration > 0.0) {
+			character->keyframes.pos = fmod(character->keyframes.pos, animation->duration);
+		} else {
+			character->keyframes.pos = animation->duration;
+			character->keyframes.finished = true;
+		}
+	}
+	ApplyKeyframeAnimation(game, animation, character, character->keyframes.pos);
+}
+
+// Each property has its own section with "time=value [style]" entries, e.g. [x] 1.5=300 cubic_out;
+// optional [keyframes] section holds duration and loop.
+static struct KeyframeAnimation* LoadKeyframeAnimationFromConfig(struct Game* game, const char* filename, const char* path) {
+	ALLEGRO_CONFIG* config = al_load_config_file(path);
+	if (!config) {
+		PrintConsole(game, "Could not load keyframes from %s!", filename);
+		return NULL;
+	}
+
+	struct KeyframeAnimation* animation = CreateKeyframeAnimation(game, filename);
+	for (int i = 0; i < KEYFRAME_PROPERTY_COUNT; i++) {
+		ALLEGRO_CONFIG_ENTRY* entry = NULL;
+		const char* key = al_get_first_config_entry(config, PROPERTY_NAMES[i], &entry);
+		while (key) {
+			const char* val = al_get_config_value(config, PROPERTY_NAMES[i], key);
+			char* end = NULL;
+			float value = strtod(val, &end);
+			AddKeyframe(game, animation, i, strtod(key, NULL), value, ParseTweenStyle(game, end));
+			key = al_get_next_config_entry(&entry);
+		}
+	}
+
+	const char* duration = al_get_config_value(config, "keyframes", "duration");
+	if (duration) {
+		animation->duration = strtod(duration, NULL);
+	}
+	const char* loop = al_get_config_value(config, "keyframes", "loop");
+	if (loop) {
+		animation->loop = strtol(loop, NULL, 10);
+	}
+
+	al_destroy_config(config);
+	return animation;
+}
+
+static float ReadFloat(ALLEGRO_FILE* file) {
+	int32_t raw = al_fread32le(file);
+	float value;
+	memcpy(&value, &raw, sizeof(float));
+	return value;
+}
+
+static void WriteFloat(ALLEGRO_FILE* file, float value) {
+	int32_t raw;
+	memcpy(&raw, &value, sizeof(float));
+	al_fwrite32le(file, raw);
+}
+
+static struct KeyframeAnimation* LoadKeyframeAnimationFromBinary(struct Game* game, const char* filename, const char* path) {
+	ALLEGRO_FILE* file = al_fopen(path, "rb");
+	if (!file) {
+		PrintConsole(game, "Could not load keyframes from %s!", filename);
+		return NULL;
+	}
+
+	char magic[4];
+	if (al_fread(file, magic, 4) != 4 || memcmp(magic, KEYFRAMES_MAGIC, 4) != 0 || al_fread32le(file) != KEYFRAMES_VERSION) {
+		PrintConsole(game, "%s is not a valid keyframes file!", filename);
+		al_fclose(file);
+		return NULL;
+	}
+
+	struct KeyframeAnimation* animation = CreateKeyframeAnimation(game, filename);
+	animation->duration = ReadFloat(file);
+	animation->loop = al_fread32le(file);
+	int tracks = al_fread32le(file);
+	for (int i = 0; i < tracks && !al_feof(file); i++) {
+		int property = al_fread32le(file);
+		int count = al_fread32le(file);
+		if (property < 0 || property >= KEYFRAME_PROPERTY_COUNT || count < 0) {
+			PrintConsole(game, "%s: invalid keyframe track %d!", filename, i);
+			break;
+		}
+		for (int j = 0; j < count && !al_feof(file); j++) {
+			float time = ReadFloat(file);
+			float value = ReadFloat(file);
+			int style = al_fread32le(file);
+			if (style < 0 || style >= TWEEN_STYLE_CUSTOM) {
+				style = TWEEN_STYLE_LINEAR;
+			}
+			AddKeyframe(game, animation, property, time, value, style);
+		}
+	}
+
+	al_fclose(file);
+	return animation;
+}
+
+SYMBOL_EXPORT struct KeyframeAnimation* LoadKeyframeAnimation(struct Game* game, const char* filename) {
+	PrintConsole(game, "Loading keyframes: %s", filename);
+	const char* path = GetDataFilePath(game, filename);
+	const char* ext = strrchr(filename, '.');
+	if (ext && !strcmp(ext, ".ini")) {
+		return LoadKeyframeAnimationFromConfig(game, filename, path);
+	}
+	return LoadKeyframeAnimationFromBinary(game, filename, path);
+}
+
+SYMBOL_EXPORT bool SaveKeyframeAnimation(struct Game* game, struct KeyframeAnimation* animation, const char* path) {
+	ALLEGRO_FILE* file = al_fopen(path, "wb");
+	if (!file) {
+		PrintConsole(game, "Could not open %s for writing!", path);
+		return false;
+	}
+
+	int tracks = 0;
+	for (int i = 0; i < KEYFRAME_PROPERTY_COUNT; i++) {
+		if (animation->tracks[i].count) {
+			tracks++;
+		}
+	}
+
+	al_fwrite(file, KEYFRAMES_MAGIC, 4);
+	al_fwrite32le(file, KEYFRAMES_VERSION);
+	WriteFloat(file, animation->duration);
+	al_fwrite32le(file, animation->loop);
+	al_fwrite32le(file, tracks);
+	for (int i = 0; i < KEYFRAME_PROPERTY_COUNT; i++) {
+		struct KeyframeTrack* track = &animation->tracks[i];
+		if (!track->count) {
+			continue;
+		}
+		al_fwrite32le(file, i);
+		al_fwrite32le(file, track->count);
+		for (int j = 0; j < track->count; j++) {
+			WriteFloat(file, track->keyframes[j].time);
+			WriteFloat(file, track->keyframes[j].value);
+			al_fwrite32le(file, track->keyframes[j].style);
+		}
+	}
+
+	bool success = !al_ferror(file);
+	al_fclose(file);
+	return success;
+}
@@ -0,0 +1,79 @@
+/*! \file keyframes.h
+ *  \brief Keyframe animation curves for character properties.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This file is part of libsuperderpy.
+ *
+ * libsuperderpy is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libsuperderpy is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libsuperderpy. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Also, ponies.
+ */
+
+#ifndef LIBSUPERDERPY_KEYFRAMES_H
+#define LIBSUPERDERPY_KEYFRAMES_H
+
+#include "libsuperderpy.h"
+#include "tween.h"
+
+/*! \brief Character properties that can be driven by a keyframe track. */
+typedef enum KEYFRAME_PROPERTY {
+	KEYFRAME_X,
+	KEYFRAME_Y,
+	KEYFRAME_SCALE_X,
+	KEYFRAME_SCALE_Y,
+	KEYFRAME_ANGLE,
+	KEYFRAME_TINT_R,
+	KEYFRAME_TINT_G,
+	KEYFRAME_TINT_B,
+	KEYFRAME_TINT_A,
+	KEYFRAME_PROPERTY_COUNT
+} KEYFRAME_PROPERTY;
+
+struct Keyframe {
+	double time; /*!< Position of the keyframe on the timeline, in seconds. */
+	float value; /*!< Value of the property at this keyframe. */
+	TWEEN_STYLE style; /*!< Easing used when interpolating towards this keyframe. */
+};
+
+/*! \brief Sorted list of keyframes for a single property. */
+struct KeyframeTrack {
+	struct Keyframe* keyframes; /*!< Keyframes sorted by time. */
+	int count;
+	int size;
+	int hint; /*!< Segment found by the last lookup; checked first on the next one. */
+};
+
+/*! \brief Set of keyframe tracks that can be played on characters. */
+struct KeyframeAnimation {
+	char* name;
+	struct KeyframeTrack tracks[KEYFRAME_PROPERTY_COUNT];
+	double duration; /*!< Length of the animation in seconds. */
+	bool loop; /*!< Whether the animation starts over after reaching its end. */
+};
+
+struct KeyframeAnimation* CreateKeyframeAnimation(struct Game* game, const char* name);
+struct KeyframeAnimation* LoadKeyframeAnimation(struct Game* game, const char* filename);
+bool SaveKeyframeAnimation(struct Game* game, struct KeyframeAnimation* animation, const char* path);
+void DestroyKeyframeAnimation(struct Game* game, struct KeyframeAnimation* animation);
+
+void AddKeyframe(struct Game* game, struct KeyframeAnimation* animation, KEYFRAME_PROPERTY property, double time, float value, TWEEN_STYLE style);
+float EvaluateKeyframeTrack(struct KeyframeTrack* track, double time);
+void ApplyKeyframeAnimation(struct Game* game, struct KeyframeAnimation* animation, struct Character* character, double time);
+
+void PlayCharacterKeyframes(struct Game* game, struct Character* character, struct KeyframeAnimation* animation);
+void StopCharacterKeyframes(struct Game* game, struct Character* character);
+
+#endif /* LIBSUPERDERPY_KEYFRAMES_H */
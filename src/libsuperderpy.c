@@ -75,6 +75,20 @@ SYMBOL_EXPORT struct Game* libsuperderpy_init(int argc, char** argv, const char*
 	chdir(dirname(exe_path));
 #endif
 
+	// headless mode has to be known before Allegro gets initialized
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--headless") == 0) {
+			game->_priv.params.headless = true;
+		}
+	}
+
+#if defined(ALLEGRO_SDL) && !defined(ALLEGRO_WINDOWS)
+	if (game->_priv.params.headless) {
+		// SDL can render without any window system at all
+		setenv("SDL_VIDEODRIVER", "offscreen", false);
+	}
+#endif
+
 	if (!al_init()) {
 		fprintf(stderr, "failed to initialize allegro!\n");
 		free(game);
@@ -99,12 +113,14 @@ SYMBOL_EXPORT struct Game* libsuperderpy_init(int argc, char** argv, const char*
 	game->_priv.garbage = NULL;
 	game->_priv.timelines = NULL;
 	game->_priv.shaders = NULL;
+	game->_priv.spritesheet_library = NULL;
 	game->_priv.gamestates = NULL;
 
 	game->_priv.paused = false;
 	game->_priv.started = false;
 
-	game->_priv.texture_sync = false;
+	game->_priv.texture_sync_waiting = 0;
+	game->_priv.texture_sync_generation = 0;
 	game->_priv.texture_sync_cond = al_create_cond();
 	game->_priv.texture_sync_mutex = al_create_mutex();
 
@@ -124,6 +140,7 @@ SYMBOL_EXPORT struct Game* libsuperderpy_init(int argc, char** argv, const char*
 	game->_priv.bg.a = 1.0;
 
 	game->_priv.mutex = al_create_mutex();
+	game->_priv.cache_mutex = al_create_mutex_recursive();
 
 	game->config.fullscreen = strtol(GetConfigOptionDefault(game, "SuperDerpy", "fullscreen", IS_POCKETCHIP ? "0" : "1"), NULL, 10);
 	game->config.music = strtol(GetConfigOptionDefault(game, "SuperDerpy", "music", "10"), NULL, 10);
@@ -136,6 +153,8 @@ SYMBOL_EXPORT struct Game* libsuperderpy_init(int argc, char** argv, const char*
 	game->config.height = strtol(GetConfigOptionDefault(game, "SuperDerpy", "height", GetDefaultWindowHeight(game)), NULL, 10);
 	if (game->config.height < 100) { game->config.height = 100; }
 	game->config.autopause = strtol(GetConfigOptionDefault(game, "SuperDerpy", "autopause", "1"), NULL, 10);
+	game->config.shader_compile_budget = strtod(GetConfigOptionDefault(game, "SuperDerpy", "shaderCompileBudget", "0"), NULL) / 1000.0;
+	game->config.preload_budget = strtod(GetConfigOptionDefault(game, "SuperDerpy", "preloadBudget", "2"), NULL) / 1000.0;
 
 	game->config.debug.enabled = strtol(GetConfigOptionDefault(game, "SuperDerpy", "debug", "0"), NULL, 10);
 	game->config.debug.verbose = strtol(GetConfigOptionDefault(game, "debug", "verbose", "0"), NULL, 10);
@@ -154,12 +173,16 @@ SYMBOL_EXPORT struct Game* libsuperderpy_init(int argc, char** argv, const char*
 			{"debug", no_argument, NULL, 'd'},
 			{"fullscreen", no_argument, NULL, 'f'},
 			{"windowed", no_argument, NULL, 'w'},
+			{"record", required_argument, NULL, 'r'},
+			{"replay", required_argument, NULL, 'p'},
+			{"headless", no_argument, NULL, 'H'},
+			{"frames", required_argument, NULL, 'n'},
 			{NULL, 0, NULL, 0},
 		};
 
 	optind = 1;
 	int opt = 0;
-	while ((opt = getopt_long(argc, argv, "dfw", long_options, NULL)) != -1) {
+	while ((opt = getopt_long(argc, argv, "dfwr:p:n:", long_options, NULL)) != -1) {
 		switch (opt) {
 			case 'd':
 				game->config.debug.enabled = true;
@@ -174,10 +197,34 @@ SYMBOL_EXPORT struct Game* libsuperderpy_init(int argc, char** argv, const char*
 					game->config.fullscreen = false;
 				}
 				break;
+			case 'r':
+				if (!game->_priv.replay) {
+					StartRecording(game, optarg);
+				}
+				break;
+			case 'p':
+				if (!game->_priv.replay && StartReplay(game, optarg)) {
+					// replay has to run uninterrupted
+					game->config.autopause = false;
+				}
+				break;
+			case 'H':
+				// already handled before initialization
+				break;
+			case 'n':
+				game->_priv.frame_stats.limit = strtol(optarg, NULL, 10);
+				game->_priv.frame_stats.enabled = true;
+				break;
 		}
 	}
 	optind = 1;
 
+	if (game->_priv.params.headless) {
+		game->config.fullscreen = false;
+		game->config.autopause = false;
+		game->_priv.frame_stats.enabled = true;
+	}
+
 	game->show_console = game->config.debug.enabled;
 	game->_priv.show_timeline = false;
 
@@ -188,7 +235,8 @@ SYMBOL_EXPORT struct Game* libsuperderpy_init(int argc, char** argv, const char*
 		return NULL;
 	}
 
-	if (!al_install_audio()) {
+	// build servers may have no sound card at all
+	if (!game->_priv.params.headless && !al_install_audio()) {
 		fprintf(stderr, "failed to initialize audio!\n");
 		return NULL;
 	}
@@ -237,10 +285,14 @@ SYMBOL_EXPORT struct Game* libsuperderpy_init(int argc, char** argv, const char*
 
 	game->input.available.joystick = false;
 
-	if (!strtol(GetConfigOptionDefault(game, "SuperDerpy", "disableJoystick", "0"), NULL, 10)) {
+	if (!game->_priv.params.headless && !strtol(GetConfigOptionDefault(game, "SuperDerpy", "disableJoystick", "0"), NULL, 10)) {
 		game->input.available.joystick = al_install_joystick();
 	}
 
+	if (params.input_snapshot) {
+		game->_priv.input = calloc(1, sizeof(struct InputState));
+	}
+
 #ifdef ALLEGRO_ANDROID
 	int windowMode = ALLEGRO_FULLSCREEN_WINDOW | ALLEGRO_FRAMELESS;
 #elif defined(__EMSCRIPTEN__)
@@ -252,12 +304,16 @@ SYMBOL_EXPORT struct Game* libsuperderpy_init(int argc, char** argv, const char*
 	if (!game->config.fullscreen) {
 		windowMode = ALLEGRO_WINDOWED;
 	}
-	if (!params.fixed_size) {
+	if (!params.fixed_size && !game->_priv.params.headless) {
 		windowMode |= ALLEGRO_RESIZABLE;
 	}
+	if (game->_priv.params.headless) {
+		windowMode |= ALLEGRO_FRAMELESS;
+	}
 
 	al_set_new_display_flags(windowMode | ALLEGRO_OPENGL | ALLEGRO_PROGRAMMABLE_PIPELINE | ALLEGRO_GENERATE_EXPOSE_EVENTS);
-	al_set_new_display_option(ALLEGRO_VSYNC, 2 - strtol(GetConfigOptionDefault(game, "SuperDerpy", "vsync", "1"), NULL, 10), ALLEGRO_SUGGEST);
+	// frames shouldn't wait for the display when measuring how long they take
+	al_set_new_display_option(ALLEGRO_VSYNC, game->_priv.params.headless ? 2 : (2 - strtol(GetConfigOptionDefault(game, "SuperDerpy", "vsync", "1"), NULL, 10)), ALLEGRO_SUGGEST);
 
 #ifdef LIBSUPERDERPY_ORIENTATION_LANDSCAPE
 	al_set_new_display_option(ALLEGRO_SUPPORTED_ORIENTATIONS, ALLEGRO_DISPLAY_ORIENTATION_LANDSCAPE, ALLEGRO_SUGGEST);
@@ -449,6 +505,7 @@ SYMBOL_EXPORT int libsuperderpy_start(struct Game* game) {
 		struct Gamestate* tmp = game->_priv.gamestates;
 #ifdef LIBSUPERDERPY_STATIC_GAMESTATES
 		if (tmp && strcmp(tmp->name, "loading") == 0) {
+			RemoveGamestateFromMap(game, tmp);
 			game->_priv.gamestates = tmp->next;
 			game->_priv.loading.gamestate = tmp;
 			tmp = game->_priv.gamestates;
@@ -461,6 +518,7 @@ SYMBOL_EXPORT int libsuperderpy_start(struct Game* game) {
 			}
 #ifdef LIBSUPERDERPY_STATIC_GAMESTATES
 			if (tmp->next && strcmp(tmp->next->name, "loading") == 0) {
+				RemoveGamestateFromMap(game, tmp->next);
 				game->_priv.loading.gamestate = tmp->next;
 				tmp->next = tmp->next->next;
 			}
@@ -473,11 +531,7 @@ SYMBOL_EXPORT int libsuperderpy_start(struct Game* game) {
 		game->_priv.loading.gamestate = AllocateGamestate(game, "loading");
 	}
 	if (OpenGamestate(game, game->_priv.loading.gamestate, false) && LinkGamestate(game, game->_priv.loading.gamestate)) {
-		if (game->_priv.params.handlers.compositor) {
-			game->_priv.loading.gamestate->fb = CreateNotPreservedBitmap(game->clip_rect.w, game->clip_rect.h);
-		} else {
-			game->_priv.loading.gamestate->fb = al_create_sub_bitmap(al_get_backbuffer(game->display), game->clip_rect.x, game->clip_rect.y, game->clip_rect.w, game->clip_rect.h);
-		}
+		CreateGamestateFramebuffer(game, game->_priv.loading.gamestate);
 
 		game->_priv.loading.gamestate->data = (*game->_priv.loading.gamestate->api->load)(game, ProgressStub);
 		game->_priv.loading.gamestate->loaded = true;
@@ -559,6 +613,7 @@ SYMBOL_EXPORT void libsuperderpy_destroy(struct Game* game) {
 #endif
 
 	ClearGarbage(game);
+	ProcessPreloading(game, true);
 
 	struct Gamestate *tmp = game->_priv.gamestates, *pom = NULL;
 	while (tmp) {
@@ -567,6 +622,7 @@ SYMBOL_EXPORT void libsuperderpy_destroy(struct Game* game) {
 			game->_priv.current_gamestate = tmp;
 			(*tmp->api->stop)(game, tmp->data);
 			tmp->started = false;
+			DestroyGamestateFramebuffer(game, tmp);
 			PrintConsole(game, "Gamestate \"%s\" stopped successfully.", tmp->name);
 		}
 		if (tmp->loaded) {
@@ -582,14 +638,30 @@ SYMBOL_EXPORT void libsuperderpy_destroy(struct Game* game) {
 		free(tmp);
 		tmp = pom;
 	}
+	game->_priv.gamestates = NULL;
+	memset(game->_priv.gamestates_map, 0, sizeof(game->_priv.gamestates_map));
+	free(game->_priv.dispatch.active);
+	free(game->_priv.dispatch.drawable);
+	// the destroy handler can still end up dispatching or querying input
+	game->_priv.dispatch.active = NULL;
+	game->_priv.dispatch.drawable = NULL;
+	game->_priv.dispatch.active_count = 0;
+	game->_priv.dispatch.drawable_count = 0;
+	game->_priv.dispatch.size = 0;
+	game->_priv.dispatch.dirty = true;
+	free(game->_priv.coalesced.events);
+	game->_priv.coalesced.events = NULL;
+	game->_priv.coalesced.count = 0;
+	game->_priv.coalesced.size = 0;
+	free(game->_priv.input);
+	game->_priv.input = NULL;
+	ReportFrameTimes(game);
+	StopReplay(game);
 
 	if (game->_priv.loading.gamestate->open && game->_priv.loading.gamestate->api) {
 		(*game->_priv.loading.gamestate->api->unload)(game, game->_priv.loading.gamestate->data);
 	}
-	if (game->_priv.loading.gamestate->fb) {
-		al_destroy_bitmap(game->_priv.loading.gamestate->fb);
-		game->_priv.loading.gamestate->fb = NULL;
-	}
+	DestroyGamestateFramebuffer(game, game->_priv.loading.gamestate);
 	CloseGamestate(game, game->_priv.loading.gamestate);
 	free(game->_priv.loading.gamestate->name);
 	free(game->_priv.loading.gamestate);
@@ -598,6 +670,11 @@ SYMBOL_EXPORT void libsuperderpy_destroy(struct Game* game) {
 		(*game->_priv.params.handlers.destroy)(game);
 	}
 	DestroyShaders(game);
+	ClearTextLayouts(game);
+	DestroyTextCache(game);
+	ClearInternedStrings(game);
+	ClearRenderTargets(game);
+	DestroyFileWatcher(game);
 
 	SetBackgroundColor(game, al_map_rgb(0, 0, 0));
 	ClearScreen(game);
@@ -640,6 +717,7 @@ SYMBOL_EXPORT void libsuperderpy_destroy(struct Game* game) {
 	al_destroy_cond(game->_priv.bsod_cond);
 	al_destroy_mutex(game->_priv.bsod_mutex);
 	al_destroy_mutex(game->_priv.mutex);
+	al_destroy_mutex(game->_priv.cache_mutex);
 	al_uninstall_audio();
 	DeinitConfig(game);
 #ifndef __EMSCRIPTEN__ // ???
@@ -76,10 +76,15 @@ struct GamestateResources;
 #include "character.h"
 #include "config.h"
 #include "gamestate.h"
+#include "input.h"
+#include "keyframes.h"
 #include "mainloop.h"
 #include "maths.h"
 #include "particle.h"
 #include "shader.h"
+#include "skeleton.h"
+#include "spatial.h"
+#include "text.h"
 #include "timeline.h"
 #include "tween.h"
 #include "utils.h"
@@ -93,6 +98,9 @@ struct GamestateResources;
 #endif
 
 #define LIBSUPERDERPY_BITMAP_HASHMAP_BUCKETS 16
+#define LIBSUPERDERPY_TEXT_LAYOUT_HASHMAP_BUCKETS 32
+#define LIBSUPERDERPY_INTERNED_STRINGS_HASHMAP_BUCKETS 64
+#define LIBSUPERDERPY_GAMESTATE_HASHMAP_BUCKETS 16
 
 #if !defined(LIBSUPERDERPY_PRIV_ACCESS) && defined(__GNUC__)
 #define LIBSUPERDERPY_DEPRECATED_PRIV __attribute__((deprecated))
@@ -146,10 +154,13 @@ struct Params {
 	bool integer_scaling; /*!< Ensure that the viewport is zoomed only by integer factors. */
 	bool depth_buffer; /*!< Request a depth buffer for the framebuffer's render target. */
 	bool show_loading_on_launch; /*!< Whether the loading screen should be shown when loading the initial set of gamestates. */
+	bool concurrent_loading; /*!< Load gamestates marked to be loaded at the same time in parallel, respecting their dependencies. Their Gamestate_Load functions have to be thread-safe. */
 	bool disable_bg_clear; /*!< If set to true, the gamestate framebuffer won't be cleared to background color before calling Gamestate_Draw. */
 	bool fixed_size; /*!< If set to true, the game's window will not be resizable. */
 	bool no_autopause; /*!< If set to true, engine autopause is forced to be disabled. */
 	bool show_cursor; /*!< If set to true, system cursor won't be hidden in fullscreen. */
+	bool headless; /*!< Run without audio output in a frameless window (or no window at all where supported), reporting frame times on exit. Also enabled with --headless switch. */
+	bool input_snapshot; /*!< Track the state of input devices, so it can be polled with GetInputState and friends. */
 	int samples; /*!< How many samples should be used for multisampling; 0 to disable. */
 	int sample_rate; /*!< Default sample rate of audio output; 0 to use engine default. */
 	char* window_title; /*!< A title of the game's window. When NULL, al_get_app_name() is used. */
@@ -189,6 +200,8 @@ struct Game {
 		int width; /*!< Width of window as being set in configuration. */
 		int height; /*!< Height of window as being set in configuration. */
 		bool autopause; /*!< Pauses/resumes the game when the window loses/gains focus. */
+		double shader_compile_budget; /*!< Time in seconds spent on compiling pending shaders each frame. When 0, they're compiled right after loading. */
+		double preload_budget; /*!< Time in seconds spent on uploading textures of a preloaded gamestate each frame. */
 		struct {
 			bool enabled; /*!< Toggles debug mode. */
 			bool verbose; /*!< Prints file names and line numbers with every message. */
@@ -221,6 +234,33 @@ struct Game {
 		struct Params params;
 
 		struct Gamestate* gamestates; /*!< List of known gamestates. */
+		struct Gamestate* gamestates_map[LIBSUPERDERPY_GAMESTATE_HASHMAP_BUCKETS]; /*!< Known gamestates indexed by name. */
+		struct {
+			struct Gamestate** active; /*!< Started and not paused gamestates, receiving logic and events. */
+			struct Gamestate** drawable; /*!< Started gamestates, including paused ones. */
+			int active_count, drawable_count, size;
+			int events; /*!< Event categories subscribed to by any of the active gamestates. */
+			bool coalesce; /*!< Whether any of the active gamestates wants movement events coalesced. */
+			bool dirty; /*!< Set whenever gamestates get started, stopped, paused or resumed. */
+		} dispatch;
+
+		struct {
+			ALLEGRO_EVENT* events; /*!< Latest movement events of each source, delivered at the end of the frame. */
+			int count, size;
+		} coalesced;
+
+		struct InputState* input; /*!< Input snapshot, allocated only when enabled in Params. */
+
+		struct Replay* replay; /*!< Input recording or replay, set up with --record and --replay switches. */
+
+		struct {
+			double* times;
+			int count, size;
+			double last;
+			int frames; /*!< Number of frames done so far. */
+			int limit; /*!< Number of frames after which the game quits, set with --frames switch. 0 for no limit. */
+			bool enabled;
+		} frame_stats; /*!< Durations of frames, reported on exit. */
 		ALLEGRO_FONT* font_console; /*!< Font used in game console. */
 		ALLEGRO_FONT* font_bsod; /*!< Font used in Blue Screens of Derp. */
 		char console[5][1024];
@@ -234,6 +274,10 @@ struct Game {
 			int frames_done;
 		} fps_count; /*!< Used for counting the effective FPS. */
 
+		struct {
+			int drawn, culled;
+		} sprites; /*!< Number of characters drawn and culled in the current frame. */
+
 		ALLEGRO_CONFIG* config; /*!< Configuration file interface. */
 
 		int argc;
@@ -241,24 +285,37 @@ struct Game {
 
 		struct {
 			struct Gamestate* gamestate;
-			struct Gamestate* current;
-			int progress;
 			int loaded, to_load;
 			volatile bool in_progress;
 			bool lock;
 			double time;
 		} loading;
 
+		struct {
+			struct Gamestate* gamestate; /*!< Gamestate being loaded in background, NULL if none. */
+			struct GamestateLoadingThreadData* data;
+			double credit; /*!< Time left for texture uploads in the current frame. */
+			struct List* bitmaps; /*!< Memory bitmaps loaded by the preloading thread, waiting to be uploaded. */
+			double time;
+		} preload;
+
 		struct Gamestate* current_gamestate;
 
 		struct List *garbage, *timelines, *shaders, *bitmaps[LIBSUPERDERPY_BITMAP_HASHMAP_BUCKETS];
+		struct List* spritesheet_library;
+		struct List* text_layouts[LIBSUPERDERPY_TEXT_LAYOUT_HASHMAP_BUCKETS];
+		struct List* interned_strings[LIBSUPERDERPY_INTERNED_STRINGS_HASHMAP_BUCKETS];
+		struct List* render_targets;
+		struct TextCache* text_cache;
+		struct FileWatcher* watcher;
 
 		double timestamp;
 
 		bool paused;
 		bool started;
 
-		volatile bool texture_sync;
+		int texture_sync_waiting; /*!< Number of loading threads waiting for their bitmaps to be converted. */
+		unsigned int texture_sync_generation;
 		ALLEGRO_MUTEX* texture_sync_mutex;
 		ALLEGRO_COND* texture_sync_cond;
 
@@ -268,6 +325,7 @@ struct Game {
 		ALLEGRO_COND* bsod_cond;
 
 		ALLEGRO_MUTEX* mutex;
+		ALLEGRO_MUTEX* cache_mutex; /*!< Guards bitmap and shader caches, which loading threads share with the main thread. */
 
 		char* name;
 
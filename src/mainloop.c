@@ -224,10 +224,74 @@ static inline void HandleDebugEvent(struct Game* game, ALLEGRO_EVENT* ev) {
 	}
 }
 
+// Returns false when the game should quit.
+static inline bool DispatchEvent(struct Game* game, ALLEGRO_EVENT* ev) {
+	// even when swallowed below, releases have to be seen, or keys and buttons would stay held down
+	UpdateInputState(game, ev);
+
+#ifdef LIBSUPERDERPY_IMGUI
+	ImGui_ImplAllegro5_ProcessEvent(ev);
+	switch (ev->type) {
+		case ALLEGRO_EVENT_KEY_CHAR:
+		case ALLEGRO_EVENT_KEY_DOWN:
+		case ALLEGRO_EVENT_KEY_UP:
+			if (igGetIO()->WantCaptureKeyboard) {
+				return true;
+			}
+			break;
+		case ALLEGRO_EVENT_MOUSE_AXES:
+		case ALLEGRO_EVENT_MOUSE_BUTTON_DOWN:
+		case ALLEGRO_EVENT_MOUSE_BUTTON_UP:
+		case ALLEGRO_EVENT_TOUCH_BEGIN:
+		case ALLEGRO_EVENT_TOUCH_CANCEL:
+		case ALLEGRO_EVENT_TOUCH_END:
+		case ALLEGRO_EVENT_TOUCH_MOVE:
+			if (igGetIO()->WantCaptureMouse) {
+				return true;
+			}
+			break;
+		default:
+			break;
+	}
+#endif
+
+	if (game->_priv.params.handlers.event) {
+		if ((*game->_priv.params.handlers.event)(game, ev)) {
+			return true;
+		}
+	}
+
+	if (HandleEvent(game, ev)) {
+		return true;
+	}
+
+	if (game->config.debug.enabled) {
+		HandleDebugEvent(game, ev);
+	}
+
+	EventGamestates(game, ev);
+
+	if (ev->type == ALLEGRO_EVENT_DISPLAY_CLOSE) {
+		return false;
+	}
+
+	if (ALLEGRO_EVENT_TYPE_IS_USER(ev->type)) {
+		al_unref_user_event(&ev->user);
+	}
+	return true;
+}
+
 static inline bool MainloopEvents(struct Game* game) {
-	do {
-		ALLEGRO_EVENT ev;
+	ALLEGRO_EVENT ev;
+
+	// recorded input goes through the same path as live events, which are ignored during replay
+	while (GetNextReplayedEvent(game, &ev)) {
+		if (!DispatchEvent(game, &ev)) {
+			return false;
+		}
+	}
 
+	do {
 		if (game->_priv.paused && !IS_EMSCRIPTEN) {
 			// there's no frame flipping when paused, so avoid pointless busylooping
 			al_wait_for_event(game->event_queue, &ev);
@@ -235,59 +299,296 @@ static inline bool MainloopEvents(struct Game* game) {
 			break;
 		}
 
-#ifdef LIBSUPERDERPY_IMGUI
-		ImGui_ImplAllegro5_ProcessEvent(&ev);
-		switch (ev.type) {
-			case ALLEGRO_EVENT_KEY_CHAR:
-			case ALLEGRO_EVENT_KEY_DOWN:
-			case ALLEGRO_EVENT_KEY_UP:
-				if (igGetIO()->WantCaptureKeyboard) {
-					continue;
-				}
-				break;
-			case ALLEGRO_EVENT_MOUSE_AXES:
-			case ALLEGRO_EVENT_MOUSE_BUTTON_DOWN:
-			case ALLEGRO_EVENT_MOUSE_BUTTON_UP:
-			case ALLEGRO_EVENT_TOUCH_BEGIN:
-			case ALLEGRO_EVENT_TOUCH_CANCEL:
-			case ALLEGRO_EVENT_TOUCH_END:
-			case ALLEGRO_EVENT_TOUCH_MOVE:
-				if (igGetIO()->WantCaptureMouse) {
-					continue;
-				}
-				break;
-			default:
-				break;
+		if (IsReplacedByReplay(game, &ev)) {
+			continue;
+		}
+		RecordEvent(game, &ev);
+
+		if (!DispatchEvent(game, &ev)) {
+			return false;
 		}
+
+	} while (!al_is_event_queue_empty(game->event_queue));
+
+	DispatchCoalescedEvents(game);
+	return true;
+}
+
+#ifndef LIBSUPERDERPY_SINGLE_THREAD
+// Draws one frame of the loading screen and uploads textures once all given loading threads are waiting for it.
+static bool DrawLoadingFrame(struct Game* game, int threads, bool force) {
+	double delta = al_get_time() - game->_priv.loading.time;
+	game->time += delta; // TODO: ability to disable passing time during loading
+	game->_priv.loading.time += delta;
+	if (game->loading.shown && game->_priv.loading.gamestate->open) {
+		(*game->_priv.loading.gamestate->api->logic)(game, game->_priv.loading.gamestate->data, delta);
+	}
+	DrawGamestates(game);
+	bool synced = SyncTextures(game, threads, force);
+	if (synced) {
+		game->_priv.loading.time = al_get_time(); // TODO: rethink time management during loading
+	}
+	DrawConsole(game);
+	al_flip_display();
+
+	if (game->_priv.bsod_sync) {
+		al_set_target_bitmap(NULL);
+		game->_priv.bsod_sync = false;
+		al_signal_cond(game->_priv.bsod_cond);
+	}
+
+	al_lock_mutex(game->_priv.bsod_mutex);
+	while (game->_priv.in_bsod) {
+		al_wait_cond(game->_priv.bsod_cond, game->_priv.bsod_mutex);
+	}
+	al_unlock_mutex(game->_priv.bsod_mutex);
+	return synced;
+}
 #endif
 
-		if (game->_priv.params.handlers.event) {
-			if ((*game->_priv.params.handlers.event)(game, &ev)) {
-				continue;
-			}
+static bool AreDependenciesLoaded(struct Game* game, struct Gamestate* gamestate) {
+	if (!gamestate->api->dependencies) {
+		return true;
+	}
+	for (const char** name = gamestate->api->dependencies; *name; name++) {
+		struct Gamestate* dependency = GetGamestate(game, *name);
+		if (dependency && dependency != gamestate && dependency->pending_load) {
+			return false;
 		}
+	}
+	return true;
+}
 
-		if (HandleEvent(game, &ev)) {
+// Opens the gamestate and marks its dependencies to be loaded as well.
+static void PrepareGamestate(struct Game* game, struct Gamestate* gamestate) {
+	if (!gamestate->open) {
+		if (!OpenGamestate(game, gamestate, true) || !LinkGamestate(game, gamestate)) {
+			gamestate->pending_load = false;
+			gamestate->pending_start = false;
+			return;
+		}
+	}
+	if (!gamestate->api) {
+		gamestate->pending_load = false;
+		return;
+	}
+	gamestate->pending_preload = false;
+	gamestate->progress = 0;
+	if (!gamestate->api->dependencies) {
+		return;
+	}
+	for (const char** name = gamestate->api->dependencies; *name; name++) {
+		struct Gamestate* dependency = GetGamestate(game, *name);
+		if (dependency && (dependency->pending_load || (dependency->loaded && !dependency->pending_unload))) {
 			continue;
 		}
+		PrintConsole(game, "Gamestate \"%s\" depends on \"%s\", loading it as well.", gamestate->name, *name);
+		LoadGamestate(game, *name);
+		dependency = GetGamestate(game, *name);
+		dependency->show_loading = gamestate->show_loading;
+		PrepareGamestate(game, dependency);
+	}
+}
 
-		if (game->config.debug.enabled) {
-			HandleDebugEvent(game, &ev);
+static struct Gamestate* GetNextGamestateToLoad(struct Game* game) {
+	struct Gamestate* first = NULL;
+	for (struct Gamestate* tmp = game->_priv.gamestates; tmp; tmp = tmp->next) {
+		if (!tmp->pending_load) {
+			continue;
+		}
+		if (AreDependenciesLoaded(game, tmp)) {
+			return tmp;
+		}
+		if (!first) {
+			first = tmp;
 		}
+	}
+	if (first) {
+		PrintConsole(game, "WARNING: Circular dependency detected while loading gamestate \"%s\"!", first->name);
+	}
+	return first;
+}
 
-		EventGamestates(game, &ev);
+static void FinishGamestateLoading(struct Game* game, struct Gamestate* gamestate, double time) {
+	ReloadShaders(game, false);
 
-		if (ev.type == ALLEGRO_EVENT_DISPLAY_CLOSE) {
-			return false;
+	game->_priv.current_gamestate = gamestate;
+	if (gamestate->api->post_load) {
+		PrintConsole(game, "[%s] Post-loading...", gamestate->name);
+		gamestate->api->post_load(game, gamestate->data);
+	}
+
+	gamestate->progress++;
+	CalculateProgress(game, gamestate);
+	PrintConsole(game, "Gamestate \"%s\" loaded successfully in %f seconds.", gamestate->name, al_get_time() - time);
+	gamestate->loaded = true;
+	gamestate->pending_load = false;
+	game->_priv.loading.loaded++;
+
+	DrawGamestates(game);
+	DrawConsole(game);
+	al_flip_display();
+#ifdef __EMSCRIPTEN__
+	emscripten_sleep(0);
+#endif
+}
+
+static void LoadSingleGamestate(struct Game* game, struct Gamestate* tmp) {
+#ifdef __EMSCRIPTEN__
+	StopAudio(game);
+#endif
+#ifdef __vita__
+	int vita_arm_freq = scePowerGetArmClockFrequency();
+	int vita_bus_freq = scePowerGetBusClockFrequency();
+	scePowerSetArmClockFrequency(444);
+	scePowerSetBusClockFrequency(222);
+#endif
+	if (tmp->show_loading && game->_priv.loading.gamestate->open) {
+		(*game->_priv.loading.gamestate->api->start)(game, game->_priv.loading.gamestate->data);
+	}
+
+	PrintConsole(game, "Loading gamestate \"%s\"...", tmp->name);
+	game->_priv.current_gamestate = tmp;
+
+	struct GamestateLoadingThreadData data = {.game = game, .gamestate = tmp};
+	al_store_state(&data.state, ALLEGRO_STATE_NEW_FILE_INTERFACE | ALLEGRO_STATE_NEW_BITMAP_PARAMETERS | ALLEGRO_STATE_BLENDER);
+	game->_priv.loading.in_progress = true;
+	double time = al_get_time();
+	game->_priv.loading.time = time;
+
+	CalculateProgress(game, tmp);
+	if (tmp->show_loading) {
+		game->loading.shown = true;
+		DrawGamestates(game);
+		DrawConsole(game);
+		al_flip_display();
+#ifdef __EMSCRIPTEN__
+		emscripten_sleep(0);
+#endif
+	}
+#ifndef LIBSUPERDERPY_SINGLE_THREAD
+	al_run_detached_thread(GamestateLoadingThread, &data);
+	while (!data.done) {
+		DrawLoadingFrame(game, 1, false);
+	}
+#else
+	GamestateLoadingThread(&data);
+	DrawGamestates(game);
+	DrawConsole(game);
+	al_flip_display();
+#ifdef __EMSCRIPTEN__
+	emscripten_sleep(0);
+#endif
+#endif
+	game->_priv.loading.in_progress = false;
+	al_convert_memory_bitmaps();
+
+	al_restore_state(&data.state);
+
+	FinishGamestateLoading(game, tmp, time);
+
+	if (tmp->show_loading && game->_priv.loading.gamestate->open) {
+		(*game->_priv.loading.gamestate->api->stop)(game, game->_priv.loading.gamestate->data);
+	}
+	tmp->show_loading = true;
+	game->loading.shown = false;
+	game->_priv.timestamp = al_get_time();
+#ifdef __EMSCRIPTEN__
+	SetupAudio(game);
+#endif
+#ifdef __vita__
+	scePowerSetArmClockFrequency(vita_arm_freq);
+	scePowerSetBusClockFrequency(vita_bus_freq);
+#endif
+}
+
+#ifndef LIBSUPERDERPY_SINGLE_THREAD
+static bool IsGamestateLoading(struct GamestateLoadingThreadData* threads, int count, struct Gamestate* gamestate) {
+	for (int i = 0; i < count; i++) {
+		if (threads[i].gamestate == gamestate) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static void StartLoadingThread(struct Game* game, struct GamestateLoadingThreadData* data, struct Gamestate* gamestate) {
+	PrintConsole(game, "Loading gamestate \"%s\"...", gamestate->name);
+	data->game = game;
+	data->gamestate = gamestate;
+	al_store_state(&data->state, ALLEGRO_STATE_NEW_FILE_INTERFACE | ALLEGRO_STATE_NEW_BITMAP_PARAMETERS | ALLEGRO_STATE_BLENDER);
+	al_run_detached_thread(GamestateLoadingThread, data);
+}
+
+// Loads all pending gamestates at once, each on its own thread, as soon as their dependencies are loaded.
+static void LoadGamestatesConcurrently(struct Game* game) {
+	int count = game->_priv.loading.to_load;
+	struct GamestateLoadingThreadData* threads = calloc(count, sizeof(struct GamestateLoadingThreadData));
+
+	bool show_loading = false;
+	for (struct Gamestate* tmp = game->_priv.gamestates; tmp; tmp = tmp->next) {
+		if (tmp->pending_load) {
+			show_loading |= tmp->show_loading;
+		}
+	}
+	if (show_loading && game->_priv.loading.gamestate->open) {
+		(*game->_priv.loading.gamestate->api->start)(game, game->_priv.loading.gamestate->data);
+	}
+	game->loading.shown = show_loading;
+
+	double time = al_get_time();
+	game->_priv.loading.time = time;
+	game->_priv.loading.in_progress = true;
+
+	int started = 0, running = 0;
+	while (game->_priv.loading.loaded < count) {
+		for (struct Gamestate* tmp = game->_priv.gamestates; tmp; tmp = tmp->next) {
+			if (tmp->pending_load && !IsGamestateLoading(threads, started, tmp) && AreDependenciesLoaded(game, tmp)) {
+				StartLoadingThread(game, &threads[started++], tmp);
+				running++;
+			}
+		}
+		if (!running) {
+			struct Gamestate* tmp = game->_priv.gamestates;
+			while (!tmp->pending_load || IsGamestateLoading(threads, started, tmp)) {
+				tmp = tmp->next;
+			}
+			PrintConsole(game, "WARNING: Circular dependency detected while loading gamestate \"%s\"!", tmp->name);
+			StartLoadingThread(game, &threads[started++], tmp);
+			running++;
 		}
 
-		if (ALLEGRO_EVENT_TYPE_IS_USER(ev.type)) {
-			al_unref_user_event(&ev.user);
+		// memory bitmaps are converted only when no thread is working with them, so finished threads have to wait for it as well
+		int busy = 0;
+		bool finishing = false;
+		for (int i = 0; i < started; i++) {
+			threads[i].finishing = threads[i].done && threads[i].gamestate->pending_load;
+			finishing |= threads[i].finishing;
+			busy += !threads[i].done;
 		}
+		if (DrawLoadingFrame(game, busy, finishing) && finishing) {
+			for (int i = 0; i < started; i++) {
+				if (threads[i].finishing) {
+					al_restore_state(&threads[i].state);
+					FinishGamestateLoading(game, threads[i].gamestate, time);
+					running--;
+				}
+			}
+		}
+	}
+	game->_priv.loading.in_progress = false;
 
-	} while (!al_is_event_queue_empty(game->event_queue));
-	return true;
+	if (show_loading && game->_priv.loading.gamestate->open) {
+		(*game->_priv.loading.gamestate->api->stop)(game, game->_priv.loading.gamestate->data);
+	}
+	for (int i = 0; i < started; i++) {
+		threads[i].gamestate->show_loading = true;
+	}
+	free(threads);
+	game->loading.shown = false;
+	game->_priv.timestamp = al_get_time();
 }
+#endif
 
 static inline bool MainloopTick(struct Game* game) {
 	if (game->_priv.paused) {
@@ -305,7 +606,16 @@ static inline bool MainloopTick(struct Game* game) {
 	game->_priv.loading.lock = true;
 	game->loading.progress = 0;
 
-	// TODO: support gamestate dependences/ordering
+	if (game->_priv.preload.gamestate) {
+		bool wait = false;
+		for (tmp = game->_priv.gamestates; tmp; tmp = tmp->next) {
+			wait |= tmp->pending_load || tmp->pending_unload;
+		}
+		// loading in foreground while preloading isn't supported, so make sure it's finished first
+		ProcessPreloading(game, wait);
+		tmp = game->_priv.gamestates;
+	}
+
 	while (tmp) {
 		if (tmp->pending_stop) {
 			PrintConsole(game, "Stopping gamestate \"%s\"...", tmp->name);
@@ -313,12 +623,10 @@ static inline bool MainloopTick(struct Game* game) {
 			(*tmp->api->stop)(game, tmp->data);
 			tmp->started = false;
 			tmp->pending_stop = false;
-			al_destroy_bitmap(tmp->fb);
-			tmp->fb = NULL;
+			InvalidateGamestateDispatch(game);
+			DestroyGamestateFramebuffer(game, tmp);
 			PrintConsole(game, "Gamestate \"%s\" stopped successfully.", tmp->name);
 		}
-
-		if (tmp->pending_load) { game->_priv.loading.to_load++; }
 		tmp = tmp->next;
 	}
 
@@ -332,139 +640,38 @@ static inline bool MainloopTick(struct Game* game) {
 			PrintConsole(game, "Unloading gamestate \"%s\"...", tmp->name);
 			tmp->loaded = false;
 			tmp->pending_unload = false;
+			InvalidateGamestateDispatch(game);
 			game->_priv.current_gamestate = tmp;
 			(*tmp->api->unload)(game, tmp->data);
+			// fonts used as cache keys could have been destroyed
+			ClearTextLayouts(game);
+			ClearTextCache(game);
 			PrintConsole(game, "Gamestate \"%s\" unloaded successfully.", tmp->name);
 #ifdef __EMSCRIPTEN__
 			SetupAudio(game);
 #endif
 		}
+		tmp = tmp->next;
+	}
+
+	for (tmp = game->_priv.gamestates; tmp; tmp = tmp->next) {
 		if (tmp->pending_load) {
-#ifdef __EMSCRIPTEN__
-			StopAudio(game);
-#endif
-#ifdef __vita__
-			int vita_arm_freq = scePowerGetArmClockFrequency();
-			int vita_bus_freq = scePowerGetBusClockFrequency();
-			scePowerSetArmClockFrequency(444);
-			scePowerSetBusClockFrequency(222);
-#endif
-			if (tmp->show_loading && game->_priv.loading.gamestate->open) {
-				(*game->_priv.loading.gamestate->api->start)(game, game->_priv.loading.gamestate->data);
-			}
+			PrepareGamestate(game, tmp);
+		}
+	}
+	for (tmp = game->_priv.gamestates; tmp; tmp = tmp->next) {
+		if (tmp->pending_load) {
+			game->_priv.loading.to_load++;
+		}
+	}
 
-			if (!tmp->open) {
-				if (!OpenGamestate(game, tmp, true) || !LinkGamestate(game, tmp)) {
-					tmp->pending_load = false;
-					tmp->pending_start = false;
-					continue;
-				}
-			}
-			if (tmp->api) {
-				PrintConsole(game, "Loading gamestate \"%s\"...", tmp->name);
-				game->_priv.loading.progress = 0;
-
-				game->_priv.loading.current = tmp;
-				game->_priv.current_gamestate = tmp;
-
-				struct GamestateLoadingThreadData data = {.game = game, .gamestate = tmp};
-				al_store_state(&data.state, ALLEGRO_STATE_NEW_FILE_INTERFACE | ALLEGRO_STATE_NEW_BITMAP_PARAMETERS | ALLEGRO_STATE_BLENDER);
-				game->_priv.loading.in_progress = true;
-				double time = al_get_time();
-				game->_priv.loading.time = time;
-
-				CalculateProgress(game);
-				if (tmp->show_loading) {
-					game->loading.shown = true;
-					DrawGamestates(game);
-					DrawConsole(game);
-					al_flip_display();
-#ifdef __EMSCRIPTEN__
-					emscripten_sleep(0);
-#endif
-				}
 #ifndef LIBSUPERDERPY_SINGLE_THREAD
-				al_run_detached_thread(GamestateLoadingThread, &data);
-				while (game->_priv.loading.in_progress) {
-					double delta = al_get_time() - game->_priv.loading.time;
-					game->time += delta; // TODO: ability to disable passing time during loading
-					game->_priv.loading.time += delta;
-					if (game->loading.shown && game->_priv.loading.gamestate->open) {
-						(*game->_priv.loading.gamestate->api->logic)(game, game->_priv.loading.gamestate->data, delta);
-					}
-					DrawGamestates(game);
-					if (game->_priv.texture_sync) {
-						al_convert_memory_bitmaps();
-						game->_priv.texture_sync = false;
-						al_signal_cond(game->_priv.texture_sync_cond);
-						game->_priv.loading.time = al_get_time(); // TODO: rethink time management during loading
-					}
-					DrawConsole(game);
-					al_flip_display();
-
-					if (game->_priv.bsod_sync) {
-						al_set_target_bitmap(NULL);
-						game->_priv.bsod_sync = false;
-						al_signal_cond(game->_priv.bsod_cond);
-					}
-
-					al_lock_mutex(game->_priv.bsod_mutex);
-					while (game->_priv.in_bsod) {
-						al_wait_cond(game->_priv.bsod_cond, game->_priv.bsod_mutex);
-					}
-					al_unlock_mutex(game->_priv.bsod_mutex);
-				}
-#else
-				GamestateLoadingThread(&data);
-				DrawGamestates(game);
-				DrawConsole(game);
-				al_flip_display();
-#ifdef __EMSCRIPTEN__
-				emscripten_sleep(0);
-#endif
-#endif
-				al_convert_memory_bitmaps();
-
-				al_restore_state(&data.state);
-
-				ReloadShaders(game, false);
-
-				if (tmp->api->post_load) {
-					PrintConsole(game, "[%s] Post-loading...", tmp->name);
-					tmp->api->post_load(game, tmp->data);
-				}
-
-				game->_priv.loading.progress++;
-				CalculateProgress(game);
-				PrintConsole(game, "Gamestate \"%s\" loaded successfully in %f seconds.", tmp->name, al_get_time() - time);
-				game->_priv.loading.loaded++;
-
-				DrawGamestates(game);
-				DrawConsole(game);
-				al_flip_display();
-#ifdef __EMSCRIPTEN__
-				emscripten_sleep(0);
-#endif
-
-				tmp->loaded = true;
-				tmp->pending_load = false;
-			}
-			if (tmp->show_loading && game->_priv.loading.gamestate->open) {
-				(*game->_priv.loading.gamestate->api->stop)(game, game->_priv.loading.gamestate->data);
-			}
-			tmp->show_loading = true;
-			game->loading.shown = false;
-			game->_priv.timestamp = al_get_time();
-#ifdef __EMSCRIPTEN__
-			SetupAudio(game);
-#endif
-#ifdef __vita__
-			scePowerSetArmClockFrequency(vita_arm_freq);
-			scePowerSetBusClockFrequency(vita_bus_freq);
+	if (game->_priv.params.concurrent_loading && game->_priv.loading.to_load > 1) {
+		LoadGamestatesConcurrently(game);
+	}
 #endif
-		}
-
-		tmp = tmp->next;
+	while ((tmp = GetNextGamestateToLoad(game))) {
+		LoadSingleGamestate(game, tmp);
 	}
 
 	if (game->_priv.loading.loaded) {
@@ -486,11 +693,8 @@ static inline bool MainloopTick(struct Game* game) {
 			game->_priv.current_gamestate = tmp;
 			tmp->started = true;
 			tmp->pending_start = false;
-			if (game->_priv.params.handlers.compositor) {
-				tmp->fb = CreateNotPreservedBitmap(game->clip_rect.w, game->clip_rect.h);
-			} else {
-				tmp->fb = al_create_sub_bitmap(al_get_backbuffer(game->display), game->clip_rect.x, game->clip_rect.y, game->clip_rect.w, game->clip_rect.h);
-			}
+			InvalidateGamestateDispatch(game);
+			CreateGamestateFramebuffer(game, tmp);
 
 			(*tmp->api->start)(game, tmp->data);
 			game->_priv.timestamp = al_get_time();
@@ -503,6 +707,8 @@ static inline bool MainloopTick(struct Game* game) {
 		tmp = tmp->next;
 	}
 
+	StartPreloading(game);
+
 	game->_priv.loading.lock = false;
 #ifdef __EMSCRIPTEN__
 	emscripten_resume_main_loop();
@@ -516,18 +722,28 @@ static inline bool MainloopTick(struct Game* game) {
 		return false;
 	}
 
-	al_convert_memory_bitmaps();
+	if (!game->_priv.preload.gamestate) {
+		// otherwise the preloading thread could still be working on its bitmaps
+		al_convert_memory_bitmaps();
+	}
 
 	double delta = al_get_time() - game->_priv.timestamp;
 	game->_priv.timestamp += delta;
 	delta *= game->_priv.speed;
 
+	if (!GetReplayedFrame(game, &delta)) {
+		PrintConsole(game, "Replay finished, exiting...");
+		return false;
+	}
+	RecordFrame(game, delta);
+
 #ifdef LIBSUPERDERPY_IMGUI
 	ImGui_ImplAllegro5_NewFrame();
 	igNewFrame();
 #endif
 
 	LogicGamestates(game, delta);
+	AdvanceInputState(game);
 	DrawGamestates(game);
 
 #ifdef LIBSUPERDERPY_IMGUI
@@ -538,6 +754,12 @@ static inline bool MainloopTick(struct Game* game) {
 	DrawConsole(game);
 
 	al_flip_display();
+	MeasureFrameTime(game);
+
+	if (game->_priv.frame_stats.limit && game->_priv.frame_stats.frames >= game->_priv.frame_stats.limit) {
+		PrintConsole(game, "Done %d frames, exiting...", game->_priv.frame_stats.frames);
+		return false;
+	}
 	return true;
 }
 
@@ -546,5 +768,9 @@ SYMBOL_EXPORT bool libsuperderpy_mainloop(struct Game* game) {
 		return true;
 	}
 	ClearGarbage(game);
+	ExpireTextLayouts(game);
+	ExpireRenderTargets(game);
+	CompilePendingShaders(game);
+	PollWatchedFiles(game);
 	return MainloopEvents(game) && MainloopTick(game) && MainloopEvents(game);
 }
@@ -0,0 +1,379 @@
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This file is part of libsuperderpy.
+ *
+ * libsuperderpy is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libsuperderpy is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libsuperderpy. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Also, ponies.
+ */
+
+
+#include "internal.h"
+
+// Replay file consists of a header followed by a stream of records: input events
+// and frame markers, each frame marker holding the delta passed to Gamestate_Logic.
+// Values are stored in host byte order, so files are meant to be replayed on the same platform.
+
+#define REPLAY_MAGIC "SDRP"
+#define REPLAY_VERSION 1
+
+enum {
+	REPLAY_RECORD_EVENT = 1,
+	REPLAY_RECORD_FRAME = 2
+};
+
+struct Replay {
+	FILE* file;
+	bool recording;
+	double start; // time of the first frame, for relative event timestamps
+	bool frame_ready; // frame marker has been read, waiting for the tick to consume it
+	double delta;
+	bool finished;
+};
+
+static bool IsRecordableEvent(ALLEGRO_EVENT_TYPE type) {
+	switch (type) {
+		case ALLEGRO_EVENT_KEY_DOWN:
+		case ALLEGRO_EVENT_KEY_CHAR:
+		case ALLEGRO_EVENT_KEY_UP:
+		case ALLEGRO_EVENT_MOUSE_AXES:
+		case ALLEGRO_EVENT_MOUSE_BUTTON_DOWN:
+		case ALLEGRO_EVENT_MOUSE_BUTTON_UP:
+		case ALLEGRO_EVENT_MOUSE_ENTER_DISPLAY:
+		case ALLEGRO_EVENT_MOUSE_LEAVE_DISPLAY:
+		case ALLEGRO_EVENT_MOUSE_WARPED:
+		case ALLEGRO_EVENT_TOUCH_BEGIN:
+		case ALLEGRO_EVENT_TOUCH_END:
+		case ALLEGRO_EVENT_TOUCH_MOVE:
+		case ALLEGRO_EVENT_TOUCH_CANCEL:
+		case ALLEGRO_EVENT_JOYSTICK_AXIS:
+		case ALLEGRO_EVENT_JOYSTICK_BUTTON_DOWN:
+		case ALLEGRO_EVENT_JOYSTICK_BUTTON_UP:
+			return true;
+		default:
+			return false;
+	}
+}
+
+static void WriteInt(FILE* file, int32_t value) {
+	fwrite(&value, sizeof(value), 1, file);
+}
+
+static void WriteFloat(FILE* file, float value) {
+	fwrite(&value, sizeof(value), 1, file);
+}
+
+static void WriteDouble(FILE* file, double value) {
+	fwrite(&value, sizeof(value), 1, file);
+}
+
+static int32_t ReadInt(FILE* file) {
+	int32_t value = 0;
+	if (fread(&value, sizeof(value), 1, file) != 1) {
+		return 0;
+	}
+	return value;
+}
+
+static float ReadFloat(FILE* file) {
+	float value = 0;
+	if (fread(&value, sizeof(value), 1, file) != 1) {
+		return 0;
+	}
+	return value;
+}
+
+static double ReadDouble(FILE* file) {
+	double value = 0;
+	if (fread(&value, sizeof(value), 1, file) != 1) {
+		return 0;
+	}
+	return value;
+}
+
+static int GetJoystickIndex(ALLEGRO_JOYSTICK* joystick) {
+	for (int i = 0; i < al_get_num_joysticks(); i++) {
+		if (al_get_joystick(i) == joystick) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+SYMBOL_INTERNAL bool StartRecording(struct Game* game, const char* filename) {
+	FILE* file = fopen(filename, "wb");
+	if (!file) {
+		fprintf(stderr, "failed to open %s for recording!\n", filename);
+		return false;
+	}
+	fwrite(REPLAY_MAGIC, 1, strlen(REPLAY_MAGIC), file);
+	WriteInt(file, REPLAY_VERSION);
+
+	struct Replay* replay = calloc(1, sizeof(struct Replay));
+	replay->file = file;
+	replay->recording = true;
+	replay->start = -1;
+	game->_priv.replay = replay;
+	return true;
+}
+
+SYMBOL_INTERNAL bool StartReplay(struct Game* game, const char* filename) {
+	FILE* file = fopen(filename, "rb");
+	if (!file) {
+		fprintf(stderr, "failed to open replay %s!\n", filename);
+		return false;
+	}
+	char magic[sizeof(REPLAY_MAGIC) - 1];
+	if (fread(magic, 1, sizeof(magic), file) != sizeof(magic) || memcmp(magic, REPLAY_MAGIC, sizeof(magic)) != 0 || ReadInt(file) != REPLAY_VERSION) {
+		fprintf(stderr, "%s is not a valid replay file!\n", filename);
+		fclose(file);
+		return false;
+	}
+
+	struct Replay* replay = calloc(1, sizeof(struct Replay));
+	replay->file = file;
+	replay->start = -1;
+	game->_priv.replay = replay;
+	game->_priv.frame_stats.enabled = true;
+	return true;
+}
+
+SYMBOL_INTERNAL bool IsReplaying(struct Game* game) {
+	return game->_priv.replay && !game->_priv.replay->recording;
+}
+
+SYMBOL_INTERNAL bool IsReplacedByReplay(struct Game* game, ALLEGRO_EVENT* ev) {
+	return IsReplaying(game) && IsRecordableEvent(ev->type);
+}
+
+SYMBOL_INTERNAL void RecordEvent(struct Game* game, ALLEGRO_EVENT* ev) {
+	struct Replay* replay = game->_priv.replay;
+	if (!replay || !replay->recording || !IsRecordableEvent(ev->type)) {
+		return;
+	}
+	FILE* file = replay->file;
+	fputc(REPLAY_RECORD_EVENT, file);
+	WriteInt(file, ev->type);
+	WriteDouble(file, replay->start < 0 ? 0.0 : ev->any.timestamp - replay->start);
+	switch (ev->type) {
+		case ALLEGRO_EVENT_KEY_DOWN:
+		case ALLEGRO_EVENT_KEY_CHAR:
+		case ALLEGRO_EVENT_KEY_UP:
+			WriteInt(file, ev->keyboard.keycode);
+			WriteInt(file, ev->keyboard.unichar);
+			WriteInt(file, (int32_t)ev->keyboard.modifiers);
+			WriteInt(file, ev->keyboard.repeat);
+			break;
+		case ALLEGRO_EVENT_TOUCH_BEGIN:
+		case ALLEGRO_EVENT_TOUCH_END:
+		case ALLEGRO_EVENT_TOUCH_MOVE:
+		case ALLEGRO_EVENT_TOUCH_CANCEL:
+			WriteInt(file, ev->touch.id);
+			WriteFloat(file, ev->touch.x);
+			WriteFloat(file, ev->touch.y);
+			WriteFloat(file, ev->touch.dx);
+			WriteFloat(file, ev->touch.dy);
+			WriteInt(file, ev->touch.primary);
+			break;
+		case ALLEGRO_EVENT_JOYSTICK_AXIS:
+		case ALLEGRO_EVENT_JOYSTICK_BUTTON_DOWN:
+		case ALLEGRO_EVENT_JOYSTICK_BUTTON_UP:
+			WriteInt(file, GetJoystickIndex(ev->joystick.id));
+			WriteInt(file, ev->joystick.stick);
+			WriteInt(file, ev->joystick.axis);
+			WriteFloat(file, ev->joystick.pos);
+			WriteInt(file, ev->joystick.button);
+			break;
+		default:
+			WriteInt(file, ev->mouse.x);
+			WriteInt(file, ev->mouse.y);
+			WriteInt(file, ev->mouse.z);
+			WriteInt(file, ev->mouse.w);
+			WriteInt(file, ev->mouse.dx);
+			WriteInt(file, ev->mouse.dy);
+			WriteInt(file, ev->mouse.dz);
+			WriteInt(file, ev->mouse.dw);
+			WriteInt(file, (int32_t)ev->mouse.button);
+			WriteFloat(file, ev->mouse.pressure);
+			break;
+	}
+}
+
+SYMBOL_INTERNAL void RecordFrame(struct Game* game, double delta) {
+	struct Replay* replay = game->_priv.replay;
+	if (!replay || !replay->recording) {
+		return;
+	}
+	if (replay->start < 0) {
+		replay->start = al_get_time();
+	}
+	fputc(REPLAY_RECORD_FRAME, replay->file);
+	WriteDouble(replay->file, delta);
+}
+
+// Reads the next record. Returns true if it was an event, false on frame markers and at the end of file.
+static bool ReadReplayRecord(struct Game* game, struct Replay* replay, ALLEGRO_EVENT* ev) {
+	FILE* file = replay->file;
+	int tag = fgetc(file);
+	if (tag == REPLAY_RECORD_FRAME) {
+		replay->delta = ReadDouble(file);
+		replay->frame_ready = !feof(file);
+		replay->finished = feof(file);
+		return false;
+	}
+	if (tag != REPLAY_RECORD_EVENT) {
+		replay->finished = true;
+		return false;
+	}
+
+	memset(ev, 0, sizeof(ALLEGRO_EVENT));
+	ev->type = ReadInt(file);
+	ev->any.timestamp = replay->start + ReadDouble(file);
+	switch (ev->type) {
+		case ALLEGRO_EVENT_KEY_DOWN:
+		case ALLEGRO_EVENT_KEY_CHAR:
+		case ALLEGRO_EVENT_KEY_UP:
+			ev->keyboard.display = game->display;
+			ev->keyboard.keycode = ReadInt(file);
+			ev->keyboard.unichar = ReadInt(file);
+			ev->keyboard.modifiers = (unsigned int)ReadInt(file);
+			ev->keyboard.repeat = ReadInt(file);
+			break;
+		case ALLEGRO_EVENT_TOUCH_BEGIN:
+		case ALLEGRO_EVENT_TOUCH_END:
+		case ALLEGRO_EVENT_TOUCH_MOVE:
+		case ALLEGRO_EVENT_TOUCH_CANCEL:
+			ev->touch.display = game->display;
+			ev->touch.id = ReadInt(file);
+			ev->touch.x = ReadFloat(file);
+			ev->touch.y = ReadFloat(file);
+			ev->touch.dx = ReadFloat(file);
+			ev->touch.dy = ReadFloat(file);
+			ev->touch.primary = ReadInt(file);
+			break;
+		case ALLEGRO_EVENT_JOYSTICK_AXIS:
+		case ALLEGRO_EVENT_JOYSTICK_BUTTON_DOWN:
+		case ALLEGRO_EVENT_JOYSTICK_BUTTON_UP: {
+			int index = ReadInt(file);
+			ev->joystick.id = (index >= 0 && index < al_get_num_joysticks()) ? al_get_joystick(index) : NULL;
+			ev->joystick.stick = ReadInt(file);
+			ev->joystick.axis = ReadInt(file);
+			ev->joystick.pos = ReadFloat(file);
+			ev->joystick.button = ReadInt(file);
+			break;
+		}
+		default:
+			ev->mouse.display = game->display;
+			ev->mouse.x = ReadInt(file);
+			ev->mouse.y = ReadInt(file);
+			ev->mouse.z = ReadInt(file);
+			ev->mouse.w = ReadInt(file);
+			ev->mouse.dx = ReadInt(file);
+			ev->mouse.dy = ReadInt(file);
+			ev->mouse.dz = ReadInt(file);
+			ev->mouse.dw = ReadInt(file);
+			ev->mouse.button = (unsigned int)ReadInt(file);
+			ev->mouse.pressure = ReadFloat(file);
+			break;
+	}
+	if (feof(file) || !IsRecordableEvent(ev->type)) {
+		replay->finished = true;
+		return false;
+	}
+	return true;
+}
+
+SYMBOL_INTERNAL bool GetNextReplayedEvent(struct Game* game, ALLEGRO_EVENT* ev) {
+	struct Replay* replay = game->_priv.replay;
+	if (!IsReplaying(game) || replay->frame_ready || replay->finished) {
+		return false;
+	}
+	if (replay->start < 0) {
+		replay->start = al_get_time();
+	}
+	return ReadReplayRecord(game, replay, ev);
+}
+
+SYMBOL_INTERNAL bool GetReplayedFrame(struct Game* game, double* delta) {
+	struct Replay* replay = game->_priv.replay;
+	if (!IsReplaying(game)) {
+		return true;
+	}
+	ALLEGRO_EVENT ev;
+	while (!replay->frame_ready && !replay->finished) {
+		// events that weren't dispatched yet can't be delivered before this frame anymore
+		ReadReplayRecord(game, replay, &ev);
+	}
+	if (!replay->frame_ready) {
+		return false;
+	}
+	replay->frame_ready = false;
+	*delta = replay->delta;
+	return true;
+}
+
+SYMBOL_INTERNAL void StopReplay(struct Game* game) {
+	if (!game->_priv.replay) {
+		return;
+	}
+	fclose(game->_priv.replay->file);
+	free(game->_priv.replay);
+	game->_priv.replay = NULL;
+}
+
+SYMBOL_INTERNAL void MeasureFrameTime(struct Game* game) {
+	if (!game->_priv.frame_stats.enabled) {
+		return;
+	}
+	double now = al_get_time();
+	game->_priv.frame_stats.frames++;
+	if (game->_priv.frame_stats.last > 0) {
+		if (game->_priv.frame_stats.count == game->_priv.frame_stats.size) {
+			game->_priv.frame_stats.size = game->_priv.frame_stats.size ? game->_priv.frame_stats.size * 2 : 1024;
+			game->_priv.frame_stats.times = realloc(game->_priv.frame_stats.times, sizeof(double) * game->_priv.frame_stats.size);
+		}
+		game->_priv.frame_stats.times[game->_priv.frame_stats.count++] = now - game->_priv.frame_stats.last;
+	}
+	game->_priv.frame_stats.last = now;
+}
+
+static int CompareFrameTimes(const void* a, const void* b) {
+	double x = *(const double*)a, y = *(const double*)b;
+	return (x > y) - (x < y);
+}
+
+SYMBOL_INTERNAL void ReportFrameTimes(struct Game* game) {
+	if (!game->_priv.frame_stats.enabled) {
+		return;
+	}
+	int count = game->_priv.frame_stats.count;
+	double* times = game->_priv.frame_stats.times;
+	if (count) {
+		double total = 0;
+		for (int i = 0; i < count; i++) {
+			total += times[i];
+		}
+		qsort(times, count, sizeof(double), CompareFrameTimes);
+		// printed regardless of debug mode, as it's what benchmark runs are for
+		printf("Frames: %d, total: %.3f s, average: %.3f ms (%.1f FPS)\n", count, total, total / count * 1000.0, count / total);
+		printf("Frame times: min %.3f ms, median %.3f ms, 95th %.3f ms, 99th %.3f ms, max %.3f ms\n",
+			times[0] * 1000.0, times[count / 2] * 1000.0, times[(int)(count * 0.95)] * 1000.0, times[(int)(count * 0.99)] * 1000.0, times[count - 1] * 1000.0);
+		fflush(stdout);
+	}
+	free(times);
+	game->_priv.frame_stats.times = NULL;
+	game->_priv.frame_stats.count = 0;
+	game->_priv.frame_stats.size = 0;
+}
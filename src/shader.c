@@ -21,13 +21,109 @@
 
 #include "internal.h"
 
-static ALLEGRO_USTR* GetShaderSource(struct Game* game, const char* filename) {
+// Guards against include cycles.
+#define SHADER_MAX_INCLUDE_DEPTH 16
+
+static bool AppendShaderFile(struct Game* game, ALLEGRO_USTR* str, const char* filename) {
 	ALLEGRO_FILE* fp = al_fopen(filename, "r");
 	if (!fp) {
 		FatalError(game, false, "Failed to open shader file %s", filename);
-		return NULL;
+		return false;
+	}
+	WatchFile(game, filename, WATCHED_SHADER, NULL);
+
+	ALLEGRO_USTR_INFO info;
+	int64_t size = al_fsize(fp);
+	if (size > 0) {
+		// read the whole file at once when its size is known
+		char* buf = malloc(size);
+		if (!buf) {
+			FatalError(game, false, "Failed to allocate memory for shader file %s", filename);
+			al_fclose(fp);
+			return false;
+		}
+		size_t n = al_fread(fp, buf, size);
+		al_ustr_append(str, al_ref_buffer(&info, buf, n));
+		free(buf);
+	} else {
+		while (true) {
+			char buf[4096];
+			size_t n = al_fread(fp, buf, sizeof(buf));
+			if (n == 0) {
+				break;
+			}
+			al_ustr_append(str, al_ref_buffer(&info, buf, n));
+		}
+	}
+	al_fclose(fp);
+	return true;
+}
+
+// Copies the file into str, replacing #include "file" lines with contents of given file, relative to the including one.
+// Every file gets its own GLSL source string number in #line directives, so compile errors point to the right place.
+static bool PreprocessShaderFile(struct Game* game, ALLEGRO_USTR* str, const char* filename, int depth, int* files) {
+	if (depth > SHADER_MAX_INCLUDE_DEPTH) {
+		FatalError(game, false, "Shader includes nested too deeply in %s", filename);
+		return false;
+	}
+	ALLEGRO_USTR* src = al_ustr_new("");
+	if (!AppendShaderFile(game, src, filename)) {
+		al_ustr_free(src);
+		return false;
 	}
 
+	int index = (*files)++;
+	if (index && game->config.debug.enabled) {
+		PrintConsole(game, "Shader source string %d: %s", index, filename);
+	}
+	// GLSL 1.20 and GLSL ES 1.00 continue at the line after the one given in #line
+	al_ustr_appendf(str, "#line 0 %d\n", index);
+
+	bool ret = true;
+	ALLEGRO_USTR_INFO info;
+	const char* line = al_cstr(src);
+	int number = 0;
+	while (*line && ret) {
+		const char* end = strchr(line, '\n');
+		size_t len = end ? (size_t)(end - line + 1) : strlen(line);
+		number++;
+		const char* directive = line;
+		while (*directive == ' ' || *directive == '\t') {
+			directive++;
+		}
+		if (!strncmp(directive, "#include", 8) && (directive[8] == ' ' || directive[8] == '\t' || directive[8] == '"')) {
+			const char* open = strchr(directive, '"');
+			const char* close = open ? strchr(open + 1, '"') : NULL;
+			if (!close || close >= line + len) {
+				FatalError(game, false, "Malformed #include in shader file %s", filename);
+				ret = false;
+				break;
+			}
+			const char* slash = strrchr(filename, '/');
+#ifdef ALLEGRO_WINDOWS
+			const char* backslash = strrchr(filename, '\\');
+			if (backslash > slash) {
+				slash = backslash;
+			}
+#endif
+			char path[4096];
+			if (open[1] == '/' || !slash) {
+				snprintf(path, sizeof(path), "%.*s", (int)(close - open - 1), open + 1);
+			} else {
+				snprintf(path, sizeof(path), "%.*s%.*s", (int)(slash - filename + 1), filename, (int)(close - open - 1), open + 1);
+			}
+			ret = PreprocessShaderFile(game, str, path, depth + 1, files);
+			al_ustr_appendf(str, "\n#line %d %d\n", number, index);
+		} else {
+			al_ustr_append(str, al_ref_buffer(&info, line, len));
+		}
+		line += len;
+	}
+	al_ustr_free(src);
+	return ret;
+}
+
+static ALLEGRO_USTR* GetShaderSource(struct Game* game, const char* filename, char** defines) {
 // Use GLSL 1.20 (GL 2.1) and GLSL ES 1.00 (GLES 2.0)
 // We need to use 120 for GL because non-core GL profile on macOS is limited to 2.1
 // Even when ignoring macOS, the highest possible option right now is GLSL 1.30, because
@@ -39,33 +135,34 @@ static ALLEGRO_USTR* GetShaderSource(struct Game* game, const char* filename) {
 	ALLEGRO_USTR* str = al_ustr_new("");
 #endif
 
-	while (true) {
-		char buf[512];
-		size_t n = 0;
-		ALLEGRO_USTR_INFO info;
-
-		n = al_fread(fp, buf, sizeof(buf));
-		if (n == 0) {
-			break;
+	for (int i = 0; defines && defines[i]; i++) {
+		// both "NAME VALUE" and "NAME=VALUE" are accepted
+		const char* eq = strchr(defines[i], '=');
+		if (eq) {
+			al_ustr_appendf(str, "#define %.*s %s\n", (int)(eq - defines[i]), defines[i], eq + 1);
+		} else {
+			al_ustr_appendf(str, "#define %s\n", defines[i]);
 		}
-		al_ustr_append(str, al_ref_buffer(&info, buf, n));
 	}
-	al_fclose(fp);
+
+	int files = 0;
+	if (!PreprocessShaderFile(game, str, filename, 0, &files)) {
+		al_ustr_free(str);
+		return NULL;
+	}
 	return str;
 }
 
-static bool AttachToShader(struct Game* game, ALLEGRO_SHADER* shader, ALLEGRO_SHADER_TYPE type, const char* filename) {
-	bool ret = 0;
-	if (filename) {
-		ALLEGRO_USTR* src = GetShaderSource(game, filename);
-		if (!src) {
-			return false;
-		}
-		ret = al_attach_shader_source(shader, type, al_cstr(src));
-		al_ustr_free(src);
-	} else {
-		ret = al_attach_shader_source(shader, type, al_get_default_shader_source(al_get_shader_platform(shader), type));
+static unsigned long HashShaderSource(unsigned long hash, const char* str) {
+	char c = 0;
+	while ((c = *str++)) {
+		hash = ((hash << 5) + hash) + c; /* hash * 33 + c */
 	}
+	return hash;
+}
+
+static bool AttachToShader(struct Game* game, ALLEGRO_SHADER* shader, ALLEGRO_SHADER_TYPE type, const char* source) {
+	bool ret = al_attach_shader_source(shader, type, source ? source : al_get_default_shader_source(al_get_shader_platform(shader), type));
 	if (!ret) {
 		const char* log = al_get_shader_log(shader);
 		if (log) {
@@ -75,87 +172,299 @@ static bool AttachToShader(struct Game* game, ALLEGRO_SHADER* shader, ALLEGRO_SH
 	return ret;
 }
 
-struct ShaderListItem {
-	ALLEGRO_SHADER* shader;
+// Files a shader program has been requested with. Identical programs are shared, so there may be more than one set.
+struct ShaderFiles {
 	char* vertex;
 	char* fragment;
-	bool loaded;
+	char** defines; // NULL-terminated
+	unsigned long hash; // of sources last read from these files
 };
 
-SYMBOL_EXPORT ALLEGRO_SHADER* CreateShader(struct Game* game, const char* vertex, const char* fragment) {
+struct ShaderListItem {
+	ALLEGRO_SHADER* shader;
+	struct ShaderFiles* files;
+	int files_count;
+	char* sources[2]; // preprocessed vertex and fragment sources, used to build the program and to share identical variants
+	int references;
+	bool loaded; // build has been attempted
+	bool built; // program is ready to use
+	unsigned long hash; // of sources the program has been built from
+};
+
+static char* GetPreprocessedSource(struct Game* game, const char* filename, char** defines) {
+	if (!filename) {
+		return NULL;
+	}
+	ALLEGRO_USTR* src = GetShaderSource(game, filename, defines);
+	if (!src) {
+		return NULL;
+	}
+	char* result = al_cstr_dup(src);
+	al_ustr_free(src);
+	return result;
+}
+
+// Returns false when any of the files failed to load; sources are set to NULL then.
+static bool ReadShaderSources(struct Game* game, struct ShaderFiles* files, char* sources[2]) {
+	sources[0] = GetPreprocessedSource(game, files->vertex, files->defines);
+	sources[1] = GetPreprocessedSource(game, files->fragment, files->defines);
+	if ((files->vertex && !sources[0]) || (files->fragment && !sources[1])) {
+		free(sources[0]);
+		free(sources[1]);
+		sources[0] = NULL;
+		sources[1] = NULL;
+		return false;
+	}
+	return true;
+}
+
+static unsigned long HashShaderSources(char* sources[2]) {
+	return HashShaderSource(HashShaderSource(5381, sources[0] ? sources[0] : ""), sources[1] ? sources[1] : "");
+}
+
+static bool StringsEqual(const char* a, const char* b) {
+	return (!a && !b) || (a && b && !strcmp(a, b));
+}
+
+static bool ShaderFilesEqual(struct ShaderFiles* files, const char* vertex, const char* fragment, const char* defines[]) {
+	if (!StringsEqual(files->vertex, vertex) || !StringsEqual(files->fragment, fragment)) {
+		return false;
+	}
+	int i = 0;
+	for (; files->defines[i]; i++) {
+		if (!defines || !defines[i] || strcmp(files->defines[i], defines[i])) {
+			return false;
+		}
+	}
+	return !defines || !defines[i];
+}
+
+static void AddShaderFiles(struct ShaderListItem* item, const char* vertex, const char* fragment, const char* defines[], unsigned long hash) {
+	for (int i = 0; i < item->files_count; i++) {
+		if (ShaderFilesEqual(&item->files[i], vertex, fragment, defines)) {
+			return;
+		}
+	}
+	item->files = realloc(item->files, (item->files_count + 1) * sizeof(struct ShaderFiles));
+	struct ShaderFiles* files = &item->files[item->files_count++];
+	files->vertex = vertex ? strdup(vertex) : NULL;
+	files->fragment = fragment ? strdup(fragment) : NULL;
+	files->hash = hash;
+	int count = 0;
+	while (defines && defines[count]) {
+		count++;
+	}
+	files->defines = calloc(count + 1, sizeof(char*));
+	for (int i = 0; i < count; i++) {
+		files->defines[i] = strdup(defines[i]);
+	}
+}
+
+SYMBOL_EXPORT ALLEGRO_SHADER* CreateShaderVariant(struct Game* game, const char* vertex, const char* fragment, const char* defines[]) {
 	PrintConsole(game, "Creating shader V:%s F:%s...", vertex, fragment);
 
+	// preprocessed once here and reused by the build
+	struct ShaderFiles files = {.vertex = (char*)vertex, .fragment = (char*)fragment, .defines = (char**)defines};
+	char* sources[2];
+	bool ok = ReadShaderSources(game, &files, sources);
+	// loading threads can create shaders concurrently
+	al_lock_mutex(game->_priv.cache_mutex);
+	for (struct List* list = game->_priv.shaders; list; list = list->next) {
+		struct ShaderListItem* item = list->data;
+		if (ok && (sources[0] || sources[1]) && StringsEqual(item->sources[0], sources[0]) && StringsEqual(item->sources[1], sources[1])) {
+			item->references++;
+			// its files have to be watched for changes as well
+			AddShaderFiles(item, vertex, fragment, defines, HashShaderSources(sources));
+			al_unlock_mutex(game->_priv.cache_mutex);
+			PrintConsole(game, "Sharing identical shader program.");
+			free(sources[0]);
+			free(sources[1]);
+			return item->shader;
+		}
+	}
+
 	ALLEGRO_SHADER* shader = al_create_shader(ALLEGRO_SHADER_GLSL);
 
 	struct ShaderListItem* item = malloc(sizeof(struct ShaderListItem));
 	item->shader = shader;
-	item->vertex = vertex ? strdup(vertex) : NULL;
-	item->fragment = fragment ? strdup(fragment) : NULL;
+	item->files = NULL;
+	item->files_count = 0;
+	AddShaderFiles(item, vertex, fragment, defines, HashShaderSources(sources));
+	item->sources[0] = sources[0];
+	item->sources[1] = sources[1];
+	item->references = 1;
 	item->loaded = false;
+	item->built = false;
+	item->hash = 0;
 
 	game->_priv.shaders = AddToList(game->_priv.shaders, item);
+	al_unlock_mutex(game->_priv.cache_mutex);
 
 	return shader;
 }
 
+SYMBOL_EXPORT ALLEGRO_SHADER* CreateShader(struct Game* game, const char* vertex, const char* fragment) {
+	return CreateShaderVariant(game, vertex, fragment, NULL);
+}
+
 static bool ShaderIdentity(struct List* item, void* shader) {
 	return ((struct ShaderListItem*)item->data)->shader == shader;
 }
 
+static void FreeShaderListItem(struct ShaderListItem* item) {
+	al_destroy_shader(item->shader);
+	for (int i = 0; i < item->files_count; i++) {
+		free(item->files[i].vertex);
+		free(item->files[i].fragment);
+		for (int j = 0; item->files[i].defines[j]; j++) {
+			free(item->files[i].defines[j]);
+		}
+		free(item->files[i].defines);
+	}
+	free(item->files);
+	free(item->sources[0]);
+	free(item->sources[1]);
+	free(item);
+}
+
 SYMBOL_EXPORT void DestroyShader(struct Game* game, ALLEGRO_SHADER* shader) {
-	struct ShaderListItem* item = RemoveFromList(&game->_priv.shaders, shader, ShaderIdentity);
-	if (!item) {
+	al_lock_mutex(game->_priv.cache_mutex);
+	struct List* list = FindInList(game->_priv.shaders, shader, ShaderIdentity);
+	struct ShaderListItem* item = list ? list->data : NULL;
+	if (item && --item->references == 0) {
+		RemoveFromList(&game->_priv.shaders, shader, ShaderIdentity);
+	} else if (item) {
+		item = NULL;
+	}
+	al_unlock_mutex(game->_priv.cache_mutex);
+	if (!list) {
 		PrintConsole(game, "Tried to destroy a unregistered shader!");
 		al_destroy_shader(shader);
 		return;
 	}
-	al_destroy_shader(item->shader);
-	if (item->vertex) {
-		free(item->vertex);
+	if (item) {
+		FreeShaderListItem(item);
 	}
-	if (item->fragment) {
-		free(item->fragment);
+}
+
+SYMBOL_EXPORT bool IsShaderReady(struct Game* game, ALLEGRO_SHADER* shader) {
+	al_lock_mutex(game->_priv.cache_mutex);
+	struct List* list = FindInList(game->_priv.shaders, shader, ShaderIdentity);
+	bool ready = list && ((struct ShaderListItem*)list->data)->built;
+	al_unlock_mutex(game->_priv.cache_mutex);
+	return ready;
+}
+
+// Re-reads the sources from files when reload is set; otherwise, the ones preprocessed by CreateShaderVariant are used.
+// When only_modified is set, shaders built from the same sources as before are left alone.
+static void BuildShader(struct Game* game, struct ShaderListItem* item, bool reload, bool only_modified) {
+	item->loaded = true;
+	struct ShaderFiles* files = &item->files[0];
+	if (reload) {
+		// the program is shared by all sets of files it has been requested with, so rebuild it from the modified one
+		bool modified = false;
+		for (int i = 0; i < item->files_count; i++) {
+			char* fresh[2];
+			if (!ReadShaderSources(game, &item->files[i], fresh)) {
+				item->built = false;
+				return;
+			}
+			unsigned long hash = HashShaderSources(fresh);
+			if (hash != item->files[i].hash && !modified) {
+				modified = true;
+				free(item->sources[0]);
+				free(item->sources[1]);
+				item->sources[0] = fresh[0];
+				item->sources[1] = fresh[1];
+				files = &item->files[i];
+			} else {
+				free(fresh[0]);
+				free(fresh[1]);
+			}
+			item->files[i].hash = hash;
+		}
+	} else if ((files->vertex && !item->sources[0]) || (files->fragment && !item->sources[1])) {
+		// failed to load in CreateShaderVariant
+		item->built = false;
+		return;
 	}
-	free(item);
+
+	unsigned long hash = HashShaderSources(item->sources);
+	if (only_modified && item->built && item->hash == hash) {
+		return;
+	}
+
+	double start = al_get_time();
+	bool ret = AttachToShader(game, item->shader, ALLEGRO_VERTEX_SHADER, item->sources[0]);
+	ret = ret && AttachToShader(game, item->shader, ALLEGRO_PIXEL_SHADER, item->sources[1]);
+
+	if (ret && !al_build_shader(item->shader)) {
+		const char* log = al_get_shader_log(item->shader);
+		if (log) {
+			FatalError(game, false, "%s", log);
+		}
+		ret = false;
+	}
+	item->built = ret;
+	item->hash = ret ? hash : 0;
+	PrintConsole(game, "V:%s, F:%s (%.1f ms)", files->vertex, files->fragment, (al_get_time() - start) * 1000.0);
 }
 
 SYMBOL_INTERNAL void ReloadShaders(struct Game* game, bool force) {
-	struct List* list = game->_priv.shaders;
+	if (!force && game->config.shader_compile_budget > 0) {
+		// pending shaders will be compiled by CompilePendingShaders, a few at a time
+		return;
+	}
 	PrintConsole(game, force ? "Reloading shaders..." : "Loading shaders...");
+	al_lock_mutex(game->_priv.cache_mutex);
+	struct List* list = game->_priv.shaders;
 	while (list) {
 		struct ShaderListItem* item = list->data;
 		if (!item->loaded || force) {
-			PrintConsole(game, "V:%s, F:%s", item->vertex, item->fragment);
-			bool ret = AttachToShader(game, item->shader, ALLEGRO_VERTEX_SHADER, item->vertex);
-			ret = ret && AttachToShader(game, item->shader, ALLEGRO_PIXEL_SHADER, item->fragment);
-
-			if (ret && !al_build_shader(item->shader)) {
-				const char* log = al_get_shader_log(item->shader);
-				if (log) {
-					FatalError(game, false, "%s", log);
-				}
-			} else {
-				item->loaded = true;
-			}
+			BuildShader(game, item, force, false);
 		}
 		list = list->next;
 	}
+	al_unlock_mutex(game->_priv.cache_mutex);
 	PrintConsole(game, "Shaders loaded.");
 }
 
+SYMBOL_INTERNAL void ReloadModifiedShaders(struct Game* game) {
+	PrintConsole(game, "Reloading modified shaders...");
+	al_lock_mutex(game->_priv.cache_mutex);
+	for (struct List* list = game->_priv.shaders; list; list = list->next) {
+		BuildShader(game, list->data, true, true);
+	}
+	al_unlock_mutex(game->_priv.cache_mutex);
+}
+
+SYMBOL_INTERNAL void CompilePendingShaders(struct Game* game) {
+	double budget = game->config.shader_compile_budget;
+	if (budget <= 0) {
+		return;
+	}
+	double start = al_get_time();
+	// at least one shader gets compiled per frame, even if it takes longer than the budget
+	al_lock_mutex(game->_priv.cache_mutex);
+	for (struct List* list = game->_priv.shaders; list; list = list->next) {
+		struct ShaderListItem* item = list->data;
+		if (!item->loaded) {
+			BuildShader(game, item, false, false);
+			if (al_get_time() - start >= budget) {
+				break;
+			}
+		}
+	}
+	al_unlock_mutex(game->_priv.cache_mutex);
+}
+
 SYMBOL_INTERNAL void DestroyShaders(struct Game* game) {
 	PrintConsole(game, "Destroying shaders...");
 	while (game->_priv.shaders) {
 		struct ShaderListItem* item = game->_priv.shaders->data;
-		al_destroy_shader(item->shader);
-		if (item->vertex) {
-			free(item->vertex);
-		}
-		if (item->fragment) {
-			free(item->fragment);
-		}
 		struct List* prev = game->_priv.shaders;
 		game->_priv.shaders = game->_priv.shaders->next;
 		free(prev);
+		FreeShaderListItem(item);
 	}
 }
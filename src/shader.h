@@ -28,6 +28,18 @@
 #include "libsuperderpy.h"
 
 ALLEGRO_SHADER* CreateShader(struct Game* game, const char* vertex, const char* fragment);
+/*! \brief Creates a shader with given preprocessor definitions ("NAME" or "NAME=VALUE", NULL-terminated array) prepended to its sources.
+ *
+ * Sources can use #include "file" with paths relative to the including file. Variants that expand to identical sources
+ * share a single program, which is destroyed once DestroyShader has been called for each of them.
+ */
+ALLEGRO_SHADER* CreateShaderVariant(struct Game* game, const char* vertex, const char* fragment, const char* defines[]);
 void DestroyShader(struct Game* game, ALLEGRO_SHADER* shader);
+/*! \brief Checks whether the shader has been built successfully.
+ *
+ * With the "shaderCompileBudget" config option set (in milliseconds), shaders created by gamestates are compiled
+ * in the main loop, a few per frame, instead of right after loading; gamestates should check this before using them.
+ */
+bool IsShaderReady(struct Game* game, ALLEGRO_SHADER* shader);
 
 #endif /* LIBSUPERDERPY_SHADER_H */
@@ -0,0 +1,424 @@
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This file is part of libsuperderpy.
+ *
+ * libsuperderpy is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libsuperderpy is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libsuperderpy. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Also, ponies.
+ */
+
+#include "internal.h"
+
+static const char* PROPERTY_NAMES[SKELETON_PROPERTY_COUNT] = {
+	"x", "y", "scaleX", "scaleY", "angle"};
+
+static float* GetPoseProperty(struct SkeletonPose* pose, SKELETON_PROPERTY property) {
+	switch (property) {
+		case SKELETON_X:
+			return &pose->x;
+		case SKELETON_Y:
+			return &pose->y;
+		case SKELETON_SCALE_X:
+			return &pose->scaleX;
+		case SKELETON_SCALE_Y:
+			return &pose->scaleY;
+		case SKELETON_ANGLE:
+		default:
+			return &pose->angle;
+	}
+}
+
+static void GetPoseTransform(struct SkeletonPose* pose, ALLEGRO_TRANSFORM* transform) {
+	al_identity_transform(transform);
+	al_scale_transform(transform, pose->scaleX, pose->scaleY);
+	al_rotate_transform(transform, pose->angle);
+	al_translate_transform(transform, pose->x, pose->y);
+}
+
+SYMBOL_EXPORT struct Skeleton* CreateSkeleton(struct Game* game, const char* name, ALLEGRO_BITMAP* atlas) {
+	struct Skeleton* skeleton = calloc(1, sizeof(struct Skeleton));
+	skeleton->name = name ? strdup(name) : NULL;
+	skeleton->atlas = atlas;
+	return skeleton;
+}
+
+SYMBOL_EXPORT void DestroySkeleton(struct Game* game, struct Skeleton* skeleton) {
+	for (int i = 0; i < skeleton->bone_count; i++) {
+		free(skeleton->bones[i].name);
+	}
+	for (int i = 0; i < skeleton->part_count; i++) {
+		free(skeleton->parts[i].name);
+	}
+	if (skeleton->_priv.atlas_file) {
+		RemoveBitmap(game, skeleton->_priv.atlas_file);
+		free(skeleton->_priv.atlas_file);
+	}
+	free(skeleton->bones);
+	free(skeleton->parts);
+	free(skeleton->_priv.vertices);
+	if (skeleton->name) {
+		free(skeleton->name);
+	}
+	free(skeleton);
+}
+
+SYMBOL_EXPORT int AddSkeletonBone(struct Game* game, struct Skeleton* skeleton, const char* name, int parent, struct SkeletonPose setup) {
+	if (parent >= skeleton->bone_count) {
+		PrintConsole(game, "%s: parent of bone %s has to be added first!", skeleton->name, name);
+		return -1;
+	}
+	if (skeleton->bone_count == skeleton->_priv.bones_size) {
+		skeleton->_priv.bones_size = skeleton->_priv.bones_size ? skeleton->_priv.bones_size * 2 : 8;
+		skeleton->bones = realloc(skeleton->bones, sizeof(struct SkeletonBone) * skeleton->_priv.bones_size);
+	}
+	struct SkeletonBone* bone = &skeleton->bones[skeleton->bone_count];
+	bone->name = strdup(name);
+	bone->parent = parent < 0 ? -1 : parent;
+	bone->setup = setup;
+	bone->pose = setup;
+	al_identity_transform(&bone->transform);
+	return skeleton->bone_count++;
+}
+
+SYMBOL_EXPORT int AddSkeletonPart(struct Game* game, struct Skeleton* skeleton, const char* name, int bone, float sx, float sy, float sw, float sh, float pivotX, float pivotY, struct SkeletonPose offset) {
+	if (bone < 0 || bone >= skeleton->bone_count) {
+		PrintConsole(game, "%s: part %s attached to invalid bone %d!", skeleton->name, name, bone);
+		return -1;
+	}
+	if (skeleton->part_count == skeleton->_priv.parts_size) {
+		skeleton->_priv.parts_size = skeleton->_priv.parts_size ? skeleton->_priv.parts_size * 2 : 8;
+		skeleton->parts = realloc(skeleton->parts, sizeof(struct SkeletonPart) * skeleton->_priv.parts_size);
+	}
+	struct SkeletonPart* part = &skeleton->parts[skeleton->part_count];
+	part->name = strdup(name);
+	part->bone = bone;
+	part->sx = sx;
+	part->sy = sy;
+	part->sw = sw;
+	part->sh = sh;
+	part->pivotX = pivotX;
+	part->pivotY = pivotY;
+	part->offset = offset;
+	part->tint = al_map_rgb(255, 255, 255);
+	part->hidden = false;
+	return skeleton->part_count++;
+}
+
+SYMBOL_EXPORT int FindSkeletonBone(struct Skeleton* skeleton, const char* name) {
+	for (int i = 0; i < skeleton->bone_count; i++) {
+		if (!strcmp(skeleton->bones[i].name, name)) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+SYMBOL_EXPORT int FindSkeletonPart(struct Skeleton* skeleton, const char* name) {
+	for (int i = 0; i < skeleton->part_count; i++) {
+		if (!strcmp(skeleton->parts[i].name, name)) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+static float GetConfigFloat(ALLEGRO_CONFIG* config, const char* section, const char* key, float val) {
+	const char* value = al_get_config_value(config, section, key);
+	return value ? strtod(value, NULL) : val;
+}
+
+static struct SkeletonPose GetConfigPose(ALLEGRO_CONFIG* config, const char* section) {
+	return (struct SkeletonPose){
+		.x = GetConfigFloat(config, section, "x", 0.0),
+		.y = GetConfigFloat(config, section, "y", 0.0),
+		.scaleX = GetConfigFloat(config, section, "scaleX", 1.0),
+		.scaleY = GetConfigFloat(config, section, "scaleY", 1.0),
+		.angle = GetConfigFloat(config, section, "angle", 0.0),
+	};
+}
+
+// Bones are described in [bone:name] sections with optional parent and setup pose keys (x, y, scaleX, scaleY, angle);
+// [part:name] sections attach the atlas region (sx, sy, sw, sh) to a bone, with pivotX, pivotY and the same pose keys
+// placing it relative to the bone. Parts are drawn in the order of their sections.
+SYMBOL_EXPORT struct Skeleton* LoadSkeleton(struct Game* game, const char* filename) {
+	PrintConsole(game, "Loading skeleton: %s", filename);
+	ALLEGRO_CONFIG* config = al_load_config_file(GetDataFilePath(game, filename));
+	if (!config) {
+		PrintConsole(game, "Could not load skeleton from %s!", filename);
+		return NULL;
+	}
+
+	struct Skeleton* skeleton = CreateSkeleton(game, filename, NULL);
+	const char* atlas = al_get_config_value(config, "skeleton", "atlas");
+	if (atlas) {
+		skeleton->_priv.atlas_file = strdup(atlas);
+		skeleton->atlas = AddBitmap(game, skeleton->_priv.atlas_file);
+	}
+
+	// bones can be listed in any order, so keep adding those whose parents are already there
+	bool progress = true;
+	while (progress) {
+		progress = false;
+		ALLEGRO_CONFIG_SECTION* iterator = NULL;
+		const char* section = al_get_first_config_section(config, &iterator);
+		while (section) {
+			if (!strncmp(section, "bone:", 5) && FindSkeletonBone(skeleton, section + 5) < 0) {
+				const char* parent = al_get_config_value(config, section, "parent");
+				int index = parent ? FindSkeletonBone(skeleton, parent) : -1;
+				if (!parent || index >= 0) {
+					AddSkeletonBone(game, skeleton, section + 5, index, GetConfigPose(config, section));
+					progress = true;
+				}
+			}
+			section = al_get_next_config_section(&iterator);
+		}
+	}
+
+	ALLEGRO_CONFIG_SECTION* iterator = NULL;
+	const char* section = al_get_first_config_section(config, &iterator);
+	while (section) {
+		if (!strncmp(section, "bone:", 5) && FindSkeletonBone(skeleton, section + 5) < 0) {
+			PrintConsole(game, "%s: bone %s has a missing or cyclic parent!", filename, section + 5);
+		}
+		if (!strncmp(section, "part:", 5)) {
+			const char* bone = al_get_config_value(config, section, "bone");
+			AddSkeletonPart(game, skeleton, section + 5, bone ? FindSkeletonBone(skeleton, bone) : 0,
+				GetConfigFloat(config, section, "sx", 0.0), GetConfigFloat(config, section, "sy", 0.0),
+				GetConfigFloat(config, section, "sw", 0.0), GetConfigFloat(config, section, "sh", 0.0),
+				GetConfigFloat(config, section, "pivotX", 0.5), GetConfigFloat(config, section, "pivotY", 0.5),
+				GetConfigPose(config, section));
+		}
+		section = al_get_next_config_section(&iterator);
+	}
+
+	al_destroy_config(config);
+	UpdateSkeleton(game, skeleton);
+	return skeleton;
+}
+
+SYMBOL_EXPORT struct SkeletonAnimation* CreateSkeletonAnimation(struct Game* game, struct Skeleton* skeleton, const char* name) {
+	struct SkeletonAnimation* animation = calloc(1, sizeof(struct SkeletonAnimation));
+	animation->name = name ? strdup(name) : NULL;
+	animation->bone_count = skeleton->bone_count;
+	animation->tracks = calloc(animation->bone_count * SKELETON_PROPERTY_COUNT, sizeof(struct KeyframeTrack));
+	animation->duration = 0.0;
+	animation->loop = false;
+	return animation;
+}
+
+SYMBOL_EXPORT void DestroySkeletonAnimation(struct Game* game, struct SkeletonAnimation* animation) {
+	for (int i = 0; i < animation->bone_count * SKELETON_PROPERTY_COUNT; i++) {
+		free(animation->tracks[i].keyframes);
+	}
+	free(animation->tracks);
+	if (animation->name) {
+		free(animation->name);
+	}
+	free(animation);
+}
+
+SYMBOL_EXPORT void AddSkeletonKeyframe(struct Game* game, struct SkeletonAnimation* animation, int bone, SKELETON_PROPERTY property, double time, float value, TWEEN_STYLE style) {
+	if (bone < 0 || bone >= animation->bone_count) {
+		PrintConsole(game, "%s: keyframe for invalid bone %d!", animation->name, bone);
+		return;
+	}
+	InsertKeyframe(&animation->tracks[bone * SKELETON_PROPERTY_COUNT + property], time, value, style);
+	if (time > animation->duration) {
+		animation->duration = time;
+	}
+}
+
+// Each animated property has its own section named after the bone, e.g. [arm.angle] with "time=value [style]" entries;
+// optional [animation] section holds duration and loop.
+SYMBOL_EXPORT struct SkeletonAnimation* LoadSkeletonAnimation(struct Game* game, struct Skeleton* skeleton, const char* filename) {
+	PrintConsole(game, "Loading skeleton animation: %s", filename);
+	ALLEGRO_CONFIG* config = al_load_config_file(GetDataFilePath(game, filename));
+	if (!config) {
+		PrintConsole(game, "Could not load skeleton animation from %s!", filename);
+		return NULL;
+	}
+
+	struct SkeletonAnimation* animation = CreateSkeletonAnimation(game, skeleton, filename);
+	ALLEGRO_CONFIG_SECTION* iterator = NULL;
+	const char* section = al_get_first_config_section(config, &iterator);
+	while (section) {
+		const char* dot = strrchr(section, '.');
+		if (dot) {
+			char bone_name[255] = {0};
+			snprintf(bone_name, sizeof(bone_name), "%.*s", (int)(dot - section), section);
+			int bone = FindSkeletonBone(skeleton, bone_name);
+			int property = -1;
+			for (int i = 0; i < SKELETON_PROPERTY_COUNT; i++) {
+				if (!strcmp(dot + 1, PROPERTY_NAMES[i])) {
+					property = i;
+				}
+			}
+			if (bone < 0 || property < 0) {
+				PrintConsole(game, "%s: unknown bone property %s!", filename, section);
+			} else {
+				ALLEGRO_CONFIG_ENTRY* entry = NULL;
+				const char* key = al_get_first_config_entry(config, section, &entry);
+				while (key) {
+					const char* val = al_get_config_value(config, section, key);
+					char* end = NULL;
+					float value = strtod(val, &end);
+					AddSkeletonKeyframe(game, animation, bone, property, strtod(key, NULL), value, ParseTweenStyle(game, end));
+					key = al_get_next_config_entry(&entry);
+				}
+			}
+		}
+		section = al_get_next_config_section(&iterator);
+	}
+
+	const char* duration = al_get_config_value(config, "animation", "duration");
+	if (duration) {
+		animation->duration = strtod(duration, NULL);
+	}
+	const char* loop = al_get_config_value(config, "animation", "loop");
+	if (loop) {
+		animation->loop = strtol(loop, NULL, 10);
+	}
+
+	al_destroy_config(config);
+	return animation;
+}
+
+SYMBOL_EXPORT void ResetSkeletonPose(struct Game* game, struct Skeleton* skeleton) {
+	for (int i = 0; i < skeleton->bone_count; i++) {
+		skeleton->bones[i].pose = skeleton->bones[i].setup;
+	}
+}
+
+SYMBOL_EXPORT void ApplySkeletonAnimation(struct Game* game, struct Skeleton* skeleton, struct SkeletonAnimation* animation, double time, float weight) {
+	int count = MIN(animation->bone_count, skeleton->bone_count);
+	for (int i = 0; i < count; i++) {
+		struct KeyframeTrack* tracks = &animation->tracks[i * SKELETON_PROPERTY_COUNT];
+		for (int j = 0; j < SKELETON_PROPERTY_COUNT; j++) {
+			if (!tracks[j].count) {
+				continue;
+			}
+			float* value = GetPoseProperty(&skeleton->bones[i].pose, j);
+			*value += (EvaluateKeyframeTrack(&tracks[j], time) - *value) * weight;
+		}
+	}
+}
+
+SYMBOL_EXPORT void UpdateSkeleton(struct Game* game, struct Skeleton* skeleton) {
+	// parents always come first, so their transformations are already up to date
+	for (int i = 0; i < skeleton->bone_count; i++) {
+		struct SkeletonBone* bone = &skeleton->bones[i];
+		GetPoseTransform(&bone->pose, &bone->transform);
+		if (bone->parent >= 0) {
+			al_compose_transform(&bone->transform, &skeleton->bones[bone->parent].transform);
+		}
+	}
+}
+
+SYMBOL_EXPORT void PlaySkeletonAnimation(struct Game* game, struct Skeleton* skeleton, struct SkeletonAnimation* animation, double fade) {
+	if (fade > 0.0 && skeleton->playback.animation) {
+		skeleton->playback.previous = skeleton->playback.animation;
+		skeleton->playback.previous_pos = skeleton->playback.pos;
+	} else {
+		skeleton->playback.previous = NULL;
+	}
+	skeleton->playback.animation = animation;
+	skeleton->playback.pos = 0.0;
+	skeleton->playback.fade = 0.0;
+	skeleton->playback.fade_duration = fade;
+	skeleton->playback.finished = false;
+}
+
+static double AdvanceSkeletonAnimation(struct SkeletonAnimation* animation, double pos, double delta, bool* finished) {
+	pos += delta;
+	if (pos >= animation->duration) {
+		if (animation->loop && animation->duration > 0.0) {
+			return fmod(pos, animation->duration);
+		}
+		if (finished) {
+			*finished = true;
+		}
+		return animation->duration;
+	}
+	return pos;
+}
+
+SYMBOL_EXPORT void AnimateSkeleton(struct Game* game, struct Skeleton* skeleton, double delta) {
+	struct SkeletonAnimation* animation = skeleton->playback.animation;
+	ResetSkeletonPose(game, skeleton);
+
+	float weight = 1.0;
+	if (skeleton->playback.previous) {
+		skeleton->playback.fade += delta;
+		if (skeleton->playback.fade >= skeleton->playback.fade_duration) {
+			skeleton->playback.previous = NULL;
+		} else {
+			skeleton->playback.previous_pos = AdvanceSkeletonAnimation(skeleton->playback.previous, skeleton->playback.previous_pos, delta, NULL);
+			ApplySkeletonAnimation(game, skeleton, skeleton->playback.previous, skeleton->playback.previous_pos, 1.0);
+			weight = skeleton->playback.fade / skeleton->playback.fade_duration;
+		}
+	}
+	if (animation) {
+		if (!skeleton->playback.finished) {
+			skeleton->playback.pos = AdvanceSkeletonAnimation(animation, skeleton->playback.pos, delta, &skeleton->playback.finished);
+		}
+		ApplySkeletonAnimation(game, skeleton, animation, skeleton->playback.pos, weight);
+	}
+
+	UpdateSkeleton(game, skeleton);
+}
+
+SYMBOL_EXPORT void DrawSkeleton(struct Game* game, struct Skeleton* skeleton) {
+	if (!skeleton->atlas) {
+		return;
+	}
+	if (skeleton->_priv.vertices_size < skeleton->part_count * 6) {
+		skeleton->_priv.vertices_size = skeleton->part_count * 6;
+		skeleton->_priv.vertices = realloc(skeleton->_priv.vertices, sizeof(ALLEGRO_VERTEX) * skeleton->_priv.vertices_size);
+	}
+
+	int count = 0;
+	for (int i = 0; i < skeleton->part_count; i++) {
+		struct SkeletonPart* part = &skeleton->parts[i];
+		if (part->hidden) {
+			continue;
+		}
+		ALLEGRO_TRANSFORM transform;
+		GetPoseTransform(&part->offset, &transform);
+		al_compose_transform(&transform, &skeleton->bones[part->bone].transform);
+
+		float x1 = -part->sw * part->pivotX, y1 = -part->sh * part->pivotY;
+		float xs[4] = {x1, x1 + part->sw, x1 + part->sw, x1}, ys[4] = {y1, y1, y1 + part->sh, y1 + part->sh};
+		float us[4] = {part->sx, part->sx + part->sw, part->sx + part->sw, part->sx}, vs[4] = {part->sy, part->sy, part->sy + part->sh, part->sy + part->sh};
+		ALLEGRO_VERTEX quad[4];
+		for (int j = 0; j < 4; j++) {
+			al_transform_coordinates(&transform, &xs[j], &ys[j]);
+			quad[j] = (ALLEGRO_VERTEX){.x = xs[j], .y = ys[j], .z = 0, .u = us[j], .v = vs[j], .color = part->tint};
+		}
+
+		ALLEGRO_VERTEX* v = &skeleton->_priv.vertices[count];
+		v[0] = quad[0];
+		v[1] = quad[1];
+		v[2] = quad[2];
+		v[3] = quad[0];
+		v[4] = quad[2];
+		v[5] = quad[3];
+		count += 6;
+	}
+
+	if (count) {
+		al_draw_prim(skeleton->_priv.vertices, NULL, skeleton->atlas, 0, count, ALLEGRO_PRIM_TRIANGLE_LIST);
+		game->_priv.sprites.drawn += count / 6;
+	}
+}
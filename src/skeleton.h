@@ -0,0 +1,139 @@
+/*! \file skeleton.h
+ *  \brief Skeletal (cutout) animation.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This file is part of libsuperderpy.
+ *
+ * libsuperderpy is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libsuperderpy is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libsuperderpy. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Also, ponies.
+ */
+
+#ifndef LIBSUPERDERPY_SKELETON_H
+#define LIBSUPERDERPY_SKELETON_H
+
+#include "keyframes.h"
+#include "libsuperderpy.h"
+
+/*! \brief Bone properties that can be driven by a skeleton animation. */
+typedef enum SKELETON_PROPERTY {
+	SKELETON_X,
+	SKELETON_Y,
+	SKELETON_SCALE_X,
+	SKELETON_SCALE_Y,
+	SKELETON_ANGLE,
+	SKELETON_PROPERTY_COUNT
+} SKELETON_PROPERTY;
+
+/*! \brief Transformation of a bone relative to its parent. */
+struct SkeletonPose {
+	float x;
+	float y;
+	float scaleX;
+	float scaleY;
+	float angle; /*!< Rotation angle (radians). */
+};
+
+struct SkeletonBone {
+	char* name;
+	int parent; /*!< Index of the parent bone, always lower than the bone's own index. -1 for root bones. */
+	struct SkeletonPose setup; /*!< Rest pose, used for properties not driven by the current animation. */
+	struct SkeletonPose pose; /*!< Current pose, updated by AnimateSkeleton. */
+	ALLEGRO_TRANSFORM transform; /*!< Bone-to-skeleton transformation, computed by UpdateSkeleton. */
+};
+
+/*! \brief Region of the skeleton's atlas attached to a bone. */
+struct SkeletonPart {
+	char* name;
+	int bone; /*!< Index of the bone the part is attached to. */
+	float sx, sy, sw, sh; /*!< Region of the atlas, in pixels. */
+	float pivotX; /*!< Pivot point's X, relative of part's size. */
+	float pivotY; /*!< Pivot point's Y, relative of part's size. */
+	struct SkeletonPose offset; /*!< Placement of the pivot relative to the bone. */
+	ALLEGRO_COLOR tint;
+	bool hidden;
+};
+
+/*! \brief Hierarchy of bones stored in parent-first order, with sprite parts drawn from a single atlas. */
+struct Skeleton {
+	char* name;
+	ALLEGRO_BITMAP* atlas; /*!< Bitmap holding all parts, so they can be drawn in one batch. */
+	struct SkeletonBone* bones;
+	int bone_count;
+	struct SkeletonPart* parts; /*!< Parts in drawing order. */
+	int part_count;
+
+	struct {
+		struct SkeletonAnimation* animation; /*!< Currently played animation. NULL if none. */
+		double pos; /*!< Current position in the animation, in seconds. */
+		struct SkeletonAnimation* previous; /*!< Animation being faded out. */
+		double previous_pos;
+		double fade; /*!< Time elapsed since the animation has been started, for crossfading. */
+		double fade_duration;
+		bool finished;
+	} playback;
+
+	struct {
+		char* atlas_file;
+		int bones_size;
+		int parts_size;
+		ALLEGRO_VERTEX* vertices;
+		int vertices_size;
+	} _priv;
+};
+
+/*! \brief Keyframe tracks for bones of a particular skeleton. */
+struct SkeletonAnimation {
+	char* name;
+	int bone_count; /*!< Number of bones the animation has been created for. */
+	struct KeyframeTrack* tracks; /*!< SKELETON_PROPERTY_COUNT tracks for each bone. */
+	double duration; /*!< Length of the animation in seconds. */
+	bool loop; /*!< Whether the animation starts over after reaching its end. */
+};
+
+struct Skeleton* CreateSkeleton(struct Game* game, const char* name, ALLEGRO_BITMAP* atlas);
+/*! \brief Loads the skeleton definition from an ini file, along with its atlas. */
+struct Skeleton* LoadSkeleton(struct Game* game, const char* filename);
+void DestroySkeleton(struct Game* game, struct Skeleton* skeleton);
+
+/*! \brief Appends a bone and returns its index. The parent must have been added before. */
+int AddSkeletonBone(struct Game* game, struct Skeleton* skeleton, const char* name, int parent, struct SkeletonPose setup);
+/*! \brief Attaches a region of the atlas to the bone. Parts are drawn in the order they've been added. */
+int AddSkeletonPart(struct Game* game, struct Skeleton* skeleton, const char* name, int bone, float sx, float sy, float sw, float sh, float pivotX, float pivotY, struct SkeletonPose offset);
+int FindSkeletonBone(struct Skeleton* skeleton, const char* name);
+int FindSkeletonPart(struct Skeleton* skeleton, const char* name);
+
+struct SkeletonAnimation* CreateSkeletonAnimation(struct Game* game, struct Skeleton* skeleton, const char* name);
+/*! \brief Loads animation from an ini file with "time=value [style]" entries in sections named "bone.property", e.g. [arm.angle]. */
+struct SkeletonAnimation* LoadSkeletonAnimation(struct Game* game, struct Skeleton* skeleton, const char* filename);
+void DestroySkeletonAnimation(struct Game* game, struct SkeletonAnimation* animation);
+void AddSkeletonKeyframe(struct Game* game, struct SkeletonAnimation* animation, int bone, SKELETON_PROPERTY property, double time, float value, TWEEN_STYLE style);
+
+/*! \brief Blends the animation sampled at given time into the current pose. Weight of 1 replaces the pose. */
+void ApplySkeletonAnimation(struct Game* game, struct Skeleton* skeleton, struct SkeletonAnimation* animation, double time, float weight);
+/*! \brief Resets all bones to their setup pose. */
+void ResetSkeletonPose(struct Game* game, struct Skeleton* skeleton);
+/*! \brief Computes bone transformations from their current poses in a single pass. */
+void UpdateSkeleton(struct Game* game, struct Skeleton* skeleton);
+
+/*! \brief Starts playing the animation, crossfading from the current one over given time in seconds. */
+void PlaySkeletonAnimation(struct Game* game, struct Skeleton* skeleton, struct SkeletonAnimation* animation, double fade);
+/*! \brief Advances the playback, poses the bones and updates their transformations. */
+void AnimateSkeleton(struct Game* game, struct Skeleton* skeleton, double delta);
+/*! \brief Draws all visible parts with a single draw call, using the current transformation. */
+void DrawSkeleton(struct Game* game, struct Skeleton* skeleton);
+
+#endif /* LIBSUPERDERPY_SKELETON_H */
@@ -0,0 +1,287 @@
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This file is part of libsuperderpy.
+ *
+ * libsuperderpy is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libsuperderpy is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libsuperderpy. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Also, ponies.
+ */
+
+#include "internal.h"
+
+// entries covering more cells than that are kept in a separate list checked by every query
+#define SPATIAL_INDEX_MAX_CELLS 64
+
+// cell coordinates are kept within that range, so spans between them never overflow int
+#define SPATIAL_INDEX_MAX_CELL (1 << 29)
+
+static int GetCell(struct SpatialIndex* index, float coord) {
+	double cell = floor((double)coord / index->cell_size);
+	if (isnan(cell)) {
+		return 0;
+	}
+	if (cell < -SPATIAL_INDEX_MAX_CELL) {
+		return -SPATIAL_INDEX_MAX_CELL;
+	}
+	if (cell > SPATIAL_INDEX_MAX_CELL) {
+		return SPATIAL_INDEX_MAX_CELL;
+	}
+	return (int)cell;
+}
+
+static struct SpatialIndexBucket* GetBucket(struct SpatialIndex* index, int cx, int cy) {
+	unsigned int hash = ((unsigned int)cx * 73856093U) ^ ((unsigned int)cy * 19349663U);
+	return &index->_priv.buckets[hash % LIBSUPERDERPY_SPATIAL_INDEX_BUCKETS];
+}
+
+static bool IsLargeEntry(struct SpatialIndexEntry* entry) {
+	// spans of huge entries overflow int when multiplied
+	return ((double)entry->cx2 - entry->cx1 + 1) * ((double)entry->cy2 - entry->cy1 + 1) > SPATIAL_INDEX_MAX_CELLS;
+}
+
+static void PushToBucket(struct SpatialIndexBucket* bucket, struct SpatialIndexEntry* entry) {
+	if (bucket->count == bucket->size) {
+		bucket->size = bucket->size ? bucket->size * 2 : 8;
+		bucket->entries = realloc(bucket->entries, sizeof(struct SpatialIndexEntry*) * bucket->size);
+	}
+	bucket->entries[bucket->count++] = entry;
+}
+
+static void RemoveFromBucket(struct SpatialIndexBucket* bucket, struct SpatialIndexEntry* entry) {
+	for (int i = 0; i < bucket->count; i++) {
+		if (bucket->entries[i] == entry) {
+			bucket->entries[i] = bucket->entries[--bucket->count];
+			return;
+		}
+	}
+}
+
+static void InsertEntry(struct SpatialIndex* index, struct SpatialIndexEntry* entry) {
+	if (IsLargeEntry(entry)) {
+		PushToBucket(&index->_priv.large, entry);
+		return;
+	}
+	for (int cy = entry->cy1; cy <= entry->cy2; cy++) {
+		for (int cx = entry->cx1; cx <= entry->cx2; cx++) {
+			struct SpatialIndexBucket* bucket = GetBucket(index, cx, cy);
+			// different cells of the same entry can hash into the same bucket
+			if (!bucket->count || bucket->entries[bucket->count - 1] != entry) {
+				PushToBucket(bucket, entry);
+			}
+		}
+	}
+}
+
+static void EraseEntry(struct SpatialIndex* index, struct SpatialIndexEntry* entry) {
+	if (IsLargeEntry(entry)) {
+		RemoveFromBucket(&index->_priv.large, entry);
+		return;
+	}
+	for (int cy = entry->cy1; cy <= entry->cy2; cy++) {
+		for (int cx = entry->cx1; cx <= entry->cx2; cx++) {
+			RemoveFromBucket(GetBucket(index, cx, cy), entry);
+		}
+	}
+}
+
+static void ComputeEntryBounds(struct Game* game, struct SpatialIndex* index, struct SpatialIndexEntry* entry) {
+	GetCharacterBounds(game, entry->character, false, &entry->x1, &entry->y1, &entry->x2, &entry->y2);
+	entry->cx1 = GetCell(index, entry->x1);
+	entry->cy1 = GetCell(index, entry->y1);
+	entry->cx2 = GetCell(index, entry->x2);
+	entry->cy2 = GetCell(index, entry->y2);
+}
+
+static void UpdateEntry(struct Game* game, struct SpatialIndex* index, struct SpatialIndexEntry* entry) {
+	struct SpatialIndexEntry old = *entry;
+	ComputeEntryBounds(game, index, entry);
+	if (old.cx1 == entry->cx1 && old.cy1 == entry->cy1 && old.cx2 == entry->cx2 && old.cy2 == entry->cy2) {
+		return;
+	}
+	struct SpatialIndexEntry current = *entry;
+	*entry = old;
+	EraseEntry(index, entry);
+	*entry = current;
+	InsertEntry(index, entry);
+}
+
+SYMBOL_EXPORT struct SpatialIndex* CreateSpatialIndex(struct Game* game, float cell_size) {
+	if (!(cell_size > 0) || isinf(cell_size)) {
+		PrintConsole(game, "CreateSpatialIndex: invalid cell size %f!", cell_size);
+		return NULL;
+	}
+	struct SpatialIndex* index = calloc(1, sizeof(struct SpatialIndex));
+	index->cell_size = cell_size;
+	return index;
+}
+
+SYMBOL_EXPORT void DestroySpatialIndex(struct Game* game, struct SpatialIndex* index) {
+	for (int i = 0; i < index->_priv.entries.count; i++) {
+		struct SpatialIndexEntry* entry = index->_priv.entries.entries[i];
+		entry->character->spatial.index = NULL;
+		entry->character->spatial.entry = NULL;
+		free(entry);
+	}
+	for (int i = 0; i < LIBSUPERDERPY_SPATIAL_INDEX_BUCKETS; i++) {
+		free(index->_priv.buckets[i].entries);
+	}
+	free(index->_priv.large.entries);
+	free(index->_priv.entries.entries);
+	free(index->_priv.results);
+	free(index);
+}
+
+SYMBOL_EXPORT void AddToSpatialIndex(struct Game* game, struct SpatialIndex* index, struct Character* character) {
+	if (character->spatial.index) {
+		RemoveFromSpatialIndex(game, character->spatial.index, character);
+	}
+	struct SpatialIndexEntry* entry = calloc(1, sizeof(struct SpatialIndexEntry));
+	entry->character = character;
+	entry->order = index->_priv.order++;
+	entry->stamp = index->_priv.stamp;
+	entry->slot = index->_priv.entries.count;
+	PushToBucket(&index->_priv.entries, entry);
+	ComputeEntryBounds(game, index, entry);
+	InsertEntry(index, entry);
+	character->spatial.index = index;
+	character->spatial.entry = entry;
+}
+
+SYMBOL_EXPORT void RemoveFromSpatialIndex(struct Game* game, struct SpatialIndex* index, struct Character* character) {
+	if (character->spatial.index != index) {
+		PrintConsole(game, "%s: character is not registered in the spatial index!", character->name);
+		return;
+	}
+	struct SpatialIndexEntry* entry = character->spatial.entry;
+	EraseEntry(index, entry);
+	struct SpatialIndexEntry* last = index->_priv.entries.entries[--index->_priv.entries.count];
+	index->_priv.entries.entries[entry->slot] = last;
+	last->slot = entry->slot;
+	free(entry);
+	character->spatial.index = NULL;
+	character->spatial.entry = NULL;
+}
+
+SYMBOL_INTERNAL void UpdateCharacterSpatialIndex(struct Game* game, struct Character* character) {
+	if (character->spatial.index) {
+		UpdateEntry(game, character->spatial.index, character->spatial.entry);
+	}
+}
+
+static void VisitBucket(struct SpatialIndex* index, struct SpatialIndexBucket* bucket, float x1, float y1, float x2, float y2, int* count) {
+	for (int i = 0; i < bucket->count; i++) {
+		struct SpatialIndexEntry* entry = bucket->entries[i];
+		if (entry->stamp == index->_priv.stamp) {
+			continue;
+		}
+		entry->stamp = index->_priv.stamp;
+		if (entry->x2 < x1 || entry->x1 > x2 || entry->y2 < y1 || entry->y1 > y2) {
+			continue;
+		}
+		index->_priv.results[(*count)++] = entry->character;
+	}
+}
+
+static int CompareCharacterOrder(const void* a, const void* b) {
+	const struct Character* c1 = *(struct Character* const*)a;
+	const struct Character* c2 = *(struct Character* const*)b;
+	return c1->spatial.entry->order - c2->spatial.entry->order;
+}
+
+SYMBOL_EXPORT void UpdateSpatialIndex(struct Game* game, struct SpatialIndex* index) {
+	for (int i = 0; i < index->_priv.entries.count; i++) {
+		UpdateEntry(game, index, index->_priv.entries.entries[i]);
+	}
+}
+
+SYMBOL_EXPORT int QuerySpatialIndexRect(struct Game* game, struct SpatialIndex* index, float x1, float y1, float x2, float y2, struct Character*** results) {
+	if (index->_priv.results_size < index->_priv.entries.count) {
+		index->_priv.results_size = index->_priv.entries.count;
+		index->_priv.results = realloc(index->_priv.results, sizeof(struct Character*) * index->_priv.results_size);
+	}
+	index->_priv.stamp++;
+	int count = 0;
+
+	VisitBucket(index, &index->_priv.large, x1, y1, x2, y2, &count);
+
+	int cx1 = GetCell(index, x1), cy1 = GetCell(index, y1), cx2 = GetCell(index, x2), cy2 = GetCell(index, y2);
+	if ((double)(cx2 - cx1 + 1) * (cy2 - cy1 + 1) > LIBSUPERDERPY_SPATIAL_INDEX_BUCKETS) {
+		// the area covers more cells than there are buckets, so just scan them all
+		for (int i = 0; i < LIBSUPERDERPY_SPATIAL_INDEX_BUCKETS; i++) {
+			VisitBucket(index, &index->_priv.buckets[i], x1, y1, x2, y2, &count);
+		}
+	} else {
+		for (int cy = cy1; cy <= cy2; cy++) {
+			for (int cx = cx1; cx <= cx2; cx++) {
+				VisitBucket(index, GetBucket(index, cx, cy), x1, y1, x2, y2, &count);
+			}
+		}
+	}
+
+	qsort(index->_priv.results, count, sizeof(struct Character*), CompareCharacterOrder);
+	if (results) {
+		*results = index->_priv.results;
+	}
+	return count;
+}
+
+SYMBOL_EXPORT int QuerySpatialIndexPoint(struct Game* game, struct SpatialIndex* index, float x, float y, bool pixelperfect, struct Character*** results) {
+	struct Character** candidates;
+	int count = QuerySpatialIndexRect(game, index, x, y, x, y, &candidates);
+	int found = 0;
+	for (int i = 0; i < count; i++) {
+		if (IsOnCharacter(game, candidates[i], x, y, pixelperfect)) {
+			candidates[found++] = candidates[i];
+		}
+	}
+	if (results) {
+		*results = candidates;
+	}
+	return found;
+}
+
+SYMBOL_EXPORT struct Character* GetCharacterAt(struct Game* game, struct SpatialIndex* index, float x, float y, bool pixelperfect) {
+	struct Character** candidates;
+	int count = QuerySpatialIndexRect(game, index, x, y, x, y, &candidates);
+	for (int i = count - 1; i >= 0; i--) {
+		if (IsOnCharacter(game, candidates[i], x, y, pixelperfect)) {
+			return candidates[i];
+		}
+	}
+	return NULL;
+}
+
+SYMBOL_EXPORT void DrawSpatialIndex(struct Game* game, struct SpatialIndex* index) {
+	int cx, cy, cw, ch;
+	al_get_clipping_rectangle(&cx, &cy, &cw, &ch);
+
+	ALLEGRO_TRANSFORM transform = *al_get_current_transform();
+	al_invert_transform(&transform);
+	float xs[4] = {cx, cx + cw, cx, cx + cw}, ys[4] = {cy, cy, cy + ch, cy + ch};
+	float x1 = INFINITY, y1 = INFINITY, x2 = -INFINITY, y2 = -INFINITY;
+	for (int i = 0; i < 4; i++) {
+		al_transform_coordinates(&transform, &xs[i], &ys[i]);
+		x1 = fminf(x1, xs[i]);
+		y1 = fminf(y1, ys[i]);
+		x2 = fmaxf(x2, xs[i]);
+		y2 = fmaxf(y2, ys[i]);
+	}
+
+	struct Character** characters;
+	int count = QuerySpatialIndexRect(game, index, x1, y1, x2, y2, &characters);
+	for (int i = 0; i < count; i++) {
+		DrawCharacter(game, characters[i]);
+	}
+}
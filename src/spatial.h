@@ -0,0 +1,95 @@
+/*! \file spatial.h
+ *  \brief Spatial hash for hit testing and culling characters.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This file is part of libsuperderpy.
+ *
+ * libsuperderpy is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libsuperderpy is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libsuperderpy. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Also, ponies.
+ */
+
+#ifndef LIBSUPERDERPY_SPATIAL_H
+#define LIBSUPERDERPY_SPATIAL_H
+
+#include "libsuperderpy.h"
+
+#define LIBSUPERDERPY_SPATIAL_INDEX_BUCKETS 256
+
+/*! \brief Character registered in a spatial index, with its cached world-space bounds. */
+struct SpatialIndexEntry {
+	struct Character* character;
+	float x1, y1, x2, y2; /*!< Axis-aligned bounding box of the character. */
+	int cx1, cy1, cx2, cy2; /*!< Range of cells the entry is stored in. */
+	int order; /*!< Registration order, used to keep query results in drawing order. */
+	unsigned int stamp; /*!< Number of the last query that visited the entry. */
+	int slot; /*!< Position in the index's list of all entries. */
+};
+
+struct SpatialIndexBucket {
+	struct SpatialIndexEntry** entries;
+	int count;
+	int size;
+};
+
+/*! \brief Uniform grid of cells hashed into a fixed number of buckets. */
+struct SpatialIndex {
+	float cell_size; /*!< Size of a grid cell in the character coordinate space. */
+
+	struct {
+		struct SpatialIndexBucket buckets[LIBSUPERDERPY_SPATIAL_INDEX_BUCKETS];
+		struct SpatialIndexBucket large; /*!< Entries spanning too many cells to be hashed. */
+		struct SpatialIndexBucket entries; /*!< All registered entries. */
+		struct Character** results;
+		int results_size;
+		int order;
+		unsigned int stamp;
+	} _priv;
+};
+
+/*! \brief Creates an empty spatial index. Cell size should be close to the size of a typical character.
+ *
+ * Returns NULL when the cell size isn't a positive, finite number.
+ */
+struct SpatialIndex* CreateSpatialIndex(struct Game* game, float cell_size);
+void DestroySpatialIndex(struct Game* game, struct SpatialIndex* index);
+
+/*! \brief Registers a character in the index. A character can be registered in only one index at a time. */
+void AddToSpatialIndex(struct Game* game, struct SpatialIndex* index, struct Character* character);
+void RemoveFromSpatialIndex(struct Game* game, struct SpatialIndex* index, struct Character* character);
+
+/*! \brief Recomputes bounds of all registered characters.
+ *
+ * Characters moved with SetCharacterPosition, MoveCharacter and keyframe animations are updated
+ * automatically; call this after changing scale, angle, parent or other fields directly.
+ */
+void UpdateSpatialIndex(struct Game* game, struct SpatialIndex* index);
+
+/*! \brief Finds characters which bounds intersect given rectangle.
+ *
+ * Returns the number of found characters. Results are stored in registration order in a buffer
+ * owned by the index, valid until the next query.
+ */
+int QuerySpatialIndexRect(struct Game* game, struct SpatialIndex* index, float x1, float y1, float x2, float y2, struct Character*** results);
+/*! \brief Finds characters for which IsOnCharacter returns true at given point. */
+int QuerySpatialIndexPoint(struct Game* game, struct SpatialIndex* index, float x, float y, bool pixelperfect, struct Character*** results);
+/*! \brief Returns the topmost (last registered) character at given point, or NULL. */
+struct Character* GetCharacterAt(struct Game* game, struct SpatialIndex* index, float x, float y, bool pixelperfect);
+
+/*! \brief Draws registered characters in registration order, skipping those outside of the clipping rectangle. */
+void DrawSpatialIndex(struct Game* game, struct SpatialIndex* index);
+
+#endif /* LIBSUPERDERPY_SPATIAL_H */
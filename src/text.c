@@ -0,0 +1,565 @@
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This file is part of libsuperderpy.
+ *
+ * libsuperderpy is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libsuperderpy is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libsuperderpy. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Also, ponies.
+ */
+
+#include "internal.h"
+
+#define TEXT_LAYOUT_EXPIRATION_TIME 1.0
+
+static int GetSubstringWidth(ALLEGRO_FONT* font, const char* text, int length) {
+	ALLEGRO_USTR_INFO info;
+	return al_get_ustr_width(font, al_ref_buffer(&info, text, length));
+}
+
+static void PushLine(struct TextLayout* layout, int* size, int start, int end) {
+	if (layout->lines_count == *size) {
+		*size *= 2;
+		layout->lines = realloc(layout->lines, sizeof(struct TextLayoutLine) * *size);
+	}
+	struct TextLayoutLine* line = &layout->lines[layout->lines_count++];
+	line->start = start;
+	line->length = end - start;
+	line->width = line->length ? GetSubstringWidth(layout->font, layout->text + start, line->length) : 0;
+}
+
+SYMBOL_EXPORT struct TextLayout* CreateTextLayout(ALLEGRO_FONT* font, int width, char const* text) {
+	struct TextLayout* layout = calloc(1, sizeof(struct TextLayout));
+	layout->font = font;
+	layout->width = width;
+	layout->text = strdup(text);
+	layout->line_height = al_get_font_line_height(font) + 1;
+
+	int size = 8;
+	layout->lines = malloc(sizeof(struct TextLayoutLine) * size);
+
+	// spaces and newlines are ASCII, so words can be split on bytes without breaking UTF-8 sequences
+	int len = strlen(layout->text);
+	int pos = 0, start = 0, end = 0, line_width = 0;
+	bool empty = true;
+	const char* str = layout->text;
+
+	while (true) {
+		int word = pos;
+		while (pos < len && str[pos] != ' ' && str[pos] != '\n') {
+			pos++;
+		}
+		if (pos > word) {
+			int word_width = GetSubstringWidth(font, str + word, pos - word);
+			if (empty) {
+				start = word;
+				line_width = word_width;
+				empty = false;
+			} else {
+				// the whole run of spaces between words gets drawn, so measure it as it is
+				int gap = GetSubstringWidth(font, str + end, word - end);
+				if (line_width + gap + word_width > width) {
+					PushLine(layout, &size, start, end);
+					start = word;
+					line_width = word_width;
+				} else {
+					line_width += gap + word_width;
+				}
+			}
+			end = pos;
+		}
+		if (pos >= len) {
+			break;
+		}
+		if (str[pos] == '\n') {
+			if (empty) {
+				start = end = pos;
+			}
+			PushLine(layout, &size, start, end);
+			empty = true;
+			line_width = 0;
+		}
+		pos++;
+	}
+	if (empty) {
+		start = end;
+	}
+	PushLine(layout, &size, start, end);
+
+	return layout;
+}
+
+SYMBOL_EXPORT void DestroyTextLayout(struct TextLayout* layout) {
+	free(layout->lines);
+	free(layout->text);
+	free(layout);
+}
+
+SYMBOL_EXPORT int GetTextLayoutHeight(struct TextLayout* layout) {
+	return layout->lines_count * layout->line_height;
+}
+
+SYMBOL_EXPORT int DrawTextLayout(struct TextLayout* layout, ALLEGRO_COLOR color, float x, float y, int flags) {
+	if (flags & ALLEGRO_ALIGN_RIGHT) {
+		x += layout->width;
+	} else if (flags & ALLEGRO_ALIGN_CENTER) {
+		x += layout->width / 2.0;
+	}
+	for (int i = 0; i < layout->lines_count; i++) {
+		ALLEGRO_USTR_INFO info;
+		struct TextLayoutLine* line = &layout->lines[i];
+		al_draw_ustr(layout->font, color, x, y + i * layout->line_height, flags, al_ref_buffer(&info, layout->text + line->start, line->length));
+	}
+	return GetTextLayoutHeight(layout);
+}
+
+SYMBOL_EXPORT int DrawTextLayoutWithShadow(struct TextLayout* layout, ALLEGRO_COLOR color, float x, float y, int flags) {
+	DrawTextLayout(layout, al_map_rgba(0, 0, 0, 128), x + 1, y + 1, flags);
+	return DrawTextLayout(layout, color, x, y, flags);
+}
+
+static unsigned long HashText(const char* str) {
+	unsigned long hash = 5381;
+	char c = 0;
+
+	while ((c = *str++)) {
+		hash = ((hash << 5) + hash) + c; /* hash * 33 + c */
+	}
+	return hash;
+}
+
+struct TextLayoutKey {
+	ALLEGRO_FONT* font;
+	int width;
+	unsigned long hash;
+	const char* text;
+};
+
+static bool TextLayoutIdentity(struct List* elem, void* data) {
+	struct TextLayout* layout = elem->data;
+	struct TextLayoutKey* key = data;
+	return layout->font == key->font && layout->width == key->width && layout->_priv.hash == key->hash && !strcmp(layout->text, key->text);
+}
+
+SYMBOL_EXPORT struct TextLayout* GetTextLayout(struct Game* game, ALLEGRO_FONT* font, int width, char const* text) {
+	struct TextLayoutKey key = {.font = font, .width = width, .hash = HashText(text), .text = text};
+	int bucket = (key.hash ^ (uintptr_t)font ^ (unsigned int)width) % LIBSUPERDERPY_TEXT_LAYOUT_HASHMAP_BUCKETS;
+
+	al_lock_mutex(game->_priv.mutex);
+	struct TextLayout* layout = NULL;
+	struct List* item = FindInList(game->_priv.text_layouts[bucket], &key, TextLayoutIdentity);
+	if (item) {
+		layout = item->data;
+	} else {
+		layout = CreateTextLayout(font, width, text);
+		layout->_priv.hash = key.hash;
+		game->_priv.text_layouts[bucket] = AddToList(game->_priv.text_layouts[bucket], layout);
+	}
+	layout->_priv.last_used = al_get_time();
+	al_unlock_mutex(game->_priv.mutex);
+
+	return layout;
+}
+
+static void PurgeTextLayouts(struct Game* game, bool all) {
+	double now = al_get_time();
+	al_lock_mutex(game->_priv.mutex);
+	for (int i = 0; i < LIBSUPERDERPY_TEXT_LAYOUT_HASHMAP_BUCKETS; i++) {
+		struct List** item = &game->_priv.text_layouts[i];
+		while (*item) {
+			struct TextLayout* layout = (*item)->data;
+			if (all || now - layout->_priv.last_used > TEXT_LAYOUT_EXPIRATION_TIME) {
+				struct List* next = (*item)->next;
+				DestroyTextLayout(layout);
+				free(*item);
+				*item = next;
+			} else {
+				item = &(*item)->next;
+			}
+		}
+	}
+	al_unlock_mutex(game->_priv.mutex);
+}
+
+SYMBOL_INTERNAL void ExpireTextLayouts(struct Game* game) {
+	PurgeTextLayouts(game, false);
+}
+
+SYMBOL_INTERNAL void ClearTextLayouts(struct Game* game) {
+	PurgeTextLayouts(game, true);
+}
+
+#define TEXT_CACHE_BUCKETS 64
+#define TEXT_CACHE_ATLAS_SIZE 1024
+#define TEXT_CACHE_PADDING 1
+
+struct TextCacheSlot {
+	int x, y, w, h;
+};
+
+struct TextCacheEntry {
+	ALLEGRO_FONT* font;
+	ALLEGRO_COLOR color;
+	int width;
+	int flags;
+	bool shadow;
+	char* text;
+	unsigned long hash;
+	struct TextCacheSlot slot;
+	int ox, oy; /*!< Position of the slot relative to the text origin. */
+	int height; /*!< Height of the text, as returned by the drawing functions. */
+	struct TextCacheEntry *prev, *next; /*!< LRU list, most recently used first. */
+};
+
+struct TextCacheShelf {
+	int y, h, x;
+};
+
+struct TextCache {
+	ALLEGRO_BITMAP* atlas;
+	int size;
+	struct List* buckets[TEXT_CACHE_BUCKETS];
+	struct TextCacheEntry *first, *last;
+	struct TextCacheShelf* shelves;
+	int shelves_count, shelves_size;
+	struct TextCacheSlot* free_slots;
+	int free_count, free_size;
+};
+
+static void UnlinkTextCacheEntry(struct TextCache* cache, struct TextCacheEntry* entry) {
+	if (entry->prev) {
+		entry->prev->next = entry->next;
+	} else {
+		cache->first = entry->next;
+	}
+	if (entry->next) {
+		entry->next->prev = entry->prev;
+	} else {
+		cache->last = entry->prev;
+	}
+	entry->prev = NULL;
+	entry->next = NULL;
+}
+
+static void LinkTextCacheEntry(struct TextCache* cache, struct TextCacheEntry* entry) {
+	entry->prev = NULL;
+	entry->next = cache->first;
+	if (cache->first) {
+		cache->first->prev = entry;
+	}
+	cache->first = entry;
+	if (!cache->last) {
+		cache->last = entry;
+	}
+}
+
+static void EvictTextCacheEntry(struct TextCache* cache, struct TextCacheEntry* entry, bool reuse) {
+	UnlinkTextCacheEntry(cache, entry);
+	RemoveFromList(&cache->buckets[entry->hash % TEXT_CACHE_BUCKETS], entry, NULL);
+	if (reuse) {
+		if (cache->free_count == cache->free_size) {
+			cache->free_size = cache->free_size ? cache->free_size * 2 : 16;
+			cache->free_slots = realloc(cache->free_slots, sizeof(struct TextCacheSlot) * cache->free_size);
+		}
+		cache->free_slots[cache->free_count++] = entry->slot;
+	}
+	free(entry->text);
+	free(entry);
+}
+
+static void ResetTextCache(struct TextCache* cache) {
+	while (cache->first) {
+		EvictTextCacheEntry(cache, cache->first, false);
+	}
+	cache->shelves_count = 0;
+	cache->free_count = 0;
+}
+
+static bool AllocateTextCacheSlot(struct TextCache* cache, int w, int h, struct TextCacheSlot* slot) {
+	// reuse slots freed by evicted entries first, picking the tightest one
+	int best = -1;
+	for (int i = 0; i < cache->free_count; i++) {
+		struct TextCacheSlot* s = &cache->free_slots[i];
+		if (s->w >= w && s->h >= h && (best < 0 || s->w * s->h < cache->free_slots[best].w * cache->free_slots[best].h)) {
+			best = i;
+		}
+	}
+	if (best >= 0) {
+		*slot = (struct TextCacheSlot){.x = cache->free_slots[best].x, .y = cache->free_slots[best].y, .w = w, .h = h};
+		cache->free_slots[best] = cache->free_slots[--cache->free_count];
+		return true;
+	}
+
+	for (int i = 0; i < cache->shelves_count; i++) {
+		struct TextCacheShelf* shelf = &cache->shelves[i];
+		if (shelf->h >= h && shelf->h <= h * 3 / 2 + 2 && shelf->x + w <= cache->size) {
+			*slot = (struct TextCacheSlot){.x = shelf->x, .y = shelf->y, .w = w, .h = h};
+			shelf->x += w;
+			return true;
+		}
+	}
+
+	int y = cache->shelves_count ? (cache->shelves[cache->shelves_count - 1].y + cache->shelves[cache->shelves_count - 1].h) : 0;
+	if (y + h > cache->size || w > cache->size) {
+		return false;
+	}
+	if (cache->shelves_count == cache->shelves_size) {
+		cache->shelves_size = cache->shelves_size ? cache->shelves_size * 2 : 16;
+		cache->shelves = realloc(cache->shelves, sizeof(struct TextCacheShelf) * cache->shelves_size);
+	}
+	cache->shelves[cache->shelves_count++] = (struct TextCacheShelf){.y = y, .h = h, .x = w};
+	*slot = (struct TextCacheSlot){.x = 0, .y = y, .w = w, .h = h};
+	return true;
+}
+
+static bool PlaceInTextCache(struct TextCache* cache, int w, int h, struct TextCacheSlot* slot) {
+	if (w > cache->size || h > cache->size) {
+		return false;
+	}
+	while (!AllocateTextCacheSlot(cache, w, h, slot)) {
+		if (!cache->last) {
+			return false;
+		}
+		EvictTextCacheEntry(cache, cache->last, true);
+		if (!cache->first) {
+			// everything got evicted without finding a fitting slot; start over with an empty atlas
+			ResetTextCache(cache);
+		}
+	}
+	return true;
+}
+
+static float GetLineAlignment(int flags, int width, int line_width) {
+	if (flags & ALLEGRO_ALIGN_RIGHT) {
+		return width - line_width;
+	}
+	if (flags & ALLEGRO_ALIGN_CENTER) {
+		return (width - line_width) / 2.0;
+	}
+	return 0;
+}
+
+static void DrawTextCacheLines(ALLEGRO_FONT* font, ALLEGRO_COLOR color, float x, float y, int flags, struct TextLayout* layout, char const* text) {
+	if (layout) {
+		DrawTextLayout(layout, color, x, y, flags);
+	} else {
+		al_draw_text(font, color, x, y, flags, text);
+	}
+}
+
+static struct TextCacheEntry* CreateTextCacheEntry(struct Game* game, struct TextCache* cache, ALLEGRO_FONT* font, ALLEGRO_COLOR color, int width, int flags, bool shadow, char const* text, unsigned long hash) {
+	struct TextLayout* layout = (width >= 0) ? GetTextLayout(game, font, width, text) : NULL;
+	int lines = layout ? layout->lines_count : 1;
+	int line_height = layout ? layout->line_height : al_get_font_line_height(font);
+
+	// compute the area actually touched by glyphs, relative to the text origin
+	int left = 0, right = 0, top = 0, bottom = 0;
+	for (int i = 0; i < lines; i++) {
+		ALLEGRO_USTR_INFO info;
+		const ALLEGRO_USTR* ustr = layout ? al_ref_buffer(&info, layout->text + layout->lines[i].start, layout->lines[i].length) : al_ref_cstr(&info, text);
+		int advance = layout ? layout->lines[i].width : al_get_ustr_width(font, ustr);
+		int bbx = 0, bby = 0, bbw = 0, bbh = 0;
+		al_get_ustr_dimensions(font, ustr, &bbx, &bby, &bbw, &bbh);
+		float align = layout ? GetLineAlignment(flags, width, advance) : -GetLineAlignment(flags, 0, -advance);
+		int l = floorf(align + MIN(0, bbx));
+		int r = ceilf(align + MAX(advance, bbx + bbw));
+		int t = i * line_height + MIN(0, bby);
+		int b = i * line_height + MAX(line_height, bby + bbh);
+		if (i == 0 || l < left) {
+			left = l;
+		}
+		if (i == 0 || r > right) {
+			right = r;
+		}
+		if (i == 0 || t < top) {
+			top = t;
+		}
+		if (i == 0 || b > bottom) {
+			bottom = b;
+		}
+	}
+	if (shadow) {
+		right++;
+		bottom++;
+	}
+	left -= TEXT_CACHE_PADDING;
+	top -= TEXT_CACHE_PADDING;
+	right += TEXT_CACHE_PADDING;
+	bottom += TEXT_CACHE_PADDING;
+
+	struct TextCacheSlot slot;
+	if (!PlaceInTextCache(cache, right - left, bottom - top, &slot)) {
+		return NULL;
+	}
+
+	struct TextCacheEntry* entry = calloc(1, sizeof(struct TextCacheEntry));
+	entry->font = font;
+	entry->color = color;
+	entry->width = width;
+	entry->flags = flags;
+	entry->shadow = shadow;
+	entry->text = strdup(text);
+	entry->hash = hash;
+	entry->slot = slot;
+	entry->ox = left;
+	entry->oy = top;
+	entry->height = layout ? GetTextLayoutHeight(layout) : line_height;
+
+	ALLEGRO_STATE state;
+	al_store_state(&state, ALLEGRO_STATE_TARGET_BITMAP | ALLEGRO_STATE_TRANSFORM | ALLEGRO_STATE_BLENDER);
+	al_set_target_bitmap(cache->atlas);
+	ALLEGRO_TRANSFORM transform;
+	al_identity_transform(&transform);
+	al_use_transform(&transform);
+	al_set_blender(ALLEGRO_ADD, ALLEGRO_ONE, ALLEGRO_INVERSE_ALPHA);
+	al_set_clipping_rectangle(slot.x, slot.y, slot.w, slot.h);
+	al_clear_to_color(al_map_rgba(0, 0, 0, 0));
+	float x = slot.x - left, y = slot.y - top;
+	if (shadow) {
+		DrawTextCacheLines(font, al_map_rgba(0, 0, 0, 128), x + 1, y + 1, flags, layout, text);
+	}
+	DrawTextCacheLines(font, color, x, y, flags, layout, text);
+	al_reset_clipping_rectangle();
+	al_restore_state(&state);
+
+	LinkTextCacheEntry(cache, entry);
+	cache->buckets[hash % TEXT_CACHE_BUCKETS] = AddToList(cache->buckets[hash % TEXT_CACHE_BUCKETS], entry);
+	return entry;
+}
+
+struct TextCacheKey {
+	ALLEGRO_FONT* font;
+	ALLEGRO_COLOR color;
+	int width;
+	int flags;
+	bool shadow;
+	char const* text;
+	unsigned long hash;
+};
+
+static bool TextCacheIdentity(struct List* elem, void* data) {
+	struct TextCacheEntry* entry = elem->data;
+	struct TextCacheKey* key = data;
+	return entry->hash == key->hash && entry->font == key->font && entry->width == key->width && entry->flags == key->flags && entry->shadow == key->shadow &&
+		entry->color.r == key->color.r && entry->color.g == key->color.g && entry->color.b == key->color.b && entry->color.a == key->color.a &&
+		!strcmp(entry->text, key->text);
+}
+
+static struct TextCacheKey GetTextCacheKey(ALLEGRO_FONT* font, ALLEGRO_COLOR color, int width, int flags, bool shadow, char const* text) {
+	struct TextCacheKey key = {.font = font, .color = color, .width = width, .flags = flags, .shadow = shadow, .text = text};
+	key.hash = HashText(text) ^ (uintptr_t)font ^ ((unsigned long)width << 8) ^ ((unsigned long)flags << 4) ^ shadow;
+	return key;
+}
+
+static struct TextCacheEntry* FindTextCacheEntry(struct TextCache* cache, struct TextCacheKey* key) {
+	struct List* item = FindInList(cache->buckets[key->hash % TEXT_CACHE_BUCKETS], key, TextCacheIdentity);
+	return item ? item->data : NULL;
+}
+
+static int DrawCached(struct Game* game, ALLEGRO_FONT* font, ALLEGRO_COLOR color, float x, float y, int width, int flags, bool shadow, char const* text) {
+	struct TextCache* cache = game->_priv.text_cache;
+	if (!cache) {
+		cache = calloc(1, sizeof(struct TextCache));
+		cache->size = MIN(TEXT_CACHE_ATLAS_SIZE, al_get_display_option(game->display, ALLEGRO_MAX_BITMAP_SIZE));
+		int bitmap_flags = al_get_new_bitmap_flags();
+		al_set_new_bitmap_flags(bitmap_flags & ~ALLEGRO_MEMORY_BITMAP);
+		cache->atlas = al_create_bitmap(cache->size, cache->size);
+		al_set_new_bitmap_flags(bitmap_flags);
+		game->_priv.text_cache = cache;
+	}
+
+	struct TextCacheKey key = GetTextCacheKey(font, color, width, flags, shadow, text);
+	struct TextCacheEntry* entry = FindTextCacheEntry(cache, &key);
+	if (entry) {
+		UnlinkTextCacheEntry(cache, entry);
+		LinkTextCacheEntry(cache, entry);
+	} else if (cache->atlas) {
+		entry = CreateTextCacheEntry(game, cache, font, color, width, flags, shadow, text, key.hash);
+	}
+
+	if (!entry) {
+		// doesn't fit in the atlas; draw it the usual way
+		if (width >= 0) {
+			struct TextLayout* layout = GetTextLayout(game, font, width, text);
+			return shadow ? DrawTextLayoutWithShadow(layout, color, x, y, flags) : DrawTextLayout(layout, color, x, y, flags);
+		}
+		if (shadow) {
+			DrawTextWithShadow(font, color, x, y, flags, text);
+		} else {
+			al_draw_text(font, color, x, y, flags, text);
+		}
+		return al_get_font_line_height(font);
+	}
+
+	if (flags & ALLEGRO_ALIGN_INTEGER) {
+		x = roundf(x);
+		y = roundf(y);
+	}
+	al_draw_bitmap_region(cache->atlas, entry->slot.x, entry->slot.y, entry->slot.w, entry->slot.h, x + entry->ox, y + entry->oy, 0);
+	return entry->height;
+}
+
+SYMBOL_EXPORT void DrawCachedText(struct Game* game, ALLEGRO_FONT* font, ALLEGRO_COLOR color, float x, float y, int flags, char const* text) {
+	DrawCached(game, font, color, x, y, -1, flags, false, text);
+}
+
+SYMBOL_EXPORT void DrawCachedTextWithShadow(struct Game* game, ALLEGRO_FONT* font, ALLEGRO_COLOR color, float x, float y, int flags, char const* text) {
+	DrawCached(game, font, color, x, y, -1, flags, true, text);
+}
+
+SYMBOL_EXPORT int DrawCachedWrappedText(struct Game* game, ALLEGRO_FONT* font, ALLEGRO_COLOR color, float x, float y, int width, int flags, char const* text) {
+	return DrawCached(game, font, color, x, y, width, flags, false, text);
+}
+
+SYMBOL_EXPORT int DrawCachedWrappedTextWithShadow(struct Game* game, ALLEGRO_FONT* font, ALLEGRO_COLOR color, float x, float y, int width, int flags, char const* text) {
+	return DrawCached(game, font, color, x, y, width, flags, true, text);
+}
+
+SYMBOL_INTERNAL bool GetTextCacheSlot(struct Game* game, ALLEGRO_FONT* font, ALLEGRO_COLOR color, int width, int flags, bool shadow, char const* text, int* x, int* y, int* w, int* h) {
+	// doesn't touch the LRU order, so it can be used to inspect the cache without affecting it
+	if (!game->_priv.text_cache) {
+		return false;
+	}
+	struct TextCacheKey key = GetTextCacheKey(font, color, width, flags, shadow, text);
+	struct TextCacheEntry* entry = FindTextCacheEntry(game->_priv.text_cache, &key);
+	if (!entry) {
+		return false;
+	}
+	*x = entry->slot.x;
+	*y = entry->slot.y;
+	*w = entry->slot.w;
+	*h = entry->slot.h;
+	return true;
+}
+
+SYMBOL_INTERNAL void ClearTextCache(struct Game* game) {
+	if (game->_priv.text_cache) {
+		ResetTextCache(game->_priv.text_cache);
+	}
+}
+
+SYMBOL_INTERNAL void DestroyTextCache(struct Game* game) {
+	struct TextCache* cache = game->_priv.text_cache;
+	if (!cache) {
+		return;
+	}
+	ResetTextCache(cache);
+	if (cache->atlas) {
+		al_destroy_bitmap(cache->atlas);
+	}
+	free(cache->shelves);
+	free(cache->free_slots);
+	free(cache);
+	game->_priv.text_cache = NULL;
+}
@@ -0,0 +1,79 @@
+/*! \file text.h
+ *  \brief Text layout and wrapping.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This file is part of libsuperderpy.
+ *
+ * libsuperderpy is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libsuperderpy is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libsuperderpy. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Also, ponies.
+ */
+
+#ifndef LIBSUPERDERPY_TEXT_H
+#define LIBSUPERDERPY_TEXT_H
+
+#include "libsuperderpy.h"
+
+struct TextLayoutLine {
+	int start; /*!< Byte offset of the line in layout's text. */
+	int length; /*!< Length of the line in bytes. */
+	int width; /*!< Width of the line in pixels. */
+};
+
+/*! \brief Line breaks of a text wrapped with given font to given width. */
+struct TextLayout {
+	ALLEGRO_FONT* font;
+	int width; /*!< Width the text has been wrapped to. */
+	char* text; /*!< UTF-8 encoded copy of the text. */
+	int line_height;
+	int lines_count;
+	struct TextLayoutLine* lines;
+
+	struct {
+		unsigned long hash;
+		double last_used;
+	} _priv;
+};
+
+/*! \brief Wraps the text to given width. Newline characters always break the line. */
+struct TextLayout* CreateTextLayout(ALLEGRO_FONT* font, int width, char const* text);
+void DestroyTextLayout(struct TextLayout* layout);
+
+/*! \brief Returns a cached layout of given text, creating it when needed.
+ *
+ * Layouts that haven't been used for a while are freed by the engine, so the returned
+ * pointer shouldn't be kept across frames.
+ */
+struct TextLayout* GetTextLayout(struct Game* game, ALLEGRO_FONT* font, int width, char const* text);
+
+/*! \brief Draws the layout and returns its height in pixels. */
+int DrawTextLayout(struct TextLayout* layout, ALLEGRO_COLOR color, float x, float y, int flags);
+/*! \brief Draws the layout with a shadow, like DrawTextWithShadow. */
+int DrawTextLayoutWithShadow(struct TextLayout* layout, ALLEGRO_COLOR color, float x, float y, int flags);
+int GetTextLayoutHeight(struct TextLayout* layout);
+
+/*! \brief Draws text pre-rendered into a shared texture atlas.
+ *
+ * Meant for static text drawn every frame: after the first call, drawing the same string with
+ * the same font, color and flags is a single textured quad. Least recently used strings are evicted
+ * when the atlas gets full; the cache is flushed when fonts are reloaded.
+ */
+void DrawCachedText(struct Game* game, ALLEGRO_FONT* font, ALLEGRO_COLOR color, float x, float y, int flags, char const* text);
+void DrawCachedTextWithShadow(struct Game* game, ALLEGRO_FONT* font, ALLEGRO_COLOR color, float x, float y, int flags, char const* text);
+int DrawCachedWrappedText(struct Game* game, ALLEGRO_FONT* font, ALLEGRO_COLOR color, float x, float y, int width, int flags, char const* text);
+int DrawCachedWrappedTextWithShadow(struct Game* game, ALLEGRO_FONT* font, ALLEGRO_COLOR color, float x, float y, int width, int flags, char const* text);
+
+#endif /* LIBSUPERDERPY_TEXT_H */
@@ -21,6 +21,11 @@
 
 #include "internal.h"
 #include <ctype.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
 #ifdef ALLEGRO_ANDROID
 #include <android/log.h>
 #endif
@@ -54,68 +59,17 @@ SYMBOL_EXPORT void DrawTextWithShadow(ALLEGRO_FONT* font, ALLEGRO_COLOR color, f
 }
 
 SYMBOL_EXPORT int DrawWrappedText(ALLEGRO_FONT* font, ALLEGRO_COLOR color, float x, float y, int width, int flags, char const* text) {
-	// TODO: use al_do_multiline_text; and switch to al_draw_multiline_text once it returns number of lines
-
-	char stext[1024]; // Copy of the passed text.
-	char* pch = NULL; // A pointer to each word.
-	char word[255]; // A string containing the word (for convienence)
-	char* breakchar = "\n";
-	char lines[40][1024]; // A lovely array of strings to hold all the lines (40 max atm)
-	char temp[1024]; // Holds the string data of the current line only.
-	int line = 0; // Counts which line we are currently using.
-	int height = al_get_font_line_height(font) + 1;
-
-	// Setup our strings
-	strncpy(stext, text, 1023);
-	strncpy(temp, "", 1023);
-	for (int i = 0; i < 40; i += 1) {
-		strncpy(lines[i], "", 1024);
-	}
-	//-------------------- Code Begins
-
-	char* context = NULL;
-
-	pch = strtok_r(stext, " ", &context); // Get the first word.
-	do {
-		snprintf(word, 255, "%s ", pch);
-		strncat(temp, word, 255); // Append the word to the end of TempLine
-		// This code checks for the new line character.
-		if (strncmp(word, breakchar, 1) == 0) {
-			line += 1; // Move down a Line
-			strncpy(temp, "", 1023); // Clear the tempstring
-		} else {
-			if (al_get_text_width(font, temp) >= (width)) { // Check if text is larger than the area.
-				strncpy(temp, word, 255); // clear the templine and add the word to it.
-				line += 1; // Move to the next line.
-			}
-			if (line < 40) {
-				strncat(lines[line], word, 255); // Append the word to whatever line we are currently on.
-			}
-		}
-		pch = strtok_r(NULL, " ", &context); // Get the next word.
-	} while (pch != NULL);
-	// ---------------------------------- Time to draw.
-
-	for (int i = 0; i <= line; i += 1) { // Move through each line and draw according to the passed flags.
-		switch (flags) {
-			case ALLEGRO_ALIGN_CENTER:
-				al_draw_text(font, color, x + (width / 2.0), y + (i * height), ALLEGRO_ALIGN_CENTER, lines[i]);
-				break;
-			case ALLEGRO_ALIGN_RIGHT:
-				al_draw_text(font, color, x + width, y + (i * height), ALLEGRO_ALIGN_RIGHT, lines[i]);
-				break;
-			case ALLEGRO_ALIGN_LEFT:
-			default:
-				al_draw_text(font, color, x, y + (i * height), ALLEGRO_ALIGN_LEFT, lines[i]);
-				break;
-		}
-	}
-	return ((line + 1) * height); // Return the actual height of the text in pixels.
+	struct TextLayout* layout = CreateTextLayout(font, width, text);
+	int height = DrawTextLayout(layout, color, x, y, flags);
+	DestroyTextLayout(layout);
+	return height;
 }
 
 SYMBOL_EXPORT int DrawWrappedTextWithShadow(ALLEGRO_FONT* font, ALLEGRO_COLOR color, float x, float y, int width, int flags, char const* text) {
-	DrawWrappedText(font, al_map_rgba(0, 0, 0, 128), x + 1, y + 1, width, flags, text);
-	return DrawWrappedText(font, color, x, y, width, flags, text);
+	struct TextLayout* layout = CreateTextLayout(font, width, text);
+	int height = DrawTextLayoutWithShadow(layout, color, x, y, flags);
+	DestroyTextLayout(layout);
+	return height;
 }
 
 SYMBOL_EXPORT void DrawCentered(ALLEGRO_BITMAP* bitmap, float x, float y, int flags) {
@@ -165,39 +119,234 @@ SYMBOL_EXPORT ALLEGRO_COLOR InterpolateColor(ALLEGRO_COLOR c1, ALLEGRO_COLOR c2,
 		c1.a + frac * (c2.a - c1.a));
 }
 
-/*! \brief Scales bitmap using software linear filtering method to current target. */
-SYMBOL_EXPORT void ScaleBitmap(ALLEGRO_BITMAP* source, int width, int height) {
-	if ((al_get_bitmap_width(source) == width) && (al_get_bitmap_height(source) == height)) {
-		al_draw_bitmap(source, 0, 0, 0);
-		return;
+// Bitmaps are scaled on raw pixel rows. Bilinear weights have 7 bits of precision, so that products of
+// 8-bit channels fit into 16-bit lanes; the SIMD and scalar paths give identical results.
+
+#define SCALE_WEIGHT_BITS 7
+#define SCALE_WEIGHT_ONE (1 << SCALE_WEIGHT_BITS)
+#define SCALE_PIXEL_FORMAT ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE
+#define SCALE_MIN_ROWS_PER_THREAD 32
+#define SCALE_MAX_THREADS 16
+
+struct ScaleJob {
+	SCALING_FILTER filter;
+	const uint8_t* src;
+	int src_pitch, src_width, src_height;
+	uint8_t* dst;
+	int dst_pitch, dst_width, dst_height;
+	int row_start, row_end;
+	const int* xs; /*!< Left source column of each destination column (bilinear), or start of its box (box). */
+	const int* xw; /*!< Weight of the right source column (bilinear), or end of its box (box). */
+};
+
+static inline uint8_t Lerp7(uint8_t a, uint8_t b, int w) {
+	return (a * (SCALE_WEIGHT_ONE - w) + b * w + SCALE_WEIGHT_ONE / 2) >> SCALE_WEIGHT_BITS;
+}
+
+static void ScaleRowVertical(uint8_t* out, const uint8_t* r0, const uint8_t* r1, int w, int bytes) {
+	int i = 0;
+#if defined(__SSE2__)
+	__m128i zero = _mm_setzero_si128();
+	__m128i w0 = _mm_set1_epi16(SCALE_WEIGHT_ONE - w), w1 = _mm_set1_epi16(w);
+	__m128i round = _mm_set1_epi16(SCALE_WEIGHT_ONE / 2);
+	for (; i + 16 <= bytes; i += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i*)(r0 + i));
+		__m128i b = _mm_loadu_si128((const __m128i*)(r1 + i));
+		__m128i lo = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(a, zero), w0), _mm_mullo_epi16(_mm_unpacklo_epi8(b, zero), w1)), round);
+		__m128i hi = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(a, zero), w0), _mm_mullo_epi16(_mm_unpackhi_epi8(b, zero), w1)), round);
+		_mm_storeu_si128((__m128i*)(out + i), _mm_packus_epi16(_mm_srli_epi16(lo, SCALE_WEIGHT_BITS), _mm_srli_epi16(hi, SCALE_WEIGHT_BITS)));
+	}
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+	uint8x8_t w0 = vdup_n_u8(SCALE_WEIGHT_ONE - w), w1 = vdup_n_u8(w);
+	for (; i + 8 <= bytes; i += 8) {
+		uint16x8_t sum = vmlal_u8(vmull_u8(vld1_u8(r0 + i), w0), vld1_u8(r1 + i), w1);
+		vst1_u8(out + i, vrshrn_n_u16(sum, SCALE_WEIGHT_BITS));
+	}
+#endif
+	for (; i < bytes; i++) {
+		out[i] = Lerp7(r0[i], r1[i], w);
+	}
+}
+
+static void ScaleRowHorizontal(uint8_t* out, const uint8_t* row, const int* xs, const int* xw, int src_width, int width) {
+	int x = 0;
+#if defined(__SSE2__) || defined(__ARM_NEON) || defined(__ARM_NEON__)
+	const uint32_t* pixels = (const uint32_t*)row;
+	for (; x + 2 <= width; x += 2) {
+		int a0 = xs[x], a1 = xs[x + 1];
+		int b0 = MIN(a0 + 1, src_width - 1), b1 = MIN(a1 + 1, src_width - 1);
+#if defined(__SSE2__)
+		__m128i zero = _mm_setzero_si128();
+		__m128i a = _mm_unpacklo_epi8(_mm_unpacklo_epi32(_mm_cvtsi32_si128(pixels[a0]), _mm_cvtsi32_si128(pixels[a1])), zero);
+		__m128i b = _mm_unpacklo_epi8(_mm_unpacklo_epi32(_mm_cvtsi32_si128(pixels[b0]), _mm_cvtsi32_si128(pixels[b1])), zero);
+		__m128i w1 = _mm_unpacklo_epi64(_mm_set1_epi16(xw[x]), _mm_set1_epi16(xw[x + 1]));
+		__m128i w0 = _mm_sub_epi16(_mm_set1_epi16(SCALE_WEIGHT_ONE), w1);
+		__m128i sum = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(a, w0), _mm_mullo_epi16(b, w1)), _mm_set1_epi16(SCALE_WEIGHT_ONE / 2));
+		_mm_storel_epi64((__m128i*)(out + x * 4), _mm_packus_epi16(_mm_srli_epi16(sum, SCALE_WEIGHT_BITS), zero));
+#else
+		uint8x8_t a = vreinterpret_u8_u32(vset_lane_u32(pixels[a1], vdup_n_u32(pixels[a0]), 1));
+		uint8x8_t b = vreinterpret_u8_u32(vset_lane_u32(pixels[b1], vdup_n_u32(pixels[b0]), 1));
+		uint8x8_t w1 = vreinterpret_u8_u32(vset_lane_u32(xw[x + 1] * 0x01010101u, vdup_n_u32(xw[x] * 0x01010101u), 1));
+		uint8x8_t w0 = vsub_u8(vdup_n_u8(SCALE_WEIGHT_ONE), w1);
+		vst1_u8(out + x * 4, vrshrn_n_u16(vmlal_u8(vmull_u8(a, w0), b, w1), SCALE_WEIGHT_BITS));
+#endif
+	}
+#endif
+	for (; x < width; x++) {
+		const uint8_t* a = row + xs[x] * 4;
+		const uint8_t* b = row + MIN(xs[x] + 1, src_width - 1) * 4;
+		for (int c = 0; c < 4; c++) {
+			out[x * 4 + c] = Lerp7(a[c], b[c], xw[x]);
+		}
+	}
+}
+
+static void ScaleRowsBilinear(struct ScaleJob* job) {
+	uint8_t* tmp = malloc(job->src_width * 4);
+	for (int y = job->row_start; y < job->row_end; y++) {
+		// same sampling as the old al_get_pixel based implementation: destination edges map to source edges
+		float pos = ((float)y / job->dst_height) * (job->src_height - 1);
+		int y0 = floorf(pos), y1 = MIN(y0 + 1, job->src_height - 1);
+		int w = (pos - y0) * SCALE_WEIGHT_ONE;
+		ScaleRowVertical(tmp, job->src + y0 * job->src_pitch, job->src + y1 * job->src_pitch, w, job->src_width * 4);
+		ScaleRowHorizontal(job->dst + y * job->dst_pitch, tmp, job->xs, job->xw, job->src_width, job->dst_width);
+	}
+	free(tmp);
+}
+
+static void ScaleRowsBox(struct ScaleJob* job) {
+	uint32_t* sums = malloc(sizeof(uint32_t) * job->src_width * 4);
+	for (int y = job->row_start; y < job->row_end; y++) {
+		int y0 = (int64_t)y * job->src_height / job->dst_height;
+		int y1 = MAX(y0 + 1, (int)((int64_t)(y + 1) * job->src_height / job->dst_height));
+		memset(sums, 0, sizeof(uint32_t) * job->src_width * 4);
+		for (int sy = y0; sy < y1; sy++) {
+			const uint8_t* row = job->src + sy * job->src_pitch;
+			for (int i = 0; i < job->src_width * 4; i++) {
+				sums[i] += row[i];
+			}
+		}
+		uint8_t* out = job->dst + y * job->dst_pitch;
+		for (int x = 0; x < job->dst_width; x++) {
+			uint32_t acc[4] = {0};
+			for (int sx = job->xs[x]; sx < job->xw[x]; sx++) {
+				for (int c = 0; c < 4; c++) {
+					acc[c] += sums[sx * 4 + c];
+				}
+			}
+			uint32_t count = (job->xw[x] - job->xs[x]) * (y1 - y0);
+			for (int c = 0; c < 4; c++) {
+				out[x * 4 + c] = (acc[c] + count / 2) / count;
+			}
+		}
 	}
-	int x = 0, y = 0;
-	al_lock_bitmap(al_get_target_bitmap(), ALLEGRO_PIXEL_FORMAT_ANY, ALLEGRO_LOCK_WRITEONLY);
-	al_lock_bitmap(source, ALLEGRO_PIXEL_FORMAT_ANY, ALLEGRO_LOCK_READONLY);
+	free(sums);
+}
 
-	for (y = 0; y < height; y++) {
-		float pixy = ((float)y / height) * ((float)al_get_bitmap_height(source) - 1);
-		int pixy_f = (int)floorf(pixy);
-		for (x = 0; x < width; x++) {
-			float pixx = ((float)x / width) * ((float)al_get_bitmap_width(source) - 1);
-			int pixx_f = (int)floorf(pixx);
+static void* ScaleThread(ALLEGRO_THREAD* thread, void* arg) {
+	struct ScaleJob* job = arg;
+	if (job->filter == SCALING_FILTER_BOX) {
+		ScaleRowsBox(job);
+	} else {
+		ScaleRowsBilinear(job);
+	}
+	return NULL;
+}
 
-			ALLEGRO_COLOR a = al_get_pixel(source, pixx_f, pixy_f);
-			ALLEGRO_COLOR b = al_get_pixel(source, pixx_f + 1, pixy_f);
-			ALLEGRO_COLOR c = al_get_pixel(source, pixx_f, pixy_f + 1);
-			ALLEGRO_COLOR d = al_get_pixel(source, pixx_f + 1, pixy_f + 1);
+static void ScaleRegion(struct ScaleJob job) {
+	int* xs = malloc(sizeof(int) * job.dst_width);
+	int* xw = malloc(sizeof(int) * job.dst_width);
+	for (int x = 0; x < job.dst_width; x++) {
+		if (job.filter == SCALING_FILTER_BOX) {
+			xs[x] = (int64_t)x * job.src_width / job.dst_width;
+			xw[x] = MAX(xs[x] + 1, (int)((int64_t)(x + 1) * job.src_width / job.dst_width));
+		} else {
+			float pos = ((float)x / job.dst_width) * (job.src_width - 1);
+			xs[x] = floorf(pos);
+			xw[x] = (pos - xs[x]) * SCALE_WEIGHT_ONE;
+		}
+	}
+	job.xs = xs;
+	job.xw = xw;
 
-			ALLEGRO_COLOR ab = InterpolateColor(a, b, pixx - pixx_f);
-			ALLEGRO_COLOR cd = InterpolateColor(c, d, pixx - pixx_f);
-			ALLEGRO_COLOR result = InterpolateColor(ab, cd, pixy - pixy_f);
+	int threads = 1;
+#ifndef LIBSUPERDERPY_SINGLE_THREAD
+	threads = MIN(MIN(al_get_cpu_count(), SCALE_MAX_THREADS), job.dst_height / SCALE_MIN_ROWS_PER_THREAD);
+	threads = MAX(threads, 1);
+#endif
 
-			al_put_pixel(x, y, result);
+	struct ScaleJob jobs[SCALE_MAX_THREADS];
+	ALLEGRO_THREAD* handles[SCALE_MAX_THREADS] = {0};
+	for (int i = 0; i < threads; i++) {
+		jobs[i] = job;
+		jobs[i].row_start = job.dst_height * i / threads;
+		jobs[i].row_end = job.dst_height * (i + 1) / threads;
+	}
+	// the calling thread takes the first chunk itself
+	for (int i = 1; i < threads; i++) {
+		handles[i] = al_create_thread(ScaleThread, &jobs[i]);
+		if (handles[i]) {
+			al_start_thread(handles[i]);
+		} else {
+			ScaleThread(NULL, &jobs[i]);
+		}
+	}
+	ScaleThread(NULL, &jobs[0]);
+	for (int i = 1; i < threads; i++) {
+		if (handles[i]) {
+			al_join_thread(handles[i], NULL);
+			al_destroy_thread(handles[i]);
 		}
 	}
-	al_unlock_bitmap(al_get_target_bitmap());
+
+	free(xs);
+	free(xw);
+}
+
+SYMBOL_EXPORT void ScaleBitmapWithFilter(ALLEGRO_BITMAP* source, int width, int height, SCALING_FILTER filter) {
+	int src_width = al_get_bitmap_width(source), src_height = al_get_bitmap_height(source);
+	if ((src_width == width) && (src_height == height)) {
+		al_draw_bitmap(source, 0, 0, 0);
+		return;
+	}
+	if (filter == SCALING_FILTER_AUTO) {
+		filter = (src_width >= width && src_height >= height) ? SCALING_FILTER_BOX : SCALING_FILTER_BILINEAR;
+	}
+
+	ALLEGRO_BITMAP* target = al_get_target_bitmap();
+	ALLEGRO_LOCKED_REGION* dst = al_lock_bitmap_region(target, 0, 0, width, height, SCALE_PIXEL_FORMAT, ALLEGRO_LOCK_WRITEONLY);
+	if (!dst) {
+		al_draw_scaled_bitmap(source, 0, 0, src_width, src_height, 0, 0, width, height, 0);
+		return;
+	}
+	ALLEGRO_LOCKED_REGION* src = al_lock_bitmap(source, SCALE_PIXEL_FORMAT, ALLEGRO_LOCK_READONLY);
+	if (!src) {
+		al_unlock_bitmap(target);
+		al_draw_scaled_bitmap(source, 0, 0, src_width, src_height, 0, 0, width, height, 0);
+		return;
+	}
+
+	ScaleRegion((struct ScaleJob){
+		.filter = filter,
+		.src = src->data,
+		.src_pitch = src->pitch,
+		.src_width = src_width,
+		.src_height = src_height,
+		.dst = dst->data,
+		.dst_pitch = dst->pitch,
+		.dst_width = width,
+		.dst_height = height,
+	});
+
+	al_unlock_bitmap(target);
 	al_unlock_bitmap(source);
 }
 
+/*! \brief Scales bitmap using software linear filtering method to current target. */
+SYMBOL_EXPORT void ScaleBitmap(ALLEGRO_BITMAP* source, int width, int height) {
+	ScaleBitmapWithFilter(source, width, height, SCALING_FILTER_BILINEAR);
+}
+
 SYMBOL_EXPORT ALLEGRO_BITMAP* LoadScaledBitmap(struct Game* game, char* filename, int width, int height) {
 	bool memoryscale = !strtol(GetConfigOptionDefault(game, "SuperDerpy", "GPU_scaling", "1"), NULL, 10);
 	ALLEGRO_BITMAP *source = NULL, *target = al_create_bitmap(width, height);
@@ -212,7 +361,7 @@ SYMBOL_EXPORT ALLEGRO_BITMAP* LoadScaledBitmap(struct Game* game, char* filename
 	source = al_load_bitmap(GetDataFilePath(game, filename));
 	if (memoryscale) {
 		al_set_new_bitmap_flags(flags);
-		ScaleBitmap(source, width, height);
+		ScaleBitmapWithFilter(source, width, height, SCALING_FILTER_AUTO);
 	} else {
 		al_draw_scaled_bitmap(source, 0, 0, al_get_bitmap_width(source), al_get_bitmap_height(source), 0, 0, width, height, 0);
 	}
@@ -630,6 +779,98 @@ SYMBOL_EXPORT ALLEGRO_BITMAP* CreateNotPreservedBitmap(int width, int height) {
 	return bitmap;
 }
 
+// Unused render targets are kept that long before being destroyed, in seconds.
+#define RENDER_TARGET_EXPIRATION_TIME 5.0
+
+struct RenderTarget {
+	ALLEGRO_BITMAP* bitmap;
+	int width, height, format, flags;
+	bool borrowed;
+	double returned; // time of the last return
+};
+
+static bool RenderTargetBitmapIdentity(struct List* elem, void* data) {
+	struct RenderTarget* target = elem->data;
+	return target->bitmap == data;
+}
+
+SYMBOL_EXPORT ALLEGRO_BITMAP* BorrowRenderTarget(struct Game* game, int width, int height) {
+	int format = al_get_new_bitmap_format(), flags = al_get_new_bitmap_flags() | ALLEGRO_NO_PRESERVE_TEXTURE;
+
+	al_lock_mutex(game->_priv.mutex);
+	for (struct List* item = game->_priv.render_targets; item; item = item->next) {
+		struct RenderTarget* target = item->data;
+		if (!target->borrowed && target->width == width && target->height == height && target->format == format && target->flags == flags) {
+			target->borrowed = true;
+			al_unlock_mutex(game->_priv.mutex);
+			return target->bitmap;
+		}
+	}
+	al_unlock_mutex(game->_priv.mutex);
+
+	ALLEGRO_BITMAP* bitmap = CreateNotPreservedBitmap(width, height);
+	if (!bitmap) {
+		return NULL;
+	}
+	struct RenderTarget* target = calloc(1, sizeof(struct RenderTarget));
+	target->bitmap = bitmap;
+	target->width = width;
+	target->height = height;
+	target->format = format;
+	target->flags = flags;
+	target->borrowed = true;
+
+	al_lock_mutex(game->_priv.mutex);
+	game->_priv.render_targets = AddToList(game->_priv.render_targets, target);
+	al_unlock_mutex(game->_priv.mutex);
+	return bitmap;
+}
+
+SYMBOL_EXPORT void ReturnRenderTarget(struct Game* game, ALLEGRO_BITMAP* bitmap) {
+	if (!bitmap) {
+		return;
+	}
+	al_lock_mutex(game->_priv.mutex);
+	struct List* item = FindInList(game->_priv.render_targets, bitmap, RenderTargetBitmapIdentity);
+	if (item) {
+		struct RenderTarget* target = item->data;
+		target->borrowed = false;
+		target->returned = al_get_time();
+	}
+	al_unlock_mutex(game->_priv.mutex);
+	if (!item) {
+		PrintConsole(game, "Tried to return a bitmap that isn't a pooled render target!");
+		al_destroy_bitmap(bitmap);
+	}
+}
+
+static void PurgeRenderTargets(struct Game* game, bool all) {
+	double now = al_get_time();
+	al_lock_mutex(game->_priv.mutex);
+	struct List** item = &game->_priv.render_targets;
+	while (*item) {
+		struct RenderTarget* target = (*item)->data;
+		if (all || (!target->borrowed && now - target->returned > RENDER_TARGET_EXPIRATION_TIME)) {
+			struct List* next = (*item)->next;
+			al_destroy_bitmap(target->bitmap);
+			free(target);
+			free(*item);
+			*item = next;
+		} else {
+			item = &(*item)->next;
+		}
+	}
+	al_unlock_mutex(game->_priv.mutex);
+}
+
+SYMBOL_INTERNAL void ExpireRenderTargets(struct Game* game) {
+	PurgeRenderTargets(game, false);
+}
+
+SYMBOL_INTERNAL void ClearRenderTargets(struct Game* game) {
+	PurgeRenderTargets(game, true);
+}
+
 SYMBOL_EXPORT void EnableCompositor(struct Game* game, void compositor(struct Game* game)) {
 	PrintConsole(game, "Compositor enabled.");
 	game->_priv.params.handlers.compositor = compositor ? compositor : SimpleCompositor;
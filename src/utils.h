@@ -40,6 +40,10 @@ void DrawHorizontalGradientRect(float x, float y, float w, float h, ALLEGRO_COLO
  */
 void DrawTextWithShadow(ALLEGRO_FONT* font, ALLEGRO_COLOR color, float x, float y, int flags, char const* text);
 
+/*! \brief Draws text wrapped to given width. Returns the height of drawn text.
+ *
+ * The line breaks are computed on every call; use GetTextLayout for text that is drawn every frame.
+ */
 int DrawWrappedText(ALLEGRO_FONT* font, ALLEGRO_COLOR color, float x, float y, int width, int flags, char const* text);
 int DrawWrappedTextWithShadow(ALLEGRO_FONT* font, ALLEGRO_COLOR color, float x, float y, int width, int flags, char const* text);
 
@@ -51,8 +55,17 @@ void DrawFullscreen(ALLEGRO_BITMAP* bitmap, int flags);
 /*! \brief Clears the current target completely, without taking current clipping rectangle into account. */
 void ClearToColor(struct Game* game, ALLEGRO_COLOR color);
 
+typedef enum SCALING_FILTER {
+	SCALING_FILTER_AUTO, /*!< Box filter when downscaling, bilinear otherwise. */
+	SCALING_FILTER_BILINEAR,
+	SCALING_FILTER_BOX, /*!< Averages all source pixels covered by the destination pixel; only useful for downscaling. */
+} SCALING_FILTER;
+
 ALLEGRO_COLOR InterpolateColor(ALLEGRO_COLOR c1, ALLEGRO_COLOR c2, float frac);
+/*! \brief Scales bitmap using software linear filtering method to current target. */
 void ScaleBitmap(ALLEGRO_BITMAP* source, int width, int height);
+/*! \brief Scales bitmap in software to current target, splitting the work across CPU cores. */
+void ScaleBitmapWithFilter(ALLEGRO_BITMAP* source, int width, int height, SCALING_FILTER filter);
 
 /*! \brief Loads bitmap into memory and scales it with software linear filtering. */
 ALLEGRO_BITMAP* LoadScaledBitmap(struct Game* game, char* filename, int width, int height);
@@ -93,6 +106,14 @@ void PopTransform(struct Game* game);
 
 ALLEGRO_BITMAP* CreateNotPreservedBitmap(int width, int height);
 
+/*! \brief Returns a not preserved bitmap of given size, reusing one returned earlier when possible.
+ *
+ * Bitmaps are pooled by their size and the current new bitmap format and flags. Their content is undefined.
+ * Give them back with ReturnRenderTarget instead of destroying them; unused ones are freed after a while.
+ */
+ALLEGRO_BITMAP* BorrowRenderTarget(struct Game* game, int width, int height);
+void ReturnRenderTarget(struct Game* game, ALLEGRO_BITMAP* bitmap);
+
 void EnableCompositor(struct Game* game, void compositor(struct Game* game));
 void DisableCompositor(struct Game* game);
 
@@ -101,6 +122,9 @@ char* StrToLower(struct Game* game, const char* text);
 /*! \brief Converts given string to uppercase. Returns ephemeral string. */
 char* StrToUpper(struct Game* game, const char* text);
 
+/*! \brief Returns a canonical copy of given string, so equal strings can be compared by their pointers. Valid until the engine is destroyed. */
+const char* InternString(struct Game* game, const char* str);
+
 /*! \brief Puts a given number into places in given string marked by given character. Returns ephemeral string. */
 char* PunchNumber(struct Game* game, const char* text, char ch, int number);
 
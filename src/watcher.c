@@ -0,0 +1,257 @@
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This file is part of libsuperderpy.
+ *
+ * libsuperderpy is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libsuperderpy is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libsuperderpy. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Also, ponies.
+ */
+
+#include "internal.h"
+#include <sys/stat.h>
+
+#if defined(__linux__) && !defined(__ANDROID__)
+#define LIBSUPERDERPY_INOTIFY
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+// how often modification times are checked when inotify isn't available, in seconds
+#define FILE_WATCHER_POLL_INTERVAL 1.0
+
+struct WatchedFile {
+	char* path;
+	const char* name; // last path component, as reported by inotify
+	WATCHED_FILE_TYPE type;
+	void* data;
+	time_t mtime;
+	long mtime_nsec;
+	off_t size;
+	int wd;
+	bool changed;
+};
+
+struct FileWatcher {
+	struct List* files;
+	int fd;
+	double last_poll;
+};
+
+// Files saved twice within a second would be missed with the modification time alone.
+static long GetModificationNanoseconds(const struct stat* info) {
+#if defined(__APPLE__)
+	return info->st_mtimespec.tv_nsec;
+#elif defined(_WIN32)
+	return 0;
+#else
+	return info->st_mtim.tv_nsec;
+#endif
+}
+
+static bool IsFileWatcherEnabled(struct Game* game) {
+	return game->config.debug.enabled && game->config.debug.livereload;
+}
+
+static bool WatchedFileIdentity(struct List* elem, void* data) {
+	struct WatchedFile* file = elem->data;
+	return file->data == data;
+}
+
+static struct FileWatcher* GetFileWatcher(struct Game* game) {
+	if (!game->_priv.watcher) {
+		struct FileWatcher* watcher = calloc(1, sizeof(struct FileWatcher));
+		watcher->fd = -1;
+#ifdef LIBSUPERDERPY_INOTIFY
+		watcher->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+		watcher->last_poll = al_get_time();
+		game->_priv.watcher = watcher;
+	}
+	return game->_priv.watcher;
+}
+
+SYMBOL_INTERNAL void WatchFile(struct Game* game, const char* path, WATCHED_FILE_TYPE type, void* data) {
+	if (!IsFileWatcherEnabled(game) || !path) {
+		return;
+	}
+	struct stat info;
+	if (stat(path, &info) != 0) {
+		// not a real file, e.g. packed inside of an archive
+		return;
+	}
+
+	al_lock_mutex(game->_priv.mutex);
+	struct FileWatcher* watcher = GetFileWatcher(game);
+	for (struct List* item = watcher->files; item; item = item->next) {
+		struct WatchedFile* file = item->data;
+		if (file->data == data && file->type == type && !strcmp(file->path, path)) {
+			al_unlock_mutex(game->_priv.mutex);
+			return;
+		}
+	}
+
+	struct WatchedFile* file = calloc(1, sizeof(struct WatchedFile));
+	file->path = strdup(path);
+	const char* slash = strrchr(file->path, '/');
+	file->name = slash ? slash + 1 : file->path;
+	file->type = type;
+	file->data = data;
+	file->mtime = info.st_mtime;
+	file->mtime_nsec = GetModificationNanoseconds(&info);
+	file->size = info.st_size;
+	file->wd = -1;
+#ifdef LIBSUPERDERPY_INOTIFY
+	if (watcher->fd >= 0) {
+		// editors often replace files instead of writing to them, so watch the whole directory
+		char* dir = slash ? strndup(file->path, slash - file->path) : strdup(".");
+		file->wd = inotify_add_watch(watcher->fd, dir[0] ? dir : "/", IN_CLOSE_WRITE | IN_MOVED_TO);
+		free(dir);
+	}
+#endif
+	watcher->files = AddToList(watcher->files, file);
+	al_unlock_mutex(game->_priv.mutex);
+}
+
+SYMBOL_INTERNAL void UnwatchFile(struct Game* game, void* data) {
+	if (!game->_priv.watcher) {
+		return;
+	}
+	al_lock_mutex(game->_priv.mutex);
+	struct WatchedFile* file = NULL;
+	while ((file = RemoveFromList(&game->_priv.watcher->files, data, WatchedFileIdentity))) {
+		free(file->path);
+		free(file);
+	}
+	al_unlock_mutex(game->_priv.mutex);
+}
+
+#ifdef LIBSUPERDERPY_INOTIFY
+static void ReadFileWatcherEvents(struct FileWatcher* watcher) {
+	char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	ssize_t len = 0;
+	while ((len = read(watcher->fd, buf, sizeof(buf))) > 0) {
+		const struct inotify_event* event = NULL;
+		for (char* ptr = buf; ptr < buf + len; ptr += sizeof(struct inotify_event) + event->len) {
+			event = (const struct inotify_event*)ptr;
+			if (!event->len) {
+				continue;
+			}
+			for (struct List* item = watcher->files; item; item = item->next) {
+				struct WatchedFile* file = item->data;
+				if (file->wd == event->wd && !strcmp(file->name, event->name)) {
+					file->changed = true;
+				}
+			}
+		}
+	}
+}
+#endif
+
+static void CheckModificationTimes(struct FileWatcher* watcher) {
+	for (struct List* item = watcher->files; item; item = item->next) {
+		struct WatchedFile* file = item->data;
+		struct stat info;
+		if (stat(file->path, &info) != 0) {
+			continue;
+		}
+		long nsec = GetModificationNanoseconds(&info);
+		if (info.st_mtime != file->mtime || nsec != file->mtime_nsec || info.st_size != file->size) {
+			file->mtime = info.st_mtime;
+			file->mtime_nsec = nsec;
+			file->size = info.st_size;
+			file->changed = true;
+		}
+	}
+}
+
+SYMBOL_INTERNAL void PollWatchedFiles(struct Game* game) {
+	struct FileWatcher* watcher = game->_priv.watcher;
+	if (!watcher) {
+		return;
+	}
+
+	al_lock_mutex(game->_priv.mutex);
+	if (watcher->fd >= 0) {
+#ifdef LIBSUPERDERPY_INOTIFY
+		ReadFileWatcherEvents(watcher);
+#endif
+	} else if (al_get_time() - watcher->last_poll >= FILE_WATCHER_POLL_INTERVAL) {
+		CheckModificationTimes(watcher);
+		watcher->last_poll = al_get_time();
+	}
+	// loading threads can add files at any time, so take the changed ones out while holding the lock
+	int count = 0;
+	for (struct List* item = watcher->files; item; item = item->next) {
+		count += ((struct WatchedFile*)item->data)->changed;
+	}
+	struct WatchedFile** changed = NULL;
+	if (count) {
+		changed = malloc(count * sizeof(struct WatchedFile*));
+		count = 0;
+		for (struct List* item = watcher->files; item; item = item->next) {
+			struct WatchedFile* file = item->data;
+			if (file->changed) {
+				file->changed = false;
+				changed[count++] = file;
+			}
+		}
+	}
+	al_unlock_mutex(game->_priv.mutex);
+
+	// files are only unwatched from the main thread, so they can be reloaded without holding the lock
+	bool shaders = false;
+	for (int i = 0; i < count; i++) {
+		struct WatchedFile* file = changed[i];
+		PrintConsole(game, "File modified: %s", file->path);
+		switch (file->type) {
+			case WATCHED_BITMAP:
+				ReloadBitmap(game, file->data, file->path);
+				break;
+			case WATCHED_SPRITESHEET:
+				ReloadSpritesheet(game, file->data, file->path);
+				break;
+			case WATCHED_SHADER:
+				shaders = true;
+				break;
+		}
+	}
+	free(changed);
+	if (shaders) {
+		// only shaders which sources actually changed get rebuilt, including those using modified includes
+		ReloadModifiedShaders(game);
+	}
+}
+
+SYMBOL_INTERNAL void DestroyFileWatcher(struct Game* game) {
+	struct FileWatcher* watcher = game->_priv.watcher;
+	if (!watcher) {
+		return;
+	}
+	while (watcher->files) {
+		struct List* item = watcher->files;
+		struct WatchedFile* file = item->data;
+		watcher->files = item->next;
+		free(file->path);
+		free(file);
+		free(item);
+	}
+#ifdef LIBSUPERDERPY_INOTIFY
+	if (watcher->fd >= 0) {
+		close(watcher->fd);
+	}
+#endif
+	free(watcher);
+	game->_priv.watcher = NULL;
+}
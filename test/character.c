@@ -99,10 +99,275 @@ static void character_spritesheet_reversed_stops(void** state) {
 	DestroyCharacter(game, character);
 }
 
+static void character_keyframes_interpolate(void** state) {
+	struct Game* game = *state;
+	struct Character* character = CreateCharacter(game, "test");
+	struct KeyframeAnimation* animation = CreateKeyframeAnimation(game, "test");
+	AddKeyframe(game, animation, KEYFRAME_X, 1.0, 100.0, TWEEN_STYLE_LINEAR);
+	AddKeyframe(game, animation, KEYFRAME_X, 0.0, 0.0, TWEEN_STYLE_LINEAR);
+	AddKeyframe(game, animation, KEYFRAME_X, 2.0, 50.0, TWEEN_STYLE_LINEAR);
+	assert_float_equal(animation->duration, 2.0, 0.0001);
+
+	PlayCharacterKeyframes(game, character, animation);
+	assert_float_equal(character->x, 0.0, 0.0001);
+	AnimateCharacter(game, character, 0.5, 1.0);
+	assert_float_equal(character->x, 50.0, 0.0001);
+	AnimateCharacter(game, character, 1.0, 1.0);
+	assert_float_equal(character->x, 75.0, 0.0001);
+	AnimateCharacter(game, character, 1.0, 1.0);
+	assert_float_equal(character->x, 50.0, 0.0001);
+	assert_true(character->keyframes.finished);
+
+	// going backwards has to fall back from the cached segment to the search
+	assert_float_equal(EvaluateKeyframeTrack(&animation->tracks[KEYFRAME_X], 0.25), 25.0, 0.0001);
+
+	DestroyCharacter(game, character);
+	DestroyKeyframeAnimation(game, animation);
+}
+
+static void character_keyframes_hidden(void** state) {
+	struct Game* game = *state;
+	struct Character* character = CreateCharacter(game, "test");
+	struct KeyframeAnimation* animation = CreateKeyframeAnimation(game, "test");
+	AddKeyframe(game, animation, KEYFRAME_X, 0.0, 0.0, TWEEN_STYLE_LINEAR);
+	AddKeyframe(game, animation, KEYFRAME_X, 1.0, 100.0, TWEEN_STYLE_LINEAR);
+
+	PlayCharacterKeyframes(game, character, animation);
+	HideCharacter(game, character);
+	AnimateCharacter(game, character, 0.5, 1.0);
+	ShowCharacter(game, character);
+	assert_float_equal(character->x, 50.0, 0.0001);
+
+	DestroyCharacter(game, character);
+	DestroyKeyframeAnimation(game, animation);
+}
+
+static struct Character* CreateSpatialCharacter(struct Game* game, float x, float y) {
+	struct Character* character = CreateCharacter(game, "test");
+	RegisterSpritesheet(game, character, "animation");
+	SelectSpritesheet(game, character, "animation");
+	character->spritesheet->width = 10;
+	character->spritesheet->height = 10;
+	SetCharacterConfines(game, character, 1000, 1000);
+	SetCharacterPosition(game, character, x, y, 0);
+	return character;
+}
+
+static void character_spatial_index_queries(void** state) {
+	struct Game* game = *state;
+	struct SpatialIndex* index = CreateSpatialIndex(game, 16);
+	struct Character* first = CreateSpatialCharacter(game, 100, 100);
+	struct Character* second = CreateSpatialCharacter(game, 500, 500);
+	AddToSpatialIndex(game, index, first);
+	AddToSpatialIndex(game, index, second);
+
+	struct Character** results;
+	assert_int_equal(QuerySpatialIndexRect(game, index, 90, 90, 110, 110, &results), 1);
+	assert_ptr_equal(results[0], first);
+	assert_ptr_equal(GetCharacterAt(game, index, 501, 502, false), second);
+	assert_null(GetCharacterAt(game, index, 300, 300, false));
+
+	// moving the character has to update the index
+	SetCharacterPosition(game, second, 102, 102, 0);
+	assert_int_equal(QuerySpatialIndexRect(game, index, 90, 90, 110, 110, &results), 2);
+	assert_ptr_equal(results[0], first);
+	assert_ptr_equal(results[1], second);
+	assert_ptr_equal(GetCharacterAt(game, index, 101, 101, false), second);
+	assert_null(GetCharacterAt(game, index, 501, 502, false));
+
+	DestroyCharacter(game, second);
+	assert_int_equal(QuerySpatialIndexRect(game, index, 0, 0, 1000, 1000, &results), 1);
+	assert_ptr_equal(GetCharacterAt(game, index, 101, 101, false), first);
+
+	DestroySpatialIndex(game, index);
+	assert_null(first->spatial.index);
+	DestroyCharacter(game, first);
+}
+
+static void character_spatial_index_extremes(void** state) {
+	struct Game* game = *state;
+	assert_null(CreateSpatialIndex(game, 0));
+	assert_null(CreateSpatialIndex(game, -16));
+	assert_null(CreateSpatialIndex(game, NAN));
+
+	// coordinates far out of the int range of cells mustn't overflow
+	struct SpatialIndex* index = CreateSpatialIndex(game, 1e-30F);
+	struct Character* character = CreateSpatialCharacter(game, 100, 100);
+	AddToSpatialIndex(game, index, character);
+	assert_ptr_equal(GetCharacterAt(game, index, 101, 101, false), character);
+	assert_int_equal(QuerySpatialIndexRect(game, index, -INFINITY, -INFINITY, INFINITY, INFINITY, NULL), 1);
+	QuerySpatialIndexRect(game, index, NAN, NAN, NAN, NAN, NULL);
+	DestroySpatialIndex(game, index);
+
+	index = CreateSpatialIndex(game, 16);
+	AddToSpatialIndex(game, index, character);
+	assert_int_equal(QuerySpatialIndexRect(game, index, -1e38F, -1e38F, 1e38F, 1e38F, NULL), 1);
+	assert_null(GetCharacterAt(game, index, 1e38F, 1e38F, false));
+	DestroySpatialIndex(game, index);
+	DestroyCharacter(game, character);
+}
+
+static void character_shared_spritesheets(void** state) {
+	struct Game* game = *state;
+	struct Character* first = CreateSharedCharacter(game, "test");
+	struct Character* second = CreateSharedCharacter(game, "test");
+	RegisterSpritesheet(game, first, "animation");
+	RegisterSpritesheet(game, second, "animation");
+	assert_non_null(first->spritesheets);
+	assert_ptr_equal(first->spritesheets, second->spritesheets);
+	assert_null(first->spritesheets->next);
+
+	SelectSpritesheet(game, first, "animation");
+	SelectSpritesheet(game, second, "animation");
+	AnimateCharacter(game, first, 0.1, 1.0);
+	assert_int_equal(first->pos, 1);
+	assert_int_equal(second->pos, 0);
+
+	DestroyCharacter(game, first);
+	AnimateCharacter(game, second, 0.1, 1.0);
+	assert_int_equal(second->pos, 1);
+	DestroyCharacter(game, second);
+}
+
+static void character_spritesheet_ids(void** state) {
+	struct Game* game = *state;
+	struct Character* character = CreateCharacter(game, "test");
+	RegisterSpritesheet(game, character, "animation");
+
+	char name[] = "animation";
+	const char* id = InternString(game, name);
+	assert_ptr_not_equal(id, name);
+	assert_ptr_equal(id, InternString(game, "animation"));
+	assert_ptr_equal(GetSpritesheetByID(game, character, id), GetSpritesheet(game, character, "animation"));
+	assert_null(GetSpritesheet(game, character, "missing"));
+
+	SelectSpritesheetByID(game, character, id, true);
+	assert_ptr_equal(character->spritesheet->_priv.id, id);
+	assert_int_equal(character->pos, 2);
+
+	DestroyCharacter(game, character);
+}
+
+static void WriteLazySpritesheet(const char* name) {
+	char path[255];
+	snprintf(path, 255, "data/sprites/test/%s.png", name);
+	ALLEGRO_BITMAP* bitmap = al_create_bitmap(8, 8);
+	al_save_bitmap(path, bitmap);
+	al_destroy_bitmap(bitmap);
+	snprintf(path, 255, "data/sprites/test/%s.ini", name);
+	FILE* file = fopen(path, "we");
+	fprintf(file, "[animation]\nframes=1\nfile=%s.png\n", name);
+	fclose(file);
+}
+
+static void RemoveLazySpritesheet(const char* name) {
+	char path[255];
+	snprintf(path, 255, "data/sprites/test/%s.png", name);
+	unlink(path);
+	snprintf(path, 255, "data/sprites/test/%s.ini", name);
+	unlink(path);
+}
+
+static void character_reversed_successor(void** state) {
+	struct Game* game = *state;
+	FILE* file = fopen("data/sprites/test/chained.ini", "we");
+	fputs("[animation]\nduration=100\nframes=1\nrepeats=0\nfile=dummy\nsuccessor=-animation\n", file);
+	fclose(file);
+
+	struct Character* character = CreateCharacter(game, "test");
+	RegisterSpritesheet(game, character, "animation");
+	RegisterSpritesheet(game, character, "chained");
+	SelectSpritesheet(game, character, "chained");
+	assert_string_equal(character->successor, "-animation");
+
+	AnimateCharacter(game, character, 0.1, 1.0);
+	assert_ptr_equal(character->spritesheet, GetSpritesheet(game, character, "animation"));
+	assert_true(character->reversed);
+	assert_int_equal(character->pos, 2);
+
+	DestroyCharacter(game, character);
+	unlink("data/sprites/test/chained.ini");
+}
+
+static void character_lazy_copies(void** state) {
+	struct Game* game = *state;
+	WriteLazySpritesheet("first");
+	WriteLazySpritesheet("second");
+	WriteLazySpritesheet("third");
+
+	struct Character* character = CreateCharacter(game, "test");
+	character->lazy.enabled = true;
+	character->lazy.budget = 1;
+	RegisterSpritesheet(game, character, "third");
+	RegisterSpritesheet(game, character, "second");
+	RegisterSpritesheet(game, character, "first");
+	LoadSpritesheets(game, character, NULL);
+	assert_true(GetSpritesheet(game, character, "first")->_priv.loaded);
+
+	SelectSpritesheet(game, character, "third");
+	struct Character* copy = CreateCharacter(game, "test");
+	CopyCharacter(game, character, copy);
+
+	// over budget, but the copy still displays the spritesheet being switched away from
+	SelectSpritesheet(game, character, "second");
+	assert_true(GetSpritesheet(game, character, "third")->_priv.loaded);
+	assert_false(GetSpritesheet(game, character, "first")->_priv.loaded);
+	assert_true(GetSpritesheet(game, character, "second")->_priv.loaded);
+	DrawCharacter(game, copy);
+	assert_non_null(copy->frame->_priv.image);
+
+	DestroyCharacter(game, copy);
+	DestroyCharacter(game, character);
+	RemoveLazySpritesheet("first");
+	RemoveLazySpritesheet("second");
+	RemoveLazySpritesheet("third");
+}
+
+static void character_skeleton_pose(void** state) {
+	struct Game* game = *state;
+	struct Skeleton* skeleton = CreateSkeleton(game, "test", NULL);
+	struct SkeletonPose pose = {.x = 0, .y = 0, .scaleX = 1, .scaleY = 1, .angle = 0};
+	int root = AddSkeletonBone(game, skeleton, "root", -1, pose);
+	pose.x = 10;
+	int arm = AddSkeletonBone(game, skeleton, "arm", root, pose);
+	assert_int_equal(FindSkeletonBone(skeleton, "arm"), arm);
+
+	struct SkeletonAnimation* move = CreateSkeletonAnimation(game, skeleton, "move");
+	AddSkeletonKeyframe(game, move, root, SKELETON_X, 0.0, 0.0, TWEEN_STYLE_LINEAR);
+	AddSkeletonKeyframe(game, move, root, SKELETON_X, 1.0, 100.0, TWEEN_STYLE_LINEAR);
+
+	PlaySkeletonAnimation(game, skeleton, move, 0.0);
+	AnimateSkeleton(game, skeleton, 0.5);
+	float x = 0, y = 0;
+	al_transform_coordinates(&skeleton->bones[arm].transform, &x, &y);
+	assert_float_equal(x, 60.0, 0.001);
+	assert_float_equal(y, 0.0, 0.001);
+
+	// halfway through the crossfade both animations contribute equally
+	struct SkeletonAnimation* idle = CreateSkeletonAnimation(game, skeleton, "idle");
+	AddSkeletonKeyframe(game, idle, root, SKELETON_X, 0.0, 0.0, TWEEN_STYLE_LINEAR);
+	PlaySkeletonAnimation(game, skeleton, idle, 1.0);
+	AnimateSkeleton(game, skeleton, 0.5);
+	assert_float_equal(skeleton->bones[root].pose.x, 50.0, 0.001);
+
+	DestroySkeletonAnimation(game, idle);
+	DestroySkeletonAnimation(game, move);
+	DestroySkeleton(game, skeleton);
+}
+
 int test_character(void) {
 	const struct CMUnitTest character_tests[] = {
 		cmocka_unit_test(character_spritesheet_stops),
 		cmocka_unit_test(character_spritesheet_reversed_stops),
+		cmocka_unit_test(character_keyframes_interpolate),
+		cmocka_unit_test(character_keyframes_hidden),
+		cmocka_unit_test(character_spatial_index_queries),
+		cmocka_unit_test(character_spatial_index_extremes),
+		cmocka_unit_test(character_shared_spritesheets),
+		cmocka_unit_test(character_spritesheet_ids),
+		cmocka_unit_test(character_reversed_successor),
+		cmocka_unit_test(character_lazy_copies),
+		cmocka_unit_test(character_skeleton_pose),
 	};
 	return cmocka_run_group_tests(character_tests, character_setup, character_teardown);
 }
@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This file is part of libsuperderpy.
+ *
+ * libsuperderpy is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libsuperderpy is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libsuperderpy. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Also, ponies.
+ */
+
+#include "tests.h"
+
+// -----------------------------------------
+
+static struct Gamestate* gamestate = NULL;
+
+static int gamestate_setup(void** state) {
+	int ret = engine_setup(state);
+	struct Game* game = *state;
+	gamestate = AllocateGamestate(game, "test");
+	game->_priv.current_gamestate = gamestate;
+	SetCurrentGamestateStatic(game, true);
+	return ret;
+}
+
+static int gamestate_teardown(void** state) {
+	struct Game* game = *state;
+	game->_priv.current_gamestate = NULL;
+	free(gamestate->name);
+	free(gamestate);
+	gamestate = NULL;
+	return engine_teardown(state);
+}
+
+// -----------------------------------------
+
+static void gamestate_invalidate_rect_union(void** state) {
+	struct Game* game = *state;
+	gamestate->cache.valid = true;
+	gamestate->cache.dirty = false;
+
+	InvalidateCurrentGamestateRect(game, 10, 20, 5, 5);
+	assert_true(gamestate->cache.dirty);
+	assert_float_equal(gamestate->cache.x1, 10, 0.001);
+	assert_float_equal(gamestate->cache.y1, 20, 0.001);
+	assert_float_equal(gamestate->cache.x2, 15, 0.001);
+	assert_float_equal(gamestate->cache.y2, 25, 0.001);
+
+	InvalidateCurrentGamestateRect(game, 2, 22, 3, 10);
+	assert_float_equal(gamestate->cache.x1, 2, 0.001);
+	assert_float_equal(gamestate->cache.y1, 20, 0.001);
+	assert_float_equal(gamestate->cache.x2, 15, 0.001);
+	assert_float_equal(gamestate->cache.y2, 32, 0.001);
+
+	// a rect inside of the dirty one doesn't change it
+	InvalidateCurrentGamestateRect(game, 5, 25, 1, 1);
+	assert_float_equal(gamestate->cache.x1, 2, 0.001);
+	assert_float_equal(gamestate->cache.y1, 20, 0.001);
+	assert_float_equal(gamestate->cache.x2, 15, 0.001);
+	assert_float_equal(gamestate->cache.y2, 32, 0.001);
+
+	// a redraw resets the union
+	gamestate->cache.dirty = false;
+	InvalidateCurrentGamestateRect(game, 100, 100, 1, 1);
+	assert_float_equal(gamestate->cache.x1, 100, 0.001);
+	assert_float_equal(gamestate->cache.x2, 101, 0.001);
+	assert_true(gamestate->cache.valid);
+}
+
+static void gamestate_dirty_rect_rounds_out(void** state) {
+	struct Game* game = *state;
+	gamestate->cache.dirty = false;
+	InvalidateCurrentGamestateRect(game, 10.5, 20.25, 5.0, 4.5);
+	int x = 0, y = 0, w = 0, h = 0;
+	GetGamestateDirtyRect(gamestate, &x, &y, &w, &h);
+	// covers 10.5..15.5 and 20.25..24.75, including the partially covered pixels
+	assert_int_equal(x, 10);
+	assert_int_equal(y, 20);
+	assert_int_equal(w, 6);
+	assert_int_equal(h, 5);
+
+	gamestate->cache.dirty = false;
+	InvalidateCurrentGamestateRect(game, -0.5, -1.5, 1.0, 1.0);
+	GetGamestateDirtyRect(gamestate, &x, &y, &w, &h);
+	assert_int_equal(x, -1);
+	assert_int_equal(y, -2);
+	assert_int_equal(w, 2);
+	assert_int_equal(h, 2);
+}
+
+static void gamestate_invalidate_full(void** state) {
+	struct Game* game = *state;
+	gamestate->cache.valid = true;
+	gamestate->cache.dirty = false;
+	InvalidateCurrentGamestateRect(game, 0, 0, 1, 1);
+
+	// an invalid cache gets redrawn as a whole, regardless of the dirty rect
+	InvalidateCurrentGamestate(game);
+	assert_false(gamestate->cache.valid);
+	assert_true(gamestate->cache.enabled);
+}
+
+int test_gamestate(void) {
+	const struct CMUnitTest gamestate_tests[] = {
+		cmocka_unit_test(gamestate_invalidate_rect_union),
+		cmocka_unit_test(gamestate_dirty_rect_rounds_out),
+		cmocka_unit_test(gamestate_invalidate_full),
+	};
+	return cmocka_run_group_tests(gamestate_tests, gamestate_setup, gamestate_teardown);
+}
@@ -40,7 +40,7 @@ int main(int argc, char** argv) {
 		return 1;
 	}
 	libsuperderpy_start(game);
-	int ret = test_timeline() || test_character();
+	int ret = test_timeline() || test_character() || test_text() || test_gamestate();
 	libsuperderpy_destroy(game);
 	return ret;
 }
@@ -38,5 +38,7 @@ int engine_setup(void** state);
 int engine_teardown(void** state);
 int test_timeline(void);
 int test_character(void);
+int test_text(void);
+int test_gamestate(void);
 
 #endif
@@ -0,0 +1,232 @@
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This file is part of libsuperderpy.
+ *
+ * libsuperderpy is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libsuperderpy is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libsuperderpy. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Also, ponies.
+ */
+
+#include "tests.h"
+#include <stdio.h>
+
+// -----------------------------------------
+
+// every glyph of the builtin font is 8 pixels wide
+static ALLEGRO_FONT* font = NULL;
+
+static int text_setup(void** state) {
+	font = al_create_builtin_font();
+	return engine_setup(state);
+}
+
+static int text_teardown(void** state) {
+	struct Game* game = *state;
+	ClearTextLayouts(game);
+	ClearTextCache(game);
+	al_destroy_font(font);
+	font = NULL;
+	return engine_teardown(state);
+}
+
+// -----------------------------------------
+
+static void text_layout_wraps_words(void** state) {
+	struct TextLayout* layout = CreateTextLayout(font, 40, "aa bb cc");
+	assert_int_equal(layout->lines_count, 2);
+	assert_int_equal(layout->lines[0].start, 0);
+	assert_int_equal(layout->lines[0].length, 5);
+	assert_int_equal(layout->lines[0].width, 40);
+	assert_int_equal(layout->lines[1].start, 6);
+	assert_int_equal(layout->lines[1].length, 2);
+	assert_int_equal(layout->lines[1].width, 16);
+	DestroyTextLayout(layout);
+}
+
+static void text_layout_measures_spaces(void** state) {
+	// "aa   bb" is 56 pixels wide, so it can't fit in 40 even though "aa bb" would
+	struct TextLayout* layout = CreateTextLayout(font, 40, "aa   bb");
+	assert_int_equal(layout->lines_count, 2);
+	assert_int_equal(layout->lines[0].length, 2);
+	assert_int_equal(layout->lines[1].start, 5);
+	assert_int_equal(layout->lines[1].length, 2);
+	DestroyTextLayout(layout);
+
+	layout = CreateTextLayout(font, 56, "aa   bb");
+	assert_int_equal(layout->lines_count, 1);
+	assert_int_equal(layout->lines[0].length, 7);
+	assert_int_equal(layout->lines[0].width, 56);
+	DestroyTextLayout(layout);
+}
+
+static void text_layout_breaks_newlines(void** state) {
+	struct TextLayout* layout = CreateTextLayout(font, 1000, "aa\n\nbb");
+	assert_int_equal(layout->lines_count, 3);
+	assert_int_equal(layout->lines[0].length, 2);
+	assert_int_equal(layout->lines[1].length, 0);
+	assert_int_equal(layout->lines[1].width, 0);
+	assert_int_equal(layout->lines[2].start, 4);
+	assert_int_equal(layout->lines[2].length, 2);
+	assert_int_equal(GetTextLayoutHeight(layout), 3 * layout->line_height);
+	DestroyTextLayout(layout);
+}
+
+static void text_layout_overlong_word(void** state) {
+	// words wider than the layout get a line of their own
+	struct TextLayout* layout = CreateTextLayout(font, 16, "a abcdef b");
+	assert_int_equal(layout->lines_count, 3);
+	assert_int_equal(layout->lines[1].start, 2);
+	assert_int_equal(layout->lines[1].length, 6);
+	assert_int_equal(layout->lines[1].width, 48);
+	DestroyTextLayout(layout);
+}
+
+static void text_layout_cache_hits(void** state) {
+	struct Game* game = *state;
+	char text[] = "cached layout";
+	struct TextLayout* layout = GetTextLayout(game, font, 40, text);
+	assert_ptr_equal(GetTextLayout(game, font, 40, text), layout);
+	// the cache compares contents, not pointers
+	assert_ptr_equal(GetTextLayout(game, font, 40, "cached layout"), layout);
+	assert_ptr_not_equal(GetTextLayout(game, font, 48, text), layout);
+	assert_ptr_not_equal(GetTextLayout(game, font, 40, "cached layouts"), layout);
+
+	ClearTextLayouts(game);
+	layout = GetTextLayout(game, font, 40, text);
+	assert_int_equal(layout->width, 40);
+	assert_string_equal(layout->text, text);
+}
+
+struct Slot {
+	int x, y, w, h;
+};
+
+static bool GetSlot(struct Game* game, ALLEGRO_FONT* f, int width, char const* text, struct Slot* slot) {
+	return GetTextCacheSlot(game, f, al_map_rgb(255, 255, 255), width, 0, false, text, &slot->x, &slot->y, &slot->w, &slot->h);
+}
+
+static void text_cache_packs_shelves(void** state) {
+	struct Game* game = *state;
+	ClearTextCache(game);
+	struct Slot first, second, wrapped;
+	DrawCachedText(game, font, al_map_rgb(255, 255, 255), 0, 0, 0, "first");
+	DrawCachedText(game, font, al_map_rgb(255, 255, 255), 0, 0, 0, "second");
+	DrawCachedWrappedText(game, font, al_map_rgb(255, 255, 255), 0, 0, 40, 0, "aaaa bbbb");
+	assert_true(GetSlot(game, font, -1, "first", &first));
+	assert_true(GetSlot(game, font, -1, "second", &second));
+	assert_true(GetSlot(game, font, 40, "aaaa bbbb", &wrapped));
+
+	// texts of the same height share a shelf, one after another
+	assert_int_equal(first.x, 0);
+	assert_int_equal(first.y, 0);
+	assert_int_equal(second.y, first.y);
+	assert_int_equal(second.x, first.x + first.w);
+	assert_true(second.w > first.w);
+
+	// two lines don't fit on the shelf of a single one
+	assert_true(wrapped.h > first.h);
+	assert_int_equal(wrapped.x, 0);
+	assert_true(wrapped.y >= first.y + first.h);
+}
+
+static void text_cache_evicts_least_recent(void** state) {
+	struct Game* game = *state;
+	ClearTextCache(game);
+	ALLEGRO_COLOR color = al_map_rgb(255, 255, 255);
+
+	// texts of equal length, so a freed slot always fits the next one
+	char filler[121];
+	memset(filler, 'x', 120);
+	filler[120] = '\0';
+	char text[128];
+	struct Slot oldest, evicted, slot;
+
+	snprintf(text, sizeof(text), "%04d%s", 0, filler);
+	DrawCachedText(game, font, color, 0, 0, 0, text);
+	assert_true(GetSlot(game, font, -1, text, &oldest));
+	snprintf(text, sizeof(text), "%04d%s", 1, filler);
+	DrawCachedText(game, font, color, 0, 0, 0, text);
+	assert_true(GetSlot(game, font, -1, text, &evicted));
+
+	int i = 2;
+	for (; i < 10000; i++) {
+		// keep the first text in use, so the second one becomes the least recently used
+		snprintf(text, sizeof(text), "%04d%s", 0, filler);
+		DrawCachedText(game, font, color, 0, 0, 0, text);
+		snprintf(text, sizeof(text), "%04d%s", i, filler);
+		DrawCachedText(game, font, color, 0, 0, 0, text);
+		snprintf(text, sizeof(text), "%04d%s", 1, filler);
+		if (!GetSlot(game, font, -1, text, &slot)) {
+			break;
+		}
+	}
+	assert_true(i < 10000);
+
+	snprintf(text, sizeof(text), "%04d%s", 0, filler);
+	assert_true(GetSlot(game, font, -1, text, &slot));
+	assert_int_equal(slot.x, oldest.x);
+	assert_int_equal(slot.y, oldest.y);
+
+	// the newest text took the slot of the evicted one, nothing else had to go
+	snprintf(text, sizeof(text), "%04d%s", i, filler);
+	assert_true(GetSlot(game, font, -1, text, &slot));
+	assert_int_equal(slot.x, evicted.x);
+	assert_int_equal(slot.y, evicted.y);
+	snprintf(text, sizeof(text), "%04d%s", 2, filler);
+	assert_true(GetSlot(game, font, -1, text, &slot));
+}
+
+static void text_cache_font_changes(void** state) {
+	struct Game* game = *state;
+	ClearTextCache(game);
+	ALLEGRO_FONT* other = al_create_builtin_font();
+	struct Slot slot, other_slot;
+
+	DrawCachedText(game, font, al_map_rgb(255, 255, 255), 0, 0, 0, "font");
+	assert_true(GetSlot(game, font, -1, "font", &slot));
+	assert_false(GetSlot(game, other, -1, "font", &other_slot));
+	assert_false(GetTextCacheSlot(game, font, al_map_rgb(255, 0, 0), -1, 0, false, "font", &other_slot.x, &other_slot.y, &other_slot.w, &other_slot.h));
+
+	DrawCachedText(game, other, al_map_rgb(255, 255, 255), 0, 0, 0, "font");
+	assert_true(GetSlot(game, other, -1, "font", &other_slot));
+	assert_true(other_slot.x != slot.x || other_slot.y != slot.y);
+
+	// the engine flushes the cache whenever fonts could have been destroyed or reloaded
+	ClearTextCache(game);
+	assert_false(GetSlot(game, font, -1, "font", &slot));
+	assert_false(GetSlot(game, other, -1, "font", &other_slot));
+
+	DrawCachedText(game, other, al_map_rgb(255, 255, 255), 0, 0, 0, "font");
+	assert_true(GetSlot(game, other, -1, "font", &other_slot));
+	assert_int_equal(other_slot.x, 0);
+	assert_int_equal(other_slot.y, 0);
+
+	ClearTextCache(game);
+	al_destroy_font(other);
+}
+
+int test_text(void) {
+	const struct CMUnitTest text_tests[] = {
+		cmocka_unit_test(text_layout_wraps_words),
+		cmocka_unit_test(text_layout_measures_spaces),
+		cmocka_unit_test(text_layout_breaks_newlines),
+		cmocka_unit_test(text_layout_overlong_word),
+		cmocka_unit_test(text_layout_cache_hits),
+		cmocka_unit_test(text_cache_packs_shelves),
+		cmocka_unit_test(text_cache_evicts_least_recent),
+		cmocka_unit_test(text_cache_font_changes),
+	};
+	return cmocka_run_group_tests(text_tests, text_setup, text_teardown);
+}